@@ -23,6 +23,8 @@
 #define GSSDP_CLIENT_PRIVATE_H
 
 #include "gssdp-client.h"
+#include "gssdp-pacer.h"
+#include "gssdp-diagnostics.h"
 
 G_BEGIN_DECLS
 
@@ -32,6 +34,85 @@ typedef enum {
         _GSSDP_ANNOUNCEMENT       = 2
 } _GSSDPMessageType;
 
+/* Defined in gssdp-message.h */
+typedef struct _GSSDPMessage GSSDPMessage;
+
+typedef void (* _GSSDPMessageHandler) (GSSDPClient  *client,
+                                       GSSDPMessage *message,
+                                       gpointer      user_data);
+
+G_GNUC_INTERNAL guint
+_gssdp_client_add_target_handler  (GSSDPClient          *client,
+                                   const char           *target,
+                                   _GSSDPMessageHandler  handler,
+                                   gpointer              user_data);
+
+G_GNUC_INTERNAL guint
+_gssdp_client_add_request_handler (GSSDPClient          *client,
+                                   _GSSDPMessageHandler  handler,
+                                   gpointer              user_data);
+
+G_GNUC_INTERNAL void
+_gssdp_client_remove_handler      (GSSDPClient          *client,
+                                   guint                 handler_id);
+
+G_GNUC_INTERNAL guint
+_gssdp_client_get_message_serial  (GSSDPClient          *client);
+
+G_GNUC_INTERNAL GSSDPDiagnostics *
+_gssdp_client_get_diagnostics     (GSSDPClient          *client);
+
+G_GNUC_INTERNAL void
+_gssdp_add_statistic              (GVariantBuilder      *builder,
+                                   const char           *key,
+                                   guint64               value);
+
+G_GNUC_INTERNAL void
+_gssdp_client_send_vectors (GSSDPClient         *client,
+                            const char          *dest_ip,
+                            gushort              dest_port,
+                            const GOutputVector *vectors,
+                            guint                n_vectors,
+                            _GSSDPMessageType    type);
+
+G_GNUC_INTERNAL void
+_gssdp_client_send_messages (GSSDPClient       *client,
+                             GBytes           **messages,
+                             guint              n_messages,
+                             _GSSDPMessageType  type);
+
+G_GNUC_INTERNAL void
+_gssdp_client_queue_message (GSSDPClient        *client,
+                             GSSDPPacerPriority  priority,
+                             gpointer            owner,
+                             guint               id,
+                             GBytes             *message);
+
+G_GNUC_INTERNAL void
+_gssdp_client_queue_vectors (GSSDPClient         *client,
+                             GSSDPPacerPriority   priority,
+                             gpointer             owner,
+                             const char          *dest_ip,
+                             gushort              dest_port,
+                             const GOutputVector *vectors,
+                             guint                n_vectors,
+                             gint64               request_time);
+
+G_GNUC_INTERNAL void
+_gssdp_client_cancel_messages (GSSDPClient        *client,
+                               GSSDPPacerPriority  priority,
+                               gpointer            owner,
+                               guint               id);
+
+G_GNUC_INTERNAL void
+_gssdp_client_flush_messages  (GSSDPClient        *client,
+                               gpointer            owner);
+
+G_GNUC_INTERNAL void
+_gssdp_client_record_latency (GSSDPClient       *client,
+                              GSSDPLatencyStage  stage,
+                              gint64             since);
+
 G_GNUC_INTERNAL void
 _gssdp_client_send_message (GSSDPClient       *client,
                             const char        *dest_ip,
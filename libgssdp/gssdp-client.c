@@ -43,9 +43,25 @@
 #include "gssdp-protocol.h"
 #include "gssdp-net.h"
 #include "gssdp-socket-functions.h"
+#include "gssdp-parser.h"
+#include "gssdp-message.h"
+#include "gssdp-resource-browser.h"
+#include "gssdp-target.h"
+#include "gssdp-user-agent-cache.h"
+#include "gssdp-ring.h"
+#include "gssdp-diagnostics.h"
 #ifdef HAVE_PKTINFO
 #include "gssdp-pktinfo-message.h"
 #endif
+#ifdef HAVE_RXQ_OVFL
+#include "gssdp-overflow-message.h"
+#endif
+#ifdef HAVE_TIMESTAMPNS
+#include "gssdp-timestamp-message.h"
+#endif
+#ifdef HAVE_LIBURING
+#include "gssdp-uring.h"
+#endif
 
 #include <sys/types.h>
 #include <glib.h>
@@ -66,6 +82,43 @@
 /* Size of the buffer used for reading from the socket */
 #define BUF_SIZE 65536
 
+/* Number of datagrams drained from a socket per main loop wakeup */
+#define DEFAULT_RECEIVE_BATCH_SIZE 8
+#define MAX_RECEIVE_BATCH_SIZE 64
+
+/* Maximum number of datagrams handed to the kernel per send call */
+#define SEND_BATCH_SIZE 64
+
+/* Outgoing message rate limit, see gssdp_client_set_message_rate() */
+#define DEFAULT_MESSAGE_RATE 50
+#define DEFAULT_MESSAGE_BURST 10
+
+/* Peers whose user agent is remembered, and for how many seconds */
+#define DEFAULT_USER_AGENT_CACHE_SIZE 1024
+#define DEFAULT_USER_AGENT_CACHE_TTL  3600
+
+/* Received messages waiting for the application's main context when
+ * receiving on a thread of our own */
+#define RECEIVE_RING_SIZE 1024
+
+/* Upper limit for GSSDPClient:search-workers */
+#define MAX_SEARCH_WORKERS 64
+
+/* Request, multicast and all search sockets */
+#define MAX_SOCKETS (2 + MAX_SEARCH_WORKERS)
+
+/* Latency histogram buckets; bucket i counts latencies of less than 2^i
+ * microseconds, the last one everything from about half a minute on */
+#define LATENCY_BUCKETS 27
+#define N_LATENCY_STAGES (GSSDP_LATENCY_RECEIVE_TO_AVAILABLE + 1)
+
+#define N_MESSAGE_TYPES (_GSSDP_ANNOUNCEMENT + 1)
+
+/* Diagnostics of each kind logged per interval (in milliseconds), see
+ * gssdp-diagnostics.c */
+#define DIAGNOSTIC_BURST 5
+#define DIAGNOSTIC_INTERVAL 60000
+
 /* interface index for loopback device */
 #define LOOPBACK_IFINDEX 1
 
@@ -73,19 +126,107 @@ static void
 gssdp_client_initable_iface_init (gpointer g_iface,
                                   gpointer iface_data);
 
+typedef struct _SearchWorker SearchWorker;
+
 struct _GSSDPClientPrivate {
         char              *server_id;
 
-        GHashTable        *user_agent_cache;
+        GSSDPUserAgentCache *user_agent_cache;
+        guint              user_agent_cache_size;
+        guint              user_agent_cache_ttl;
         guint              socket_ttl;
         guint              msearch_port;
         GSSDPNetworkDevice device;
         GList             *headers;
 
+        /* Custom headers rendered as they go on the wire, including the
+         * blank line ending the message */
+        char              *header_block;
+        gsize              header_block_length;
+
+        /* Bumped whenever something that ends up in outgoing messages
+         * changes, see _gssdp_client_get_message_serial() */
+        guint              message_serial;
+
+        GSocketAddress    *multicast_address;
+
+        /* Rate limit for messages sent on behalf of resource groups */
+        GSSDPPacer        *pacer;
+        guint              message_rate;
+        guint              message_burst;
+
         GSSDPSocketSource *request_socket;
         GSSDPSocketSource *multicast_socket;
         GSSDPSocketSource *search_socket;
 
+        /* Whether the multicast socket only gets traffic for our address,
+         * see is_from_our_interface() */
+        gboolean           multicast_on_own_address;
+
+        /* Kernel side filtering, see update_kernel_filter() */
+        gboolean           kernel_filter;
+        GSSDPSocketAccept  kernel_filter_accept;
+
+        /* Batched receive */
+        guint              receive_batch_size;
+        char              *receive_buffers;
+        guint              receive_buffers_count;
+
+        /* Counted atomically by every receiving thread */
+        gsize              receive_wakeups;
+        gsize              received_datagrams;
+
+        /* See gssdp_client_get_latency_histogram(). Updated atomically, as
+         * receive threads record parse latencies */
+        guint              latency_histograms[N_LATENCY_STAGES]
+                                             [LATENCY_BUCKETS];
+
+        /* See gssdp_client_get_statistics(). Counted with atomic pointer
+         * sized additions, as receive threads count too */
+        gsize              received_counts[N_MESSAGE_TYPES];
+        gsize              sent_counts[N_MESSAGE_TYPES];
+        gsize              parse_failures;
+        gsize              interface_drops;
+        gsize              oversized_drops;
+        gsize              send_errors;
+
+        /* Rate limited warnings about broken packets and peers, shared
+         * with the browsers and groups using this client */
+        GSSDPDiagnostics   diagnostics;
+
+        /* SO_RCVBUF of the sockets, or 0 for the system default */
+        guint              receive_buffer_size;
+
+        /* Receive thread, see GSSDPClient:receive-thread */
+        gboolean           receive_thread;
+        GThread           *io_thread;
+        GMainContext      *io_context;
+        GMainLoop         *io_loop;
+        GMainContext      *main_context;
+        GSSDPRing         *received_messages;
+        GSource           *delivery_source;
+        gint               dropped_messages;
+
+        /* Threads reading discovery responses, see
+         * GSSDPClient:search-workers */
+        guint              n_search_workers;
+        SearchWorker      *search_workers;
+
+        /* io_uring backend, see GSSDPClient:io-uring */
+        gboolean           io_uring;
+#ifdef HAVE_LIBURING
+        GSSDPUring        *uring;
+#endif
+
+        /* Message dispatch, see _gssdp_client_add_target_handler() */
+        GHashTable        *handlers;
+        GHashTable        *target_handlers;
+        GList             *wildcard_handlers;
+        GList             *request_handlers;
+        guint              last_handler_id;
+        guint              dispatch_depth;
+        GList             *removed_handlers;
+
         gboolean           active;
         gboolean           initialized;
 };
@@ -100,12 +241,65 @@ G_DEFINE_TYPE_EXTENDED (GSSDPClient,
                                 (G_TYPE_INITABLE,
                                  gssdp_client_initable_iface_init));
 
+/* Reads one of the search sockets on a thread of its own */
+struct _SearchWorker {
+        GSSDPClient       *client;
+        GSSDPSocketSource *socket;
+        GMainContext      *context;
+        GMainLoop         *loop;
+        GThread           *thread;
+        GSSDPRing         *ring;
+        char              *buffers;
+        guint              buffers_count;
+};
+
+typedef struct {
+        guint                id;
+        char                *key;
+        _GSSDPMessageHandler func;
+        gpointer             user_data;
+        gboolean             removed;
+} MessageHandler;
+
 struct _GSSDPHeaderField {
         char *name;
         char *value;
 };
 typedef struct _GSSDPHeaderField GSSDPHeaderField;
 
+static void
+header_field_free (GSSDPHeaderField *header);
+
+static void
+send_paced_messages (GSSDPPacerItem *items,
+                     guint           n_items,
+                     gpointer        user_data);
+
+static void
+update_kernel_filter (GSSDPClient *client,
+                      gboolean     force);
+
+static void
+start_receive_thread (GSSDPClient *client);
+
+static void
+apply_receive_buffer_size (GSSDPClient *client);
+
+static void
+start_search_workers (GSSDPClient *client);
+
+static void
+stop_search_workers  (GSSDPClient *client);
+
+static void
+stop_delivery        (GSSDPClient *client);
+
+static void
+stop_receive_thread  (GSSDPClient *client);
+
+static gboolean
+start_uring          (GSSDPClient *client);
+
 enum {
         PROP_0,
         PROP_SERVER_ID,
@@ -115,6 +309,16 @@ enum {
         PROP_ACTIVE,
         PROP_SOCKET_TTL,
         PROP_MSEARCH_PORT,
+        PROP_RECEIVE_BATCH_SIZE,
+        PROP_MESSAGE_RATE,
+        PROP_MESSAGE_BURST,
+        PROP_USER_AGENT_CACHE_SIZE,
+        PROP_USER_AGENT_CACHE_TTL,
+        PROP_KERNEL_FILTER,
+        PROP_RECEIVE_THREAD,
+        PROP_RECEIVE_BUFFER_SIZE,
+        PROP_SEARCH_WORKERS,
+        PROP_IO_URING,
 };
 
 enum {
@@ -143,6 +347,9 @@ static gboolean
 init_network_info             (GSSDPClient  *client,
                                GError      **error);
 
+static void
+message_handler_free          (MessageHandler *handler);
+
 static gboolean
 gssdp_client_initable_init    (GInitable     *initable,
                                GCancellable  *cancellable,
@@ -154,6 +361,36 @@ gssdp_client_init (GSSDPClient *client)
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
         priv->active = TRUE;
+        priv->receive_batch_size = DEFAULT_RECEIVE_BATCH_SIZE;
+        priv->n_search_workers = 1;
+
+        gssdp_diagnostics_init (&priv->diagnostics,
+                                DIAGNOSTIC_BURST,
+                                DIAGNOSTIC_INTERVAL);
+
+        priv->message_rate = DEFAULT_MESSAGE_RATE;
+        priv->message_burst = DEFAULT_MESSAGE_BURST;
+        priv->pacer = gssdp_pacer_new (send_paced_messages, client);
+        gssdp_pacer_set_rate (priv->pacer,
+                              priv->message_rate,
+                              priv->message_burst);
+
+        priv->user_agent_cache_size = DEFAULT_USER_AGENT_CACHE_SIZE;
+        priv->user_agent_cache_ttl = DEFAULT_USER_AGENT_CACHE_TTL;
+        priv->user_agent_cache = gssdp_user_agent_cache_new
+                                        (priv->user_agent_cache_size,
+                                         priv->user_agent_cache_ttl);
+
+        priv->handlers = g_hash_table_new_full (NULL,
+                                                NULL,
+                                                NULL,
+                                                (GDestroyNotify)
+                                                message_handler_free);
+        priv->target_handlers = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free,
+                                                       (GDestroyNotify)
+                                                       g_queue_free);
 
         /* Generate default server ID */
         priv->server_id = make_server_id ();
@@ -249,16 +486,55 @@ gssdp_client_initable_init (GInitable                   *initable,
                 return FALSE;
         }
 
-        gssdp_socket_source_attach (priv->request_socket);
-        gssdp_socket_source_attach (priv->multicast_socket);
-        gssdp_socket_source_attach (priv->search_socket);
+        /* Datagrams are checked to have arrived for our address on our
+         * interface. On a socket bound to an interface with no other
+         * address, that cannot fail, so neither the check nor the
+         * IP_PKTINFO messages it needs are of any use. */
+        if (gssdp_socket_source_is_bound_to_device (priv->multicast_socket) &&
+            gssdp_net_is_only_host_ip (&priv->device)) {
+                priv->multicast_on_own_address = TRUE;
+
+                if (!gssdp_socket_enable_info
+                                (gssdp_socket_source_get_socket
+                                        (priv->multicast_socket),
+                                 FALSE,
+                                 &internal_error)) {
+                        g_debug ("Failed to disable info messages: %s",
+                                 internal_error->message);
+                        g_clear_error (&internal_error);
+                }
+        }
+
+        if (priv->n_search_workers > 1)
+                start_search_workers (client);
 
-        priv->initialized = TRUE;
+        if (priv->receive_buffer_size > 0)
+                apply_receive_buffer_size (client);
+
+        /* With a receive thread, the sockets are only ever read there */
+        if (priv->receive_thread) {
+                priv->io_context = g_main_context_new ();
+                g_main_context_push_thread_default (priv->io_context);
+        }
+
+        if (!priv->io_uring || !start_uring (client)) {
+                gssdp_socket_source_attach (priv->request_socket);
+                gssdp_socket_source_attach (priv->multicast_socket);
+                if (priv->n_search_workers <= 1)
+                        gssdp_socket_source_attach (priv->search_socket);
+        }
+
+        if (priv->receive_thread) {
+                g_main_context_pop_thread_default (priv->io_context);
+                start_receive_thread (client);
+        }
 
-        priv->user_agent_cache = g_hash_table_new_full (g_str_hash,
-                                                        g_str_equal,
-                                                        g_free,
-                                                        g_free);
+        if (priv->kernel_filter)
+                update_kernel_filter (client, TRUE);
+        gssdp_pacer_attach (priv->pacer,
+                            g_main_context_get_thread_default ());
+
+        priv->initialized = TRUE;
 
         return TRUE;
 }
@@ -299,6 +575,36 @@ gssdp_client_get_property (GObject    *object,
         case PROP_MSEARCH_PORT:
                 g_value_set_uint (value, priv->msearch_port);
                 break;
+        case PROP_RECEIVE_BATCH_SIZE:
+                g_value_set_uint (value, priv->receive_batch_size);
+                break;
+        case PROP_MESSAGE_RATE:
+                g_value_set_uint (value, priv->message_rate);
+                break;
+        case PROP_MESSAGE_BURST:
+                g_value_set_uint (value, priv->message_burst);
+                break;
+        case PROP_USER_AGENT_CACHE_SIZE:
+                g_value_set_uint (value, priv->user_agent_cache_size);
+                break;
+        case PROP_USER_AGENT_CACHE_TTL:
+                g_value_set_uint (value, priv->user_agent_cache_ttl);
+                break;
+        case PROP_KERNEL_FILTER:
+                g_value_set_boolean (value, priv->kernel_filter);
+                break;
+        case PROP_RECEIVE_THREAD:
+                g_value_set_boolean (value, priv->receive_thread);
+                break;
+        case PROP_RECEIVE_BUFFER_SIZE:
+                g_value_set_uint (value, priv->receive_buffer_size);
+                break;
+        case PROP_SEARCH_WORKERS:
+                g_value_set_uint (value, priv->n_search_workers);
+                break;
+        case PROP_IO_URING:
+                g_value_set_boolean (value, priv->io_uring);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -337,6 +643,43 @@ gssdp_client_set_property (GObject      *object,
         case PROP_MSEARCH_PORT:
                 priv->msearch_port = g_value_get_uint (value);
                 break;
+        case PROP_RECEIVE_BATCH_SIZE:
+                gssdp_client_set_receive_batch_size (client,
+                                                     g_value_get_uint (value));
+                break;
+        case PROP_MESSAGE_RATE:
+                gssdp_client_set_message_rate (client,
+                                               g_value_get_uint (value));
+                break;
+        case PROP_MESSAGE_BURST:
+                gssdp_client_set_message_burst (client,
+                                                g_value_get_uint (value));
+                break;
+        case PROP_USER_AGENT_CACHE_SIZE:
+                gssdp_client_set_user_agent_cache_size
+                                        (client, g_value_get_uint (value));
+                break;
+        case PROP_USER_AGENT_CACHE_TTL:
+                gssdp_client_set_user_agent_cache_ttl
+                                        (client, g_value_get_uint (value));
+                break;
+        case PROP_KERNEL_FILTER:
+                gssdp_client_set_kernel_filter
+                                        (client, g_value_get_boolean (value));
+                break;
+        case PROP_RECEIVE_THREAD:
+                priv->receive_thread = g_value_get_boolean (value);
+                break;
+        case PROP_RECEIVE_BUFFER_SIZE:
+                gssdp_client_set_receive_buffer_size
+                                        (client, g_value_get_uint (value));
+                break;
+        case PROP_SEARCH_WORKERS:
+                priv->n_search_workers = g_value_get_uint (value);
+                break;
+        case PROP_IO_URING:
+                priv->io_uring = g_value_get_boolean (value);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -349,6 +692,25 @@ gssdp_client_dispose (GObject *object)
         GSSDPClient *client = GSSDP_CLIENT (object);
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
+        /* Whatever resource groups left behind is sent without delay, as
+         * long as there still is a socket to send it on */
+        if (priv->pacer != NULL) {
+                if (priv->initialized)
+                        gssdp_pacer_flush (priv->pacer);
+
+                g_clear_pointer (&priv->pacer, gssdp_pacer_destroy);
+        }
+
+#ifdef HAVE_LIBURING
+        /* Waits for the flushed messages to go out */
+        g_clear_pointer (&priv->uring, gssdp_uring_free);
+#endif
+
+        /* Nothing may read from the sockets while they are going away */
+        stop_search_workers (client);
+        stop_receive_thread (client);
+        stop_delivery (client);
+
         /* Destroy the SocketSources */
         g_clear_object (&priv->request_socket);
         g_clear_object (&priv->multicast_socket);
@@ -367,11 +729,26 @@ gssdp_client_finalize (GObject *object)
         gssdp_net_shutdown ();
 
         g_clear_pointer (&priv->server_id, g_free);
+        g_list_free_full (priv->headers,
+                          (GDestroyNotify) header_field_free);
+        priv->headers = NULL;
+        g_clear_pointer (&priv->header_block, g_free);
+        g_clear_object (&priv->multicast_address);
         g_clear_pointer (&priv->device.iface_name, g_free);
         g_clear_pointer (&priv->device.host_ip, g_free);
         g_clear_pointer (&priv->device.network, g_free);
 
-        g_clear_pointer (&priv->user_agent_cache, g_hash_table_unref);
+        g_clear_pointer (&priv->user_agent_cache,
+                         gssdp_user_agent_cache_free);
+        g_clear_pointer (&priv->receive_buffers, g_free);
+        g_clear_pointer (&priv->io_context, g_main_context_unref);
+        gssdp_diagnostics_clear (&priv->diagnostics);
+
+        /* The lists only reference handlers owned by priv->handlers */
+        g_clear_pointer (&priv->target_handlers, g_hash_table_unref);
+        g_clear_pointer (&priv->wildcard_handlers, g_list_free);
+        g_clear_pointer (&priv->request_handlers, g_list_free);
+        g_clear_pointer (&priv->handlers, g_hash_table_unref);
 
         G_OBJECT_CLASS (gssdp_client_parent_class)->finalize (object);
 }
@@ -529,6 +906,219 @@ gssdp_client_class_init (GSSDPClientClass *klass)
                          G_PARAM_CONSTRUCT_ONLY |
                          G_PARAM_STATIC_STRINGS));
 
+        /**
+         * GSSDPClient:receive-batch-size:
+         *
+         * Maximum number of datagrams read from a socket each time it
+         * becomes readable. Values larger than one let the client drain
+         * announcement bursts with a single recvmmsg() call instead of one
+         * main loop iteration per packet.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_RECEIVE_BATCH_SIZE,
+                 g_param_spec_uint
+                        ("receive-batch-size",
+                         "Receive batch size",
+                         "Maximum number of datagrams read per wakeup",
+                         1, MAX_RECEIVE_BATCH_SIZE,
+                         DEFAULT_RECEIVE_BATCH_SIZE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:message-rate:
+         *
+         * Average number of messages per second the resource groups using
+         * this client may send, or 0 for no limit. Discovery responses take
+         * precedence over ssdp:byebye messages, which in turn take
+         * precedence over ssdp:alive messages.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_MESSAGE_RATE,
+                 g_param_spec_uint
+                        ("message-rate",
+                         "Message rate",
+                         "Average number of messages sent per second",
+                         0, G_MAXUINT,
+                         DEFAULT_MESSAGE_RATE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:message-burst:
+         *
+         * Number of messages that may be sent back to back after a quiet
+         * period, see #GSSDPClient:message-rate.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_MESSAGE_BURST,
+                 g_param_spec_uint
+                        ("message-burst",
+                         "Message burst",
+                         "Number of messages that may be sent at once",
+                         1, G_MAXUINT,
+                         DEFAULT_MESSAGE_BURST,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:user-agent-cache-size:
+         *
+         * Number of peers whose user agent is remembered for
+         * gssdp_client_guess_user_agent(). When the cache is full, the peer
+         * heard from least recently is forgotten. 0 disables the cache.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_USER_AGENT_CACHE_SIZE,
+                 g_param_spec_uint
+                        ("user-agent-cache-size",
+                         "User agent cache size",
+                         "Number of peers whose user agent is remembered",
+                         0, G_MAXUINT,
+                         DEFAULT_USER_AGENT_CACHE_SIZE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:user-agent-cache-ttl:
+         *
+         * Number of seconds after which the user agent of a silent peer is
+         * forgotten, or 0 to keep it as long as there is room.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_USER_AGENT_CACHE_TTL,
+                 g_param_spec_uint
+                        ("user-agent-cache-ttl",
+                         "User agent cache TTL",
+                         "Seconds after which the user agent of a silent "
+                         "peer is forgotten",
+                         0, G_MAXUINT,
+                         DEFAULT_USER_AGENT_CACHE_TTL,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:kernel-filter:
+         *
+         * Whether to have the kernel drop datagrams nobody using this client
+         * is interested in, before they are copied to user space. This only
+         * has an effect on Linux.
+         *
+         * With the filter in place, the internal ::message-received signal
+         * only sees what resource browsers and groups of this client need.
+         * The kernel counts filtered datagrams as dropped, so
+         * gssdp_client_get_dropped_datagrams() is not updated meanwhile.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_KERNEL_FILTER,
+                 g_param_spec_boolean
+                        ("kernel-filter",
+                         "Kernel filter",
+                         "Whether to drop unwanted datagrams in the kernel",
+                         FALSE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:receive-thread:
+         *
+         * Whether the client reads and parses datagrams on a thread of its
+         * own. Received messages are still handed to resource browsers and
+         * groups in batches on the main context that was the thread-default
+         * one when the client was initialized, but datagrams no longer pile
+         * up in the kernel while that context is busy.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_RECEIVE_THREAD,
+                 g_param_spec_boolean
+                        ("receive-thread",
+                         "Receive thread",
+                         "Whether to receive on a dedicated thread",
+                         FALSE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:receive-buffer-size:
+         *
+         * Size of the kernel receive buffer of each socket in bytes, or 0
+         * to keep the system default. Announcements of many devices tend to
+         * arrive in bursts that overflow small buffers; see
+         * gssdp_client_get_dropped_datagrams() to find out whether they do.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_RECEIVE_BUFFER_SIZE,
+                 g_param_spec_uint
+                        ("receive-buffer-size",
+                         "Receive buffer size",
+                         "Kernel receive buffer size of the sockets",
+                         0, G_MAXINT / 2,
+                         0,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:search-workers:
+         *
+         * Number of threads reading and parsing the unicast responses to
+         * discovery requests. With more than one, the client opens that many
+         * sockets sharing the M-SEARCH port with SO_REUSEPORT and the kernel
+         * spreads the responses over them by sender. The parsed responses
+         * are handed to resource browsers on the main context that was the
+         * thread-default one when the client was initialized.
+         *
+         * This only helps on Linux, where SO_REUSEPORT balances unicast
+         * datagrams. Elsewhere only the first socket receives anything.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_SEARCH_WORKERS,
+                 g_param_spec_uint
+                        ("search-workers",
+                         "Search workers",
+                         "Number of threads receiving discovery responses",
+                         1, MAX_SEARCH_WORKERS,
+                         1,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GSSDPClient:io-uring:
+         *
+         * Whether to receive and send through a Linux io_uring instead of
+         * polling the sockets. Each socket then has a single receive request
+         * pending that keeps delivering datagrams without further system
+         * calls, and messages sent while the main context dispatches are
+         * submitted together.
+         *
+         * This needs GSSDP to be built with liburing and Linux 6.0 or newer.
+         * The client silently falls back to polling if either is missing or
+         * if #GSSDPClient:receive-thread or #GSSDPClient:search-workers are
+         * used. Datagrams larger than about 8 KiB are dropped.
+         */
+        g_object_class_install_property
+                (object_class,
+                 PROP_IO_URING,
+                 g_param_spec_boolean
+                        ("io-uring",
+                         "io_uring",
+                         "Whether to use io_uring for socket I/O",
+                         FALSE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS));
+
         /**
          * GSSDPClient::message-received: (skip)
          * @client: The #GSSDPClient that received the message.
@@ -616,6 +1206,8 @@ gssdp_client_set_server_id (GSSDPClient *client,
         if (server_id)
                 priv->server_id = g_strdup (server_id);
 
+        priv->message_serial++;
+
         g_object_notify (G_OBJECT (client), "server-id");
 }
 
@@ -721,10 +1313,12 @@ gssdp_client_add_cache_entry (GSSDPClient  *client,
 
         hwaddr = gssdp_net_arp_lookup (&priv->device, ip_address);
 
-        if (hwaddr)
-                g_hash_table_insert (priv->user_agent_cache,
-                                     hwaddr,
-                                     g_strdup (user_agent));
+        if (hwaddr) {
+                gssdp_user_agent_cache_update (priv->user_agent_cache,
+                                               hwaddr,
+                                               user_agent);
+                g_free (hwaddr);
+        }
 }
 
 /**
@@ -752,8 +1346,8 @@ gssdp_client_guess_user_agent (GSSDPClient *client,
         if (hwaddr) {
                 const char *agent;
 
-                agent =  g_hash_table_lookup (priv->user_agent_cache,
-                                              hwaddr);
+                agent = gssdp_user_agent_cache_lookup (priv->user_agent_cache,
+                                                       hwaddr);
                 g_free (hwaddr);
 
                 return agent;
@@ -798,474 +1392,2442 @@ gssdp_client_get_active (GSSDPClient *client)
         return priv->active;
 }
 
-static void
-header_field_free (GSSDPHeaderField *header)
+/**
+ * gssdp_client_set_receive_batch_size:
+ * @client: A #GSSDPClient
+ * @batch_size: Maximum number of datagrams to read per wakeup
+ *
+ * Sets the maximum number of datagrams @client reads from one of its sockets
+ * each time it becomes readable.
+ **/
+void
+gssdp_client_set_receive_batch_size (GSSDPClient *client,
+                                     guint        batch_size)
 {
-        g_free (header->name);
-        g_free (header->value);
-        g_slice_free (GSSDPHeaderField, header);
-}
+        GSSDPClientPrivate *priv = NULL;
 
-static gchar *
-append_header_fields (GList *headers, const gchar *message)
-{
-        GString *str = NULL;
-        GList *iter = NULL;
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (batch_size > 0 &&
+                          batch_size <= MAX_RECEIVE_BATCH_SIZE);
 
-        str = g_string_new (message);
+        priv = gssdp_client_get_instance_private (client);
 
-        for (iter = headers; iter; iter = iter->next) {
-                GSSDPHeaderField *header = (GSSDPHeaderField *) iter->data;
-                g_string_append_printf (str, "%s: %s\r\n",
-                                        header->name,
-                                        header->value ? header->value : "");
-        }
+        if (priv->receive_batch_size == batch_size)
+                return;
 
-        g_string_append (str, "\r\n");
+        /* Buffers are re-allocated on next wakeup; they might be in use
+         * right now if this is called from a signal handler or while the
+         * receive thread is reading */
+        g_atomic_int_set ((gint *) &priv->receive_batch_size,
+                          (gint) batch_size);
 
-        return g_string_free (str, FALSE);
+        g_object_notify (G_OBJECT (client), "receive-batch-size");
 }
 
 /**
- * gssdp_client_append_header:
+ * gssdp_client_get_receive_batch_size:
  * @client: A #GSSDPClient
- * @name: Header name
- * @value: Header value
  *
- * Adds a header field to the message sent by this @client. It is intended to
- * be used by clients requiring vendor specific header fields. (If there is an
- * existing header with name name , then this creates a second one).
+ * Return value: The maximum number of datagrams read per wakeup.
  **/
-void
-gssdp_client_append_header (GSSDPClient *client,
-                            const char  *name,
-                            const char  *value)
+guint
+gssdp_client_get_receive_batch_size (GSSDPClient *client)
 {
-        GSSDPHeaderField *header = NULL;
         GSSDPClientPrivate *priv = NULL;
 
-        g_return_if_fail (GSSDP_IS_CLIENT (client));
-        g_return_if_fail (name != NULL);
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
 
         priv = gssdp_client_get_instance_private (client);
 
-        header = g_slice_new (GSSDPHeaderField);
-        header->name = g_strdup (name);
-        header->value = g_strdup (value);
-        priv->headers = g_list_append (priv->headers, header);
+        return priv->receive_batch_size;
+}
+
+static void
+count (gsize *counter)
+{
+        g_atomic_pointer_add (counter, 1);
+}
+
+static guint64
+read_counter (gsize *counter)
+{
+        return (gsize) g_atomic_pointer_get (counter);
 }
 
 /**
- * gssdp_client_remove_header:
+ * gssdp_client_get_receive_batch_depth:
  * @client: A #GSSDPClient
- * @name: Header name
  *
- * Removes @name from the list of headers . If there are multiple values for
- * @name, they are all removed.
+ * Get the average number of datagrams that were read each time one of the
+ * sockets of @client became readable. A value close to
+ * #GSSDPClient:receive-batch-size suggests the batch size can be increased.
+ *
+ * Return value: The average receive batch depth, or 0 if nothing was received
+ * yet.
  **/
-void
-gssdp_client_remove_header (GSSDPClient *client,
-                            const char  *name)
+gdouble
+gssdp_client_get_receive_batch_depth (GSSDPClient *client)
 {
-        GSSDPClientPrivate *priv;
-        GList *l;
+        GSSDPClientPrivate *priv = NULL;
+        gdouble depth = 0.0;
+        guint64 wakeups;
 
-        g_return_if_fail (GSSDP_IS_CLIENT (client));
-        g_return_if_fail (name != NULL);
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0.0);
 
         priv = gssdp_client_get_instance_private (client);
-        l = priv->headers;
-        while (l != NULL)
-        {
-                GList *next = l->next;
-                GSSDPHeaderField *header = l->data;
 
-                if (!g_strcmp0 (header->name, name)) {
-                        header_field_free (header);
-                        priv->headers = g_list_delete_link (priv->headers, l);
+#ifdef HAVE_LIBURING
+        if (priv->uring != NULL) {
+                guint64 datagrams;
+
+                gssdp_uring_get_stats (priv->uring, &wakeups, &datagrams);
+                if (wakeups > 0)
+                        depth = (gdouble) datagrams / (gdouble) wakeups;
+
+                return depth;
+        }
+#endif
+
+        wakeups = read_counter (&priv->receive_wakeups);
+        if (wakeups > 0)
+                depth = (gdouble) read_counter (&priv->received_datagrams) /
+                        (gdouble) wakeups;
+
+        return depth;
+}
+
+/*
+ * Fills @sockets with all socket sources @client has open, including those
+ * of the search workers, and returns their number
+ */
+static guint
+get_socket_sources (GSSDPClient        *client,
+                    GSSDPSocketSource **sockets)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        guint n = 0, i;
+
+        if (priv->request_socket != NULL)
+                sockets[n++] = priv->request_socket;
+        if (priv->multicast_socket != NULL)
+                sockets[n++] = priv->multicast_socket;
+        if (priv->search_socket != NULL)
+                sockets[n++] = priv->search_socket;
+
+        /* The first worker reads priv->search_socket */
+        for (i = 1;
+             priv->search_workers != NULL && i < priv->n_search_workers;
+             i++)
+                if (priv->search_workers[i].socket != NULL)
+                        sockets[n++] = priv->search_workers[i].socket;
+
+        return n;
+}
+
+static void
+apply_receive_buffer_size (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSSDPSocketSource *sockets[MAX_SOCKETS];
+        guint n, i;
+
+        n = get_socket_sources (client, sockets);
+
+        for (i = 0; i < n; i++) {
+                GError *error = NULL;
+
+                if (!gssdp_socket_source_set_receive_buffer_size
+                                        (sockets[i],
+                                         priv->receive_buffer_size,
+                                         &error)) {
+                        g_warning ("Failed to set receive buffer size: %s",
+                                   error->message);
+                        g_error_free (error);
                 }
-                l = next;
         }
 }
 
 /**
- * gssdp_client_clear_headers:
+ * gssdp_client_set_receive_buffer_size:
  * @client: A #GSSDPClient
+ * @size: Buffer size in bytes, or 0 for the system default
  *
- * Removes all the headers for this @client.
+ * Sets the size of the kernel receive buffer of the sockets of @client. The
+ * system wide limit is only exceeded if the process is allowed to.
+ * Going back to the system default only takes effect for new clients.
  **/
 void
-gssdp_client_clear_headers (GSSDPClient *client)
+gssdp_client_set_receive_buffer_size (GSSDPClient *client,
+                                      guint        size)
 {
         GSSDPClientPrivate *priv = NULL;
 
         g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (size <= G_MAXINT / 2);
+
         priv = gssdp_client_get_instance_private (client);
 
-        g_list_free_full (priv->headers,
-                          (GDestroyNotify) header_field_free);
+        if (priv->receive_buffer_size == size)
+                return;
+
+        priv->receive_buffer_size = size;
+        if (size > 0)
+                apply_receive_buffer_size (client);
+
+        g_object_notify (G_OBJECT (client), "receive-buffer-size");
 }
 
 /**
- * _gssdp_client_send_message:
+ * gssdp_client_get_receive_buffer_size:
  * @client: A #GSSDPClient
- * @dest_ip: (allow-none): The destination IP address, or %NULL to broadcast
- * @dest_port: (allow-none): The destination port, or %NULL for default
- * @message: The message to send
  *
- * Sends @message to @dest_ip.
+ * Return value: The requested receive buffer size in bytes, or 0 if the
+ * system default is used.
  **/
-void
-_gssdp_client_send_message (GSSDPClient      *client,
-                            const char       *dest_ip,
-                            gushort           dest_port,
-                            const char       *message,
-                            _GSSDPMessageType type)
+guint
+gssdp_client_get_receive_buffer_size (GSSDPClient *client)
 {
         GSSDPClientPrivate *priv = NULL;
-        gssize res;
-        GError *error = NULL;
-        GInetAddress *inet_address = NULL;
-        GSocketAddress *address = NULL;
-        GSocket *socket;
-        char *extended_message;
 
-        g_return_if_fail (GSSDP_IS_CLIENT (client));
-        g_return_if_fail (message != NULL);
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
 
         priv = gssdp_client_get_instance_private (client);
 
-        if (!priv->active)
-                /* We don't send messages in passive mode */
-                return;
+        return priv->receive_buffer_size;
+}
 
-        /* Broadcast if @dest_ip is NULL */
-        if (dest_ip == NULL)
-                dest_ip = SSDP_ADDR;
+/**
+ * gssdp_client_get_dropped_datagrams:
+ * @client: A #GSSDPClient
+ *
+ * Get the number of datagrams the kernel dropped because a receive buffer of
+ * @client was full. The kernel only reports this along with the next datagram
+ * that made it, and only on Linux; elsewhere this is always 0.
+ *
+ * The kernel does not tell datagrams rejected by the socket filter apart
+ * from those dropped on a full buffer. So while #GSSDPClient:kernel-filter
+ * is on, this number is not updated, and drops that happen then are not
+ * counted at all.
+ *
+ * Return value: The number of dropped datagrams.
+ **/
+guint64
+gssdp_client_get_dropped_datagrams (GSSDPClient *client)
+{
+        GSSDPSocketSource *sockets[MAX_SOCKETS];
+        guint64 drops = 0;
+        guint n, i;
 
-        /* Use default port if no port was explicitly specified */
-        if (dest_port == 0)
-                dest_port = SSDP_PORT;
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
 
-        if (type == _GSSDP_DISCOVERY_REQUEST)
-                socket = gssdp_socket_source_get_socket
-                                        (priv->search_socket);
-        else
-                socket = gssdp_socket_source_get_socket
-                                        (priv->request_socket);
+        n = get_socket_sources (client, sockets);
+        for (i = 0; i < n; i++)
+                drops += gssdp_socket_source_get_drops (sockets[i]);
 
-        inet_address = g_inet_address_new_from_string (dest_ip);
-        address = g_inet_socket_address_new (inet_address, dest_port);
-        extended_message = append_header_fields (priv->headers, message);
-
-        res = g_socket_send_to (socket,
-                                address,
-                                extended_message,
-                                strlen (extended_message),
-                                NULL,
-                                &error);
-
-        if (res == -1) {
-                g_warning ("Error sending SSDP packet to %s: %s",
-                           dest_ip,
-                           error->message);
-                g_error_free (error);
-        }
+        return drops;
+}
 
-        g_free (extended_message);
-        g_object_unref (address);
-        g_object_unref (inet_address);
+/* Adds a counter to a statistics snapshot, see gssdp_client_get_statistics() */
+void
+_gssdp_add_statistic (GVariantBuilder *builder,
+                      const char      *key,
+                      guint64          value)
+{
+        g_variant_builder_add (builder,
+                               "{sv}",
+                               key,
+                               g_variant_new_uint64 (value));
 }
 
-/*
- * Generates the default server ID
- */
-static char *
-make_server_id (void)
+/**
+ * gssdp_client_get_statistics:
+ * @client: A #GSSDPClient
+ *
+ * Get a snapshot of the counters @client keeps, as a dictionary of
+ * unsigned 64 bit integers. The keys are:
+ *
+ * <itemizedlist>
+ * <listitem><para>received-requests, received-responses,
+ * received-announcements: Messages received by type.</para></listitem>
+ * <listitem><para>sent-requests, sent-responses, sent-announcements:
+ * Messages sent by type.</para></listitem>
+ * <listitem><para>parse-failures: Datagrams that were no SSDP
+ * message.</para></listitem>
+ * <listitem><para>interface-drops: Datagrams ignored because they arrived
+ * on another network interface.</para></listitem>
+ * <listitem><para>oversized-drops: Datagrams ignored because they did not fit
+ * into the receive buffer.</para></listitem>
+ * <listitem><para>send-errors: Messages that could not be
+ * sent.</para></listitem>
+ * <listitem><para>dropped-datagrams: See
+ * gssdp_client_get_dropped_datagrams().</para></listitem>
+ * <listitem><para>dropped-messages: Messages dropped because the main context
+ * did not keep up with #GSSDPClient:receive-thread or
+ * #GSSDPClient:search-workers.</para></listitem>
+ * <listitem><para>queued-messages: Messages waiting for the rate limit, see
+ * gssdp_client_set_message_rate().</para></listitem>
+ * <listitem><para>receive-wakeups, received-datagrams: The numbers
+ * gssdp_client_get_receive_batch_depth() is computed from.</para></listitem>
+ * <listitem><para>diagnostics-invalid-cache-control,
+ * diagnostics-invalid-expires, diagnostics-missing-expiry,
+ * diagnostics-invalid-search, diagnostics-oversized-datagram,
+ * diagnostics-send-error, diagnostics-receive-error: Problems reported by
+ * @client and the resource browsers and groups using it, by
+ * kind.</para></listitem>
+ * <listitem><para>suppressed-diagnostics: Warnings about those problems that
+ * were not logged because of the rate limit.</para></listitem>
+ * </itemizedlist>
+ *
+ * All counters are updated with plain atomic operations, so taking snapshots
+ * frequently is cheap. More keys may be added in the future.
+ *
+ * Return value: (transfer full): A #GVariant of type a{sv}. Free with
+ * g_variant_unref().
+ **/
+GVariant *
+gssdp_client_get_statistics (GSSDPClient *client)
 {
-#ifdef G_OS_WIN32
-        OSVERSIONINFO versioninfo;
-        versioninfo.dwOSVersionInfoSize = sizeof (OSVERSIONINFO);
-        if (GetVersionEx (&versioninfo)) {
-                return g_strdup_printf ("Microsoft Windows/%ld.%ld GSSDP/%s",
-                                        versioninfo.dwMajorVersion,
-                                        versioninfo.dwMinorVersion,
-                                        VERSION);
-        } else {
-                return g_strdup_printf ("Microsoft Windows GSSDP/%s",
-                                        VERSION);
-        }
-#else
-        struct utsname sysinfo;
+        GSSDPClientPrivate *priv = NULL;
+        GVariantBuilder builder;
+        guint64 wakeups, datagrams;
 
-        uname (&sysinfo);
-        
-        return g_strdup_printf ("%s/%s GSSDP/%s",
-                                sysinfo.sysname,
-                                sysinfo.version,
-                                VERSION);
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), NULL);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        wakeups = read_counter (&priv->receive_wakeups);
+        datagrams = read_counter (&priv->received_datagrams);
+
+#ifdef HAVE_LIBURING
+        if (priv->uring != NULL)
+                gssdp_uring_get_stats (priv->uring, &wakeups, &datagrams);
 #endif
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+        _gssdp_add_statistic (&builder,
+                              "received-requests",
+                              read_counter (&priv->received_counts
+                                               [_GSSDP_DISCOVERY_REQUEST]));
+        _gssdp_add_statistic (&builder,
+                              "received-responses",
+                              read_counter (&priv->received_counts
+                                               [_GSSDP_DISCOVERY_RESPONSE]));
+        _gssdp_add_statistic (&builder,
+                              "received-announcements",
+                              read_counter (&priv->received_counts
+                                               [_GSSDP_ANNOUNCEMENT]));
+        _gssdp_add_statistic (&builder,
+                              "sent-requests",
+                              read_counter (&priv->sent_counts
+                                               [_GSSDP_DISCOVERY_REQUEST]));
+        _gssdp_add_statistic (&builder,
+                              "sent-responses",
+                              read_counter (&priv->sent_counts
+                                               [_GSSDP_DISCOVERY_RESPONSE]));
+        _gssdp_add_statistic (&builder,
+                              "sent-announcements",
+                              read_counter (&priv->sent_counts
+                                               [_GSSDP_ANNOUNCEMENT]));
+        _gssdp_add_statistic (&builder,
+                              "parse-failures",
+                              read_counter (&priv->parse_failures));
+        _gssdp_add_statistic (&builder,
+                              "interface-drops",
+                              read_counter (&priv->interface_drops));
+        _gssdp_add_statistic (&builder,
+                              "oversized-drops",
+                              read_counter (&priv->oversized_drops));
+        _gssdp_add_statistic (&builder,
+                              "send-errors",
+                              read_counter (&priv->send_errors));
+        _gssdp_add_statistic (&builder,
+                              "dropped-datagrams",
+                              gssdp_client_get_dropped_datagrams (client));
+        _gssdp_add_statistic (&builder,
+                              "dropped-messages",
+                              (guint) g_atomic_int_get
+                                        (&priv->dropped_messages));
+        _gssdp_add_statistic (&builder,
+                              "queued-messages",
+                              priv->pacer != NULL ?
+                              gssdp_pacer_get_n_queued (priv->pacer) : 0);
+        _gssdp_add_statistic (&builder, "receive-wakeups", wakeups);
+        _gssdp_add_statistic (&builder, "received-datagrams", datagrams);
+        gssdp_diagnostics_add_statistics (&priv->diagnostics, &builder);
+
+        return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
 
-static gboolean
-parse_http_request (char                *buf,
-                    int                  len,
-                    SoupMessageHeaders **headers,
-                    int                 *type)
-{
-        char *req_method = NULL;
-        char *path = NULL;
-        SoupHTTPVersion version;
-
-        *headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_REQUEST);
-
-        if (soup_headers_parse_request (buf,
-                                        len,
-                                        *headers,
-                                        &req_method,
-                                        &path,
-                                        &version) == SOUP_STATUS_OK &&
-            version == SOUP_HTTP_1_1 &&
-            (path && g_ascii_strncasecmp (path, "*", 1) == 0)) {
-                if (g_ascii_strncasecmp (req_method,
-                                         SSDP_SEARCH_METHOD,
-                                         strlen (SSDP_SEARCH_METHOD)) == 0)
-                        *type = _GSSDP_DISCOVERY_REQUEST;
-                else if (g_ascii_strncasecmp (req_method,
-                                              GENA_NOTIFY_METHOD,
-                                              strlen (GENA_NOTIFY_METHOD)) == 0)
-                        *type = _GSSDP_ANNOUNCEMENT;
-                else
-                        g_warning ("Unhandled method '%s'", req_method);
+/**
+ * gssdp_client_get_latency_histogram:
+ * @client: A #GSSDPClient
+ * @stage: The stage of message processing
+ * @n_buckets: (out): Location to store the number of buckets
+ *
+ * Get a histogram of the latencies @client measured for @stage. Bucket 0
+ * counts latencies of less than a microsecond, every bucket i after it
+ * latencies from 2^(i-1) up to 2^i microseconds. The last bucket also counts
+ * everything longer than that.
+ *
+ * Latencies are measured with the wall clock, so a clock change shows up as
+ * a single outlier.
+ *
+ * Return value: (array length=n_buckets) (transfer full): The number of
+ * measurements in each bucket. Free with g_free().
+ **/
+guint64 *
+gssdp_client_get_latency_histogram (GSSDPClient       *client,
+                                    GSSDPLatencyStage  stage,
+                                    guint             *n_buckets)
+{
+        GSSDPClientPrivate *priv = NULL;
+        guint64 *buckets;
+        guint i;
 
-                g_free (req_method);
-                g_free (path);
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), NULL);
+        g_return_val_if_fail (stage < N_LATENCY_STAGES, NULL);
+        g_return_val_if_fail (n_buckets != NULL, NULL);
 
-                return TRUE;
-        } else {
-                soup_message_headers_free (*headers);
-                *headers = NULL;
+        priv = gssdp_client_get_instance_private (client);
 
-                g_free (path);
-                g_free (req_method);
+        buckets = g_new (guint64, LATENCY_BUCKETS);
+        for (i = 0; i < LATENCY_BUCKETS; i++)
+                buckets[i] = (guint) g_atomic_int_get
+                        ((gint *) &priv->latency_histograms[stage][i]);
+        *n_buckets = LATENCY_BUCKETS;
 
-                return FALSE;
-        }
+        return buckets;
 }
 
-static gboolean
-parse_http_response (char                *buf,
-                    int                  len,
-                    SoupMessageHeaders **headers,
-                    int                 *type)
+static void
+record_latency (GSSDPClientPrivate *priv,
+                GSSDPLatencyStage   stage,
+                gint64              start,
+                gint64              end)
 {
-        guint status_code;
-
-        *headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
-
-        if (soup_headers_parse_response (buf,
-                                         len,
-                                         *headers,
-                                         NULL,
-                                         &status_code,
-                                         NULL) &&
-            status_code == 200) {
-                *type = _GSSDP_DISCOVERY_RESPONSE;
+        gint64 latency = end - start;
+        guint bucket = 0;
 
-                return TRUE;
-        } else {
-                soup_message_headers_free (*headers);
-                *headers = NULL;
+        if (latency >= G_GINT64_CONSTANT (1) << (LATENCY_BUCKETS - 2))
+                bucket = LATENCY_BUCKETS - 1;
+        else if (latency > 0)
+                bucket = g_bit_storage ((gulong) latency);
 
-                return FALSE;
-        }
+        g_atomic_int_inc ((gint *) &priv->latency_histograms[stage][bucket]);
 }
 
 /*
- * Called when data can be read from the socket
+ * Adds the time from @since until now to the latency histogram of @stage.
+ * @since is a wall clock time as in #GSSDPMessage.
  */
-static gboolean
-socket_source_cb (GSSDPSocketSource *socket_source, GSSDPClient *client)
+void
+_gssdp_client_record_latency (GSSDPClient       *client,
+                              GSSDPLatencyStage  stage,
+                              gint64             since)
 {
-        int type, len;
-        char buf[BUF_SIZE], *end;
-        SoupMessageHeaders *headers = NULL;
-        GSocket *socket;
-        GSocketAddress *address = NULL;
-        gssize bytes;
-        GInetAddress *inetaddr;
-        char *ip_string = NULL;
-        guint16 port;
-        GError *error = NULL;
-        GInputVector vector;
-        GSocketControlMessage **messages;
-        gint num_messages;
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
-        vector.buffer = buf;
-        vector.size = BUF_SIZE;
-
-        /* Get Socket */
-        socket = gssdp_socket_source_get_socket (socket_source);
-        bytes = g_socket_receive_message (socket,
-                                          &address,
-                                          &vector,
-                                          1,
-                                          &messages,
-                                          &num_messages,
-                                          NULL,
-                                          NULL,
-                                          &error);
+        record_latency (priv, stage, since, g_get_real_time ());
+}
 
-        if (bytes == -1) {
-                g_warning ("Failed to receive from socket: %s", error->message);
+/**
+ * gssdp_client_set_message_rate:
+ * @client: A #GSSDPClient
+ * @rate: Average number of messages per second, or 0 for no limit
+ *
+ * Limits the rate at which the #GSSDPResourceGroup<!-- -->s using @client
+ * send announcements and discovery responses. The limit is shared by all of
+ * them.
+ **/
+void
+gssdp_client_set_message_rate (GSSDPClient *client,
+                               guint        rate)
+{
+        GSSDPClientPrivate *priv = NULL;
 
-                goto out;
-        }
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
 
-#if defined(HAVE_PKTINFO) && !defined(__APPLE__)
-        {
-                int i;
-                for (i = 0; i < num_messages; i++) {
-                        GSSDPPktinfoMessage *msg;
-                        gint msg_ifindex;
+        priv = gssdp_client_get_instance_private (client);
 
-                        if (!GSSDP_IS_PKTINFO_MESSAGE (messages[i]))
-                                continue;
+        if (priv->message_rate == rate)
+                return;
 
-                        msg = GSSDP_PKTINFO_MESSAGE (messages[i]);
-                        msg_ifindex = gssdp_pktinfo_message_get_ifindex (msg);
-                        /* message needs to be on correct interface or on
-                         * loopback (as kernel can be smart and route things
-                         * there even if sent to another network) */
-                        if (!((msg_ifindex == priv->device.index ||
-                               msg_ifindex == LOOPBACK_IFINDEX) &&
-                              (g_inet_address_equal (gssdp_pktinfo_message_get_local_addr (msg),
-                                                     priv->device.host_addr))))
-                                goto out;
-                        else
-                                break;
-                }
-        }
-#else
-        /* We need the following lines to make sure the right client received
-         * the packet. We won't need to do this if there was any way to tell
-         * Mr. Unix that we are only interested in receiving multicast packets
-         * on this socket from a particular interface but AFAIK that is not
-         * possible, at least not in a portable way.
-         */
-        {
-                struct sockaddr_in addr;
-                in_addr_t mask;
-                in_addr_t our_addr;
-                if (!g_socket_address_to_native (address,
-                                                 &addr,
-                                                 sizeof (struct sockaddr_in),
-                                                 &error)) {
-                        g_warning ("Could not convert address to native: %s",
-                                   error->message);
+        priv->message_rate = rate;
+        gssdp_pacer_set_rate (priv->pacer, rate, priv->message_burst);
 
-                        goto out;
-                }
+        g_object_notify (G_OBJECT (client), "message-rate");
+}
 
-                mask = priv->device.mask.sin_addr.s_addr;
-                our_addr = inet_addr (gssdp_client_get_host_ip (client));
+/**
+ * gssdp_client_get_message_rate:
+ * @client: A #GSSDPClient
+ *
+ * Return value: The average number of messages sent per second, or 0 if
+ * there is no limit.
+ **/
+guint
+gssdp_client_get_message_rate (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
 
-                if ((addr.sin_addr.s_addr & mask) != (our_addr & mask))
-                        goto out;
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
 
-        }
-#endif
+        priv = gssdp_client_get_instance_private (client);
 
-        if (bytes >= BUF_SIZE) {
-                g_warning ("Received packet of %" G_GSSIZE_FORMAT " bytes, "
-                           "but the maximum buffer size is %d. Packed dropped.",
-                           bytes, BUF_SIZE);
+        return priv->message_rate;
+}
 
-                goto out;
-        }
+/**
+ * gssdp_client_set_message_burst:
+ * @client: A #GSSDPClient
+ * @burst: Number of messages that may be sent at once
+ *
+ * Sets how many messages @client may send back to back after it has been
+ * idle for a while, see gssdp_client_set_message_rate().
+ **/
+void
+gssdp_client_set_message_burst (GSSDPClient *client,
+                                guint        burst)
+{
+        GSSDPClientPrivate *priv = NULL;
 
-        /* Add trailing \0 */
-        buf[bytes] = '\0';
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (burst > 0);
 
-        /* Find length */
-        end = strstr (buf, "\r\n\r\n");
-        if (!end) {
-                g_debug ("Received packet lacks \"\\r\\n\\r\\n\" sequence. "
-                         "Packed dropped.");
+        priv = gssdp_client_get_instance_private (client);
 
-                goto out;
-        }
+        if (priv->message_burst == burst)
+                return;
 
-        len = end - buf + 2;
+        priv->message_burst = burst;
+        gssdp_pacer_set_rate (priv->pacer, priv->message_rate, burst);
 
-        /* Parse message */
-        type = -1;
-        headers = NULL;
-
-        if (!parse_http_request (buf,
-                                 len,
-                                 &headers,
-                                 &type)) {
-                if (!parse_http_response (buf,
-                                          len,
-                                          &headers,
-                                          &type)) {
-                        g_debug ("Unhandled packet '%s'", buf);
-                }
-        }
+        g_object_notify (G_OBJECT (client), "message-burst");
+}
 
-        /* Emit signal if parsing succeeded */
-        inetaddr = g_inet_socket_address_get_address (
-                                        G_INET_SOCKET_ADDRESS (address));
-        ip_string = g_inet_address_to_string (inetaddr);
-        port = g_inet_socket_address_get_port (
-                                        G_INET_SOCKET_ADDRESS (address));
+/**
+ * gssdp_client_get_message_burst:
+ * @client: A #GSSDPClient
+ *
+ * Return value: The number of messages that may be sent at once.
+ **/
+guint
+gssdp_client_get_message_burst (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
 
-        if (type >= 0) {
-                const char *agent;
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
 
-                /* update client cache */
-                agent = soup_message_headers_get_one (headers, "Server");
-                if (!agent)
-                        agent = soup_message_headers_get_one (headers, "User-Agent");
+        priv = gssdp_client_get_instance_private (client);
 
-                if (agent)
-                        gssdp_client_add_cache_entry (client,
-                                                      ip_string,
-                                                      agent);
+        return priv->message_burst;
+}
 
-                g_signal_emit (client,
-                               signals[MESSAGE_RECEIVED],
-                               0,
-                               ip_string,
-                               port,
-                               type,
-                               headers);
-        }
+/**
+ * gssdp_client_set_user_agent_cache_size:
+ * @client: A #GSSDPClient
+ * @size: Number of peers to remember, or 0 to disable the cache
+ *
+ * Limits the number of peers whose user agent @client remembers for
+ * gssdp_client_guess_user_agent().
+ **/
+void
+gssdp_client_set_user_agent_cache_size (GSSDPClient *client,
+                                        guint        size)
+{
+        GSSDPClientPrivate *priv = NULL;
 
-out:
-        if (error)
-                g_error_free (error);
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
 
-        g_free (ip_string);
+        priv = gssdp_client_get_instance_private (client);
 
-        if (headers)
-                soup_message_headers_free (headers);
+        if (priv->user_agent_cache_size == size)
+                return;
 
-        if (address)
-                g_object_unref (address);
+        priv->user_agent_cache_size = size;
+        gssdp_user_agent_cache_set_capacity (priv->user_agent_cache, size);
 
-        if (messages) {
-                int i;
-                for (i = 0; i < num_messages; i++)
-                        g_object_unref (messages[i]);
+        g_object_notify (G_OBJECT (client), "user-agent-cache-size");
+}
 
-                g_free (messages);
-        }
+/**
+ * gssdp_client_get_user_agent_cache_size:
+ * @client: A #GSSDPClient
+ *
+ * Return value: The number of peers whose user agent is remembered.
+ **/
+guint
+gssdp_client_get_user_agent_cache_size (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        return priv->user_agent_cache_size;
+}
+
+/**
+ * gssdp_client_set_user_agent_cache_ttl:
+ * @client: A #GSSDPClient
+ * @ttl: Number of seconds, or 0 for no expiry
+ *
+ * Sets the number of seconds after which @client forgets the user agent of
+ * a peer it has not heard from.
+ **/
+void
+gssdp_client_set_user_agent_cache_ttl (GSSDPClient *client,
+                                       guint        ttl)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+
+        priv = gssdp_client_get_instance_private (client);
+
+        if (priv->user_agent_cache_ttl == ttl)
+                return;
+
+        priv->user_agent_cache_ttl = ttl;
+        gssdp_user_agent_cache_set_ttl (priv->user_agent_cache, ttl);
+
+        g_object_notify (G_OBJECT (client), "user-agent-cache-ttl");
+}
+
+/**
+ * gssdp_client_get_user_agent_cache_ttl:
+ * @client: A #GSSDPClient
+ *
+ * Return value: The number of seconds after which the user agent of a
+ * silent peer is forgotten, or 0 if it is never.
+ **/
+guint
+gssdp_client_get_user_agent_cache_ttl (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        return priv->user_agent_cache_ttl;
+}
+
+/**
+ * gssdp_client_set_kernel_filter:
+ * @client: A #GSSDPClient
+ * @kernel_filter: %TRUE to filter received datagrams in the kernel
+ *
+ * Sets whether @client lets the kernel drop datagrams that none of its
+ * resource browsers and groups want to see. Datagrams that are not SSDP
+ * messages are always dropped, discovery requests are dropped while no
+ * resource group is available and announcements and responses while no
+ * resource browser is active.
+ *
+ * This saves waking up and copying every datagram on busy networks, but
+ * is only supported on Linux.
+ **/
+void
+gssdp_client_set_kernel_filter (GSSDPClient *client,
+                                gboolean     kernel_filter)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+
+        priv = gssdp_client_get_instance_private (client);
+
+        kernel_filter = !!kernel_filter;
+        if (priv->kernel_filter == kernel_filter)
+                return;
+
+        priv->kernel_filter = kernel_filter;
+        update_kernel_filter (client, TRUE);
+
+        g_object_notify (G_OBJECT (client), "kernel-filter");
+}
+
+/**
+ * gssdp_client_get_kernel_filter:
+ * @client: A #GSSDPClient
+ *
+ * Return value: %TRUE if @client filters received datagrams in the kernel.
+ **/
+gboolean
+gssdp_client_get_kernel_filter (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), FALSE);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        return priv->kernel_filter;
+}
+
+static void
+header_field_free (GSSDPHeaderField *header)
+{
+        g_free (header->name);
+        g_free (header->value);
+        g_slice_free (GSSDPHeaderField, header);
+}
+
+static void
+headers_changed (GSSDPClientPrivate *priv)
+{
+        g_clear_pointer (&priv->header_block, g_free);
+        priv->message_serial++;
+}
+
+static void
+ensure_header_block (GSSDPClientPrivate *priv)
+{
+        GString *str = NULL;
+        GList *iter = NULL;
+
+        if (priv->header_block != NULL)
+                return;
+
+        str = g_string_new (NULL);
+
+        for (iter = priv->headers; iter; iter = iter->next) {
+                GSSDPHeaderField *header = (GSSDPHeaderField *) iter->data;
+                g_string_append_printf (str, "%s: %s\r\n",
+                                        header->name,
+                                        header->value ? header->value : "");
+        }
+
+        g_string_append (str, "\r\n");
+
+        priv->header_block_length = str->len;
+        priv->header_block = g_string_free (str, FALSE);
+}
+
+/**
+ * gssdp_client_append_header:
+ * @client: A #GSSDPClient
+ * @name: Header name
+ * @value: Header value
+ *
+ * Adds a header field to the message sent by this @client. It is intended to
+ * be used by clients requiring vendor specific header fields. (If there is an
+ * existing header with name name , then this creates a second one).
+ **/
+void
+gssdp_client_append_header (GSSDPClient *client,
+                            const char  *name,
+                            const char  *value)
+{
+        GSSDPHeaderField *header = NULL;
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (name != NULL);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        header = g_slice_new (GSSDPHeaderField);
+        header->name = g_strdup (name);
+        header->value = g_strdup (value);
+        priv->headers = g_list_append (priv->headers, header);
+
+        headers_changed (priv);
+}
+
+/**
+ * gssdp_client_remove_header:
+ * @client: A #GSSDPClient
+ * @name: Header name
+ *
+ * Removes @name from the list of headers . If there are multiple values for
+ * @name, they are all removed.
+ **/
+void
+gssdp_client_remove_header (GSSDPClient *client,
+                            const char  *name)
+{
+        GSSDPClientPrivate *priv;
+        GList *l;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (name != NULL);
+
+        priv = gssdp_client_get_instance_private (client);
+        l = priv->headers;
+        while (l != NULL)
+        {
+                GList *next = l->next;
+                GSSDPHeaderField *header = l->data;
+
+                if (!g_strcmp0 (header->name, name)) {
+                        header_field_free (header);
+                        priv->headers = g_list_delete_link (priv->headers, l);
+                }
+                l = next;
+        }
+
+        headers_changed (priv);
+}
+
+/**
+ * gssdp_client_clear_headers:
+ * @client: A #GSSDPClient
+ *
+ * Removes all the headers for this @client.
+ **/
+void
+gssdp_client_clear_headers (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        priv = gssdp_client_get_instance_private (client);
+
+        g_list_free_full (priv->headers,
+                          (GDestroyNotify) header_field_free);
+        priv->headers = NULL;
+
+        headers_changed (priv);
+}
+
+/*
+ * _gssdp_client_get_message_serial:
+ * @client: A #GSSDPClient
+ *
+ * Returns a number that changes whenever the server ID or the custom headers
+ * of @client change, so callers can tell whether messages they rendered
+ * earlier are still up to date. The custom headers themselves are added by
+ * _gssdp_client_send_vectors().
+ */
+guint
+_gssdp_client_get_message_serial (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
+        priv = gssdp_client_get_instance_private (client);
+
+        return priv->message_serial;
+}
+
+/*
+ * _gssdp_client_get_diagnostics:
+ * @client: A #GSSDPClient
+ *
+ * Returns the diagnostics of @client, for use with gssdp_diagnostic(). They
+ * live as long as @client does.
+ */
+GSSDPDiagnostics *
+_gssdp_client_get_diagnostics (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), NULL);
+        priv = gssdp_client_get_instance_private (client);
+
+        return &priv->diagnostics;
+}
+
+static GSocketAddress *
+get_multicast_address (GSSDPClientPrivate *priv)
+{
+        if (priv->multicast_address == NULL) {
+                GInetAddress *inet_address;
+
+                inet_address = g_inet_address_new_from_string (SSDP_ADDR);
+                priv->multicast_address =
+                        g_inet_socket_address_new (inet_address, SSDP_PORT);
+                g_object_unref (inet_address);
+        }
+
+        return priv->multicast_address;
+}
+
+/*
+ * Sends a single message on @socket, or queues it on the io_uring if there
+ * is one. Either way, it is counted once the outcome is known.
+ */
+static gboolean
+send_message (GSSDPClientPrivate  *priv,
+              GSocket             *socket,
+              GSocketAddress      *address,
+              const GOutputVector *vectors,
+              guint                n_vectors,
+              _GSSDPMessageType    type,
+              GError             **error)
+{
+        gboolean sent;
+
+#ifdef HAVE_LIBURING
+        if (priv->uring != NULL) {
+                if (gssdp_uring_send (priv->uring,
+                                      socket,
+                                      address,
+                                      vectors,
+                                      n_vectors,
+                                      &priv->sent_counts[type],
+                                      &priv->send_errors,
+                                      error))
+                        return TRUE;
+
+                count (&priv->send_errors);
+
+                return FALSE;
+        }
+#endif
+
+        sent = g_socket_send_message (socket,
+                                      address,
+                                      (GOutputVector *) vectors,
+                                      n_vectors,
+                                      NULL,
+                                      0,
+                                      0,
+                                      NULL,
+                                      error) != -1;
+        count (sent ? &priv->sent_counts[type] : &priv->send_errors);
+
+        return sent;
+}
+
+/*
+ * _gssdp_client_send_vectors:
+ * @client: A #GSSDPClient
+ * @dest_ip: (allow-none): The destination IP address, or %NULL to broadcast
+ * @dest_port: (allow-none): The destination port, or 0 for default
+ * @vectors: The pieces of the message, without the terminating blank line
+ * @n_vectors: Number of elements in @vectors
+ * @type: The type of the message
+ *
+ * Sends the concatenation of @vectors, followed by the custom headers of
+ * @client, to @dest_ip without copying it.
+ */
+void
+_gssdp_client_send_vectors (GSSDPClient         *client,
+                            const char          *dest_ip,
+                            gushort              dest_port,
+                            const GOutputVector *vectors,
+                            guint                n_vectors,
+                            _GSSDPMessageType    type)
+{
+        GSSDPClientPrivate *priv = NULL;
+        GError *error = NULL;
+        GSocketAddress *address = NULL;
+        GOutputVector *message;
+        GSocket *socket;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (vectors != NULL || n_vectors == 0);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        if (!priv->active)
+                /* We don't send messages in passive mode */
+                return;
+
+        if (type == _GSSDP_DISCOVERY_REQUEST)
+                socket = gssdp_socket_source_get_socket
+                                        (priv->search_socket);
+        else
+                socket = gssdp_socket_source_get_socket
+                                        (priv->request_socket);
+
+        /* Broadcast if @dest_ip is NULL */
+        if (dest_ip == NULL && (dest_port == 0 || dest_port == SSDP_PORT)) {
+                address = g_object_ref (get_multicast_address (priv));
+        } else {
+                GInetAddress *inet_address;
+
+                if (dest_ip == NULL)
+                        dest_ip = SSDP_ADDR;
+
+                /* Use default port if no port was explicitly specified */
+                if (dest_port == 0)
+                        dest_port = SSDP_PORT;
+
+                inet_address = g_inet_address_new_from_string (dest_ip);
+                address = g_inet_socket_address_new (inet_address, dest_port);
+                g_object_unref (inet_address);
+        }
+
+        ensure_header_block (priv);
+
+        message = g_newa (GOutputVector, n_vectors + 1);
+        memcpy (message, vectors, n_vectors * sizeof (GOutputVector));
+        message[n_vectors].buffer = priv->header_block;
+        message[n_vectors].size = priv->header_block_length;
+
+        if (!send_message (priv,
+                           socket,
+                           address,
+                           message,
+                           n_vectors + 1,
+                           type,
+                           &error)) {
+                gssdp_diagnostic (&priv->diagnostics,
+                                  GSSDP_DIAGNOSTIC_SEND_ERROR,
+                                  NULL,
+                                  NULL,
+                                  "Error sending SSDP packet to %s: %s",
+                                  dest_ip ? dest_ip : SSDP_ADDR,
+                                  error->message);
+                g_error_free (error);
+        }
+
+        g_object_unref (address);
+}
+
+/*
+ * _gssdp_client_send_messages:
+ * @client: A #GSSDPClient
+ * @messages: (array length=n_messages): Complete messages, without the
+ * terminating blank line
+ * @n_messages: Number of elements in @messages
+ * @type: The type of the messages
+ *
+ * Multicasts all of @messages, followed by the custom headers of @client,
+ * using as few system calls as possible.
+ */
+void
+_gssdp_client_send_messages (GSSDPClient       *client,
+                             GBytes           **messages,
+                             guint              n_messages,
+                             _GSSDPMessageType  type)
+{
+        GSSDPClientPrivate *priv = NULL;
+        GOutputMessage batch[SEND_BATCH_SIZE];
+        GOutputVector vectors[SEND_BATCH_SIZE][2];
+        GSocketAddress *address;
+        GSocket *socket;
+        guint sent = 0;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (messages != NULL || n_messages == 0);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        if (!priv->active)
+                /* We don't send messages in passive mode */
+                return;
+
+        if (type == _GSSDP_DISCOVERY_REQUEST)
+                socket = gssdp_socket_source_get_socket
+                                        (priv->search_socket);
+        else
+                socket = gssdp_socket_source_get_socket
+                                        (priv->request_socket);
+
+        address = get_multicast_address (priv);
+        ensure_header_block (priv);
+
+#ifdef HAVE_LIBURING
+        /* The ring batches the sends already */
+        if (priv->uring != NULL) {
+                for (sent = 0; sent < n_messages; sent++) {
+                        GError *error = NULL;
+                        gsize size;
+
+                        vectors[0][0].buffer =
+                                g_bytes_get_data (messages[sent], &size);
+                        vectors[0][0].size = size;
+                        vectors[0][1].buffer = priv->header_block;
+                        vectors[0][1].size = priv->header_block_length;
+
+                        if (!send_message (priv,
+                                           socket,
+                                           address,
+                                           vectors[0],
+                                           2,
+                                           type,
+                                           &error)) {
+                                gssdp_diagnostic
+                                        (&priv->diagnostics,
+                                         GSSDP_DIAGNOSTIC_SEND_ERROR,
+                                         NULL,
+                                         NULL,
+                                         "Error sending SSDP packet to %s: %s",
+                                         SSDP_ADDR,
+                                         error->message);
+                                g_error_free (error);
+                        }
+                }
+
+                return;
+        }
+#endif
+
+        while (sent < n_messages) {
+                GError *error = NULL;
+                guint n, i;
+                gint res;
+
+                n = MIN (n_messages - sent, SEND_BATCH_SIZE);
+                for (i = 0; i < n; i++) {
+                        gsize size;
+
+                        vectors[i][0].buffer =
+                                g_bytes_get_data (messages[sent + i], &size);
+                        vectors[i][0].size = size;
+                        vectors[i][1].buffer = priv->header_block;
+                        vectors[i][1].size = priv->header_block_length;
+
+                        batch[i].address = address;
+                        batch[i].vectors = vectors[i];
+                        batch[i].num_vectors = 2;
+                        batch[i].bytes_sent = 0;
+                        batch[i].control_messages = NULL;
+                        batch[i].num_control_messages = 0;
+                }
+
+                res = g_socket_send_messages (socket,
+                                              batch,
+                                              n,
+                                              0,
+                                              NULL,
+                                              &error);
+                if (res == -1) {
+                        count (&priv->send_errors);
+                        gssdp_diagnostic (&priv->diagnostics,
+                                          GSSDP_DIAGNOSTIC_SEND_ERROR,
+                                          NULL,
+                                          NULL,
+                                          "Error sending SSDP packet to %s: %s",
+                                          SSDP_ADDR,
+                                          error->message);
+                        g_error_free (error);
+
+                        /* Skip the offending message rather than retrying
+                         * it forever */
+                        sent++;
+                        continue;
+                }
+
+                g_atomic_pointer_add (&priv->sent_counts[type], res);
+                sent += MAX (res, 1);
+        }
+}
+
+/**
+ * _gssdp_client_send_message:
+ * @client: A #GSSDPClient
+ * @dest_ip: (allow-none): The destination IP address, or %NULL to broadcast
+ * @dest_port: (allow-none): The destination port, or %NULL for default
+ * @message: The message to send
+ *
+ * Sends @message to @dest_ip.
+ **/
+void
+_gssdp_client_send_message (GSSDPClient      *client,
+                            const char       *dest_ip,
+                            gushort           dest_port,
+                            const char       *message,
+                            _GSSDPMessageType type)
+{
+        GOutputVector vector;
+
+        g_return_if_fail (message != NULL);
+
+        vector.buffer = message;
+        vector.size = strlen (message);
+
+        _gssdp_client_send_vectors (client,
+                                    dest_ip,
+                                    dest_port,
+                                    &vector,
+                                    1,
+                                    type);
+}
+
+static void
+send_paced_messages (GSSDPPacerItem *items,
+                     guint           n_items,
+                     gpointer        user_data)
+{
+        GSSDPClient *client = GSSDP_CLIENT (user_data);
+        GBytes **multicast;
+        guint i, n_multicast = 0;
+
+        multicast = g_newa (GBytes *, n_items);
+
+        for (i = 0; i < n_items; i++) {
+                GOutputVector vector;
+                gsize size;
+
+                if (items[i].dest_ip == NULL) {
+                        multicast[n_multicast++] = items[i].message;
+
+                        continue;
+                }
+
+                vector.buffer = g_bytes_get_data (items[i].message, &size);
+                vector.size = size;
+                _gssdp_client_send_vectors (client,
+                                            items[i].dest_ip,
+                                            items[i].dest_port,
+                                            &vector,
+                                            1,
+                                            _GSSDP_DISCOVERY_RESPONSE);
+
+                if (items[i].request_time != 0)
+                        _gssdp_client_record_latency
+                                        (client,
+                                         GSSDP_LATENCY_SEARCH_TO_RESPONSE,
+                                         items[i].request_time);
+        }
+
+        if (n_multicast > 0)
+                _gssdp_client_send_messages (client,
+                                             multicast,
+                                             n_multicast,
+                                             _GSSDP_ANNOUNCEMENT);
+}
+
+/*
+ * _gssdp_client_queue_message:
+ * @client: A #GSSDPClient
+ * @priority: The priority of @message
+ * @owner: The resource group queueing @message
+ * @id: Identifies @message for _gssdp_client_cancel_messages()
+ * @message: A complete message, without the terminating blank line
+ *
+ * Multicasts @message as soon as the rate limit of @client allows. Messages
+ * queued during one main loop iteration are sent in as few system calls as
+ * possible.
+ */
+void
+_gssdp_client_queue_message (GSSDPClient        *client,
+                             GSSDPPacerPriority  priority,
+                             gpointer            owner,
+                             guint               id,
+                             GBytes             *message)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (message != NULL);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        if (!priv->active)
+                /* We don't send messages in passive mode */
+                return;
+
+        gssdp_pacer_push (priv->pacer,
+                          priority,
+                          owner,
+                          id,
+                          NULL,
+                          0,
+                          0,
+                          message);
+}
+
+/*
+ * _gssdp_client_queue_vectors:
+ * @client: A #GSSDPClient
+ * @priority: The priority of the message
+ * @owner: The resource group sending the message
+ * @dest_ip: The destination IP address
+ * @dest_port: The destination port, or 0 for default
+ * @vectors: The pieces of the message, without the terminating blank line
+ * @n_vectors: Number of elements in @vectors
+ * @request_time: Receipt time of the discovery request this responds to, see
+ * #GSSDPMessage, or 0
+ *
+ * Sends the concatenation of @vectors right away if the rate limit of @client
+ * allows it. Otherwise it is copied and queued.
+ */
+void
+_gssdp_client_queue_vectors (GSSDPClient         *client,
+                             GSSDPPacerPriority   priority,
+                             gpointer             owner,
+                             const char          *dest_ip,
+                             gushort              dest_port,
+                             const GOutputVector *vectors,
+                             guint                n_vectors,
+                             gint64               request_time)
+{
+        GSSDPClientPrivate *priv = NULL;
+        GByteArray *message;
+        GBytes *bytes;
+        guint i;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+        g_return_if_fail (dest_ip != NULL);
+
+        priv = gssdp_client_get_instance_private (client);
+
+        if (!priv->active)
+                /* We don't send messages in passive mode */
+                return;
+
+        if (gssdp_pacer_try_take (priv->pacer, priority)) {
+                _gssdp_client_send_vectors (client,
+                                            dest_ip,
+                                            dest_port,
+                                            vectors,
+                                            n_vectors,
+                                            _GSSDP_DISCOVERY_RESPONSE);
+
+                if (request_time != 0)
+                        _gssdp_client_record_latency
+                                        (client,
+                                         GSSDP_LATENCY_SEARCH_TO_RESPONSE,
+                                         request_time);
+
+                return;
+        }
+
+        message = g_byte_array_new ();
+        for (i = 0; i < n_vectors; i++)
+                g_byte_array_append (message,
+                                     vectors[i].buffer,
+                                     vectors[i].size);
+        bytes = g_byte_array_free_to_bytes (message);
+
+        gssdp_pacer_push (priv->pacer,
+                          priority,
+                          owner,
+                          0,
+                          dest_ip,
+                          dest_port,
+                          request_time,
+                          bytes);
+        g_bytes_unref (bytes);
+}
+
+/*
+ * _gssdp_client_cancel_messages:
+ * @client: A #GSSDPClient
+ * @priority: The priority the messages were queued with
+ * @owner: The owner the messages were queued with
+ * @id: The id the messages were queued with
+ *
+ * Drops messages that were queued but not sent yet.
+ */
+void
+_gssdp_client_cancel_messages (GSSDPClient        *client,
+                               GSSDPPacerPriority  priority,
+                               gpointer            owner,
+                               guint               id)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+
+        priv = gssdp_client_get_instance_private (client);
+
+        gssdp_pacer_cancel (priv->pacer, priority, owner, id);
+}
+
+/*
+ * _gssdp_client_flush_messages:
+ * @client: A #GSSDPClient
+ * @owner: The owner the messages were queued with
+ *
+ * Sends all messages @owner queued right away, regardless of the rate limit.
+ * Resource groups call this when they go away.
+ */
+void
+_gssdp_client_flush_messages (GSSDPClient *client,
+                              gpointer     owner)
+{
+        GSSDPClientPrivate *priv = NULL;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+
+        priv = gssdp_client_get_instance_private (client);
+
+        gssdp_pacer_flush_owner (priv->pacer, owner);
+}
+
+/*
+ * Brings the socket filters in line with the handlers that are currently
+ * registered. Unless @force is set, the sockets are only touched if that
+ * changes what is let through.
+ */
+static void
+update_kernel_filter (GSSDPClient *client,
+                      gboolean     force)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSSDPSocketSource *sockets[MAX_SOCKETS];
+        GSSDPSocketAccept accept = 0;
+        guint n, i;
+
+        if (priv->request_handlers != NULL)
+                accept |= GSSDP_SOCKET_ACCEPT_REQUESTS;
+        if (priv->wildcard_handlers != NULL ||
+            g_hash_table_size (priv->target_handlers) > 0)
+                accept |= GSSDP_SOCKET_ACCEPT_TARGETS;
+
+        if (!force && (!priv->kernel_filter ||
+                       accept == priv->kernel_filter_accept))
+                return;
+
+        priv->kernel_filter_accept = accept;
+
+        n = get_socket_sources (client, sockets);
+
+        for (i = 0; i < n; i++) {
+                GError *error = NULL;
+
+                if (!gssdp_socket_source_set_filter (sockets[i],
+                                                     priv->kernel_filter,
+                                                     accept,
+                                                     &error)) {
+                        g_warning ("Failed to set up socket filter: %s",
+                                   error->message);
+                        g_error_free (error);
+                }
+        }
+}
+
+static void
+message_handler_free (MessageHandler *handler)
+{
+        g_free (handler->key);
+        g_slice_free (MessageHandler, handler);
+}
+
+static guint
+add_handler (GSSDPClient          *client,
+             const char           *target,
+             _GSSDPMessageHandler  func,
+             gpointer              user_data)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        MessageHandler *handler;
+
+        handler = g_slice_new0 (MessageHandler);
+        handler->id = ++priv->last_handler_id;
+        handler->func = func;
+        handler->user_data = user_data;
+
+        g_hash_table_insert (priv->handlers,
+                             GUINT_TO_POINTER (handler->id),
+                             handler);
+
+        if (target == NULL) {
+                priv->request_handlers =
+                        g_list_append (priv->request_handlers, handler);
+        } else if (strcmp (target, GSSDP_ALL_RESOURCES) == 0) {
+                priv->wildcard_handlers =
+                        g_list_append (priv->wildcard_handlers, handler);
+        } else {
+                GQueue *queue;
+
+                /* Key by the target without version, so that handlers see
+                 * every version of a type and can decide for themselves */
+                handler->key = g_strndup
+                                (target,
+                                 gssdp_target_prefix_length (target, NULL));
+
+                queue = g_hash_table_lookup (priv->target_handlers,
+                                             handler->key);
+                if (queue == NULL) {
+                        queue = g_queue_new ();
+                        g_hash_table_insert (priv->target_handlers,
+                                             g_strdup (handler->key),
+                                             queue);
+                }
+
+                g_queue_push_tail (queue, handler);
+        }
+
+        update_kernel_filter (client, FALSE);
+
+        return handler->id;
+}
+
+/*
+ * Calls @func for every discovery response and announcement whose ST or NT
+ * header can match @target. The client keeps these handlers indexed by target
+ * type, so a message only reaches the handlers that are interested in it.
+ * Handlers for "ssdp:all" see every response and announcement.
+ *
+ * Returns: An ID for _gssdp_client_remove_handler()
+ */
+guint
+_gssdp_client_add_target_handler (GSSDPClient          *client,
+                                  const char           *target,
+                                  _GSSDPMessageHandler  handler,
+                                  gpointer              user_data)
+{
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
+        g_return_val_if_fail (target != NULL, 0);
+        g_return_val_if_fail (handler != NULL, 0);
+
+        return add_handler (client, target, handler, user_data);
+}
+
+/*
+ * Calls @func for every discovery request.
+ *
+ * Returns: An ID for _gssdp_client_remove_handler()
+ */
+guint
+_gssdp_client_add_request_handler (GSSDPClient          *client,
+                                   _GSSDPMessageHandler  handler,
+                                   gpointer              user_data)
+{
+        g_return_val_if_fail (GSSDP_IS_CLIENT (client), 0);
+        g_return_val_if_fail (handler != NULL, 0);
+
+        return add_handler (client, NULL, handler, user_data);
+}
+
+static void
+unlink_handler (GSSDPClient    *client,
+                MessageHandler *handler)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GQueue *queue;
+
+        if (handler->key == NULL) {
+                priv->request_handlers =
+                        g_list_remove (priv->request_handlers, handler);
+                priv->wildcard_handlers =
+                        g_list_remove (priv->wildcard_handlers, handler);
+        } else {
+                queue = g_hash_table_lookup (priv->target_handlers,
+                                             handler->key);
+                g_queue_remove (queue, handler);
+                if (g_queue_is_empty (queue))
+                        g_hash_table_remove (priv->target_handlers,
+                                             handler->key);
+        }
+
+        g_hash_table_remove (priv->handlers, GUINT_TO_POINTER (handler->id));
+
+        update_kernel_filter (client, FALSE);
+}
+
+void
+_gssdp_client_remove_handler (GSSDPClient *client,
+                              guint        handler_id)
+{
+        GSSDPClientPrivate *priv;
+        MessageHandler *handler;
+
+        g_return_if_fail (GSSDP_IS_CLIENT (client));
+
+        priv = gssdp_client_get_instance_private (client);
+        handler = g_hash_table_lookup (priv->handlers,
+                                       GUINT_TO_POINTER (handler_id));
+        g_return_if_fail (handler != NULL);
+        g_return_if_fail (!handler->removed);
+
+        /* The lists might be iterated right now, so only unlink once the
+         * dispatch is done */
+        if (priv->dispatch_depth > 0) {
+                handler->removed = TRUE;
+                priv->removed_handlers = g_list_prepend
+                                        (priv->removed_handlers, handler);
+
+                return;
+        }
+
+        unlink_handler (client, handler);
+}
+
+static void
+call_handlers (GSSDPClient  *client,
+               GList        *handlers,
+               GSSDPMessage *message)
+{
+        GList *l;
+
+        for (l = handlers; l != NULL; l = l->next) {
+                MessageHandler *handler = l->data;
+
+                if (!handler->removed)
+                        handler->func (client, message, handler->user_data);
+        }
+}
+
+/*
+ * Passes @message on to the handlers interested in it
+ */
+static void
+dispatch_message (GSSDPClient  *client,
+                  GSSDPMessage *message)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        const char *target;
+
+        priv->dispatch_depth++;
+
+        if (message->type == _GSSDP_DISCOVERY_REQUEST) {
+                call_handlers (client, priv->request_handlers, message);
+        } else {
+                if (message->type == _GSSDP_ANNOUNCEMENT)
+                        target = message->nt;
+                else
+                        target = message->st;
+
+                if (target != NULL &&
+                    g_hash_table_size (priv->target_handlers) > 0) {
+                        char buf[256];
+                        char *key;
+                        gsize len;
+
+                        GQueue *queue;
+
+                        len = gssdp_target_prefix_length (target, NULL);
+                        if (len < sizeof (buf)) {
+                                memcpy (buf, target, len);
+                                buf[len] = '\0';
+                                key = buf;
+                        } else {
+                                key = g_strndup (target, len);
+                        }
+
+                        queue = g_hash_table_lookup (priv->target_handlers,
+                                                     key);
+                        if (queue != NULL)
+                                call_handlers (client, queue->head, message);
+
+                        if (key != buf)
+                                g_free (key);
+                }
+
+                call_handlers (client, priv->wildcard_handlers, message);
+        }
+
+        priv->dispatch_depth--;
+
+        if (priv->dispatch_depth == 0 && priv->removed_handlers != NULL) {
+                GList *l;
+
+                for (l = priv->removed_handlers; l != NULL; l = l->next)
+                        unlink_handler (client, l->data);
+
+                g_clear_pointer (&priv->removed_handlers, g_list_free);
+        }
+}
+
+/*
+ * Generates the default server ID
+ */
+static char *
+make_server_id (void)
+{
+#ifdef G_OS_WIN32
+        OSVERSIONINFO versioninfo;
+        versioninfo.dwOSVersionInfoSize = sizeof (OSVERSIONINFO);
+        if (GetVersionEx (&versioninfo)) {
+                return g_strdup_printf ("Microsoft Windows/%ld.%ld GSSDP/%s",
+                                        versioninfo.dwMajorVersion,
+                                        versioninfo.dwMinorVersion,
+                                        VERSION);
+        } else {
+                return g_strdup_printf ("Microsoft Windows GSSDP/%s",
+                                        VERSION);
+        }
+#else
+        struct utsname sysinfo;
+
+        uname (&sysinfo);
+        
+        return g_strdup_printf ("%s/%s GSSDP/%s",
+                                sysinfo.sysname,
+                                sysinfo.version,
+                                VERSION);
+#endif
+}
+
+/*
+ * Checks whether a datagram was received on the network interface of
+ * @client, as several clients can share the same multicast port.
+ */
+static gboolean
+is_from_our_interface (GSSDPClient                          *client,
+                       G_GNUC_UNUSED GSocketAddress         *address,
+                       G_GNUC_UNUSED GSocketControlMessage **messages,
+                       G_GNUC_UNUSED guint                   num_messages)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+#if defined(HAVE_PKTINFO) && !defined(__APPLE__)
+        {
+                guint i;
+                for (i = 0; i < num_messages; i++) {
+                        GSSDPPktinfoMessage *msg;
+                        gint msg_ifindex;
+
+                        if (!GSSDP_IS_PKTINFO_MESSAGE (messages[i]))
+                                continue;
+
+                        msg = GSSDP_PKTINFO_MESSAGE (messages[i]);
+                        msg_ifindex = gssdp_pktinfo_message_get_ifindex (msg);
+                        /* message needs to be on correct interface or on
+                         * loopback (as kernel can be smart and route things
+                         * there even if sent to another network) */
+                        return (msg_ifindex == priv->device.index ||
+                                msg_ifindex == LOOPBACK_IFINDEX) &&
+                               g_inet_address_equal (gssdp_pktinfo_message_get_local_addr (msg),
+                                                     priv->device.host_addr);
+                }
+        }
+
+        return TRUE;
+#else
+        /* We need the following lines to make sure the right client received
+         * the packet. We won't need to do this if there was any way to tell
+         * Mr. Unix that we are only interested in receiving multicast packets
+         * on this socket from a particular interface but AFAIK that is not
+         * possible, at least not in a portable way.
+         */
+        {
+                struct sockaddr_in addr;
+                in_addr_t mask;
+                in_addr_t our_addr;
+                GError *error = NULL;
+
+                if (!g_socket_address_to_native (address,
+                                                 &addr,
+                                                 sizeof (struct sockaddr_in),
+                                                 &error)) {
+                        g_warning ("Could not convert address to native: %s",
+                                   error->message);
+                        g_error_free (error);
+
+                        return FALSE;
+                }
+
+                mask = priv->device.mask.sin_addr.s_addr;
+                our_addr = inet_addr (gssdp_client_get_host_ip (client));
+
+                return (addr.sin_addr.s_addr & mask) == (our_addr & mask);
+        }
+#endif
+}
+
+/*
+ * Parses a single datagram read from one of the sockets. Only uses what does
+ * not change after initialization, so this is safe to call from the receive
+ * thread.
+ *
+ * Returns: The message, or %NULL if the datagram is to be ignored
+ */
+static GSSDPMessage *
+parse_datagram (GSSDPClient            *client,
+                char                   *buf,
+                gssize                  bytes,
+                GSocketAddress         *address,
+                GSocketControlMessage **messages,
+                guint                   num_messages,
+                gboolean                check_interface)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSSDPParser parser;
+        GSSDPMessage *message;
+        GInetAddress *inetaddr;
+        char *ip_string = NULL;
+        guint16 port;
+
+        /* Some sockets only get traffic for our address anyway */
+        if (check_interface &&
+            !is_from_our_interface (client, address, messages, num_messages)) {
+                count (&priv->interface_drops);
+
+                return NULL;
+        }
+
+        if (bytes >= BUF_SIZE) {
+                count (&priv->oversized_drops);
+                gssdp_diagnostic (&priv->diagnostics,
+                                  GSSDP_DIAGNOSTIC_OVERSIZED_DATAGRAM,
+                                  NULL,
+                                  NULL,
+                                  "Received packet of %" G_GSSIZE_FORMAT
+                                  " bytes, but the maximum buffer size is "
+                                  "%d. Packet dropped.",
+                                  bytes,
+                                  BUF_SIZE);
+
+                return NULL;
+        }
+
+        /* Add trailing \0 */
+        buf[bytes] = '\0';
+
+        /* Parse message */
+        if (!gssdp_parser_parse (&parser, buf, bytes)) {
+                count (&priv->parse_failures);
+                g_debug ("Unhandled packet '%s'", buf);
+
+                return NULL;
+        }
+
+        inetaddr = g_inet_socket_address_get_address (
+                                        G_INET_SOCKET_ADDRESS (address));
+        ip_string = g_inet_address_to_string (inetaddr);
+        port = g_inet_socket_address_get_port (
+                                        G_INET_SOCKET_ADDRESS (address));
+
+        message = _gssdp_message_new (&parser, buf, ip_string, port);
+        count (&priv->received_counts[message->type]);
+
+#ifdef HAVE_TIMESTAMPNS
+        {
+                guint i;
+
+                for (i = 0; i < num_messages; i++) {
+                        GSSDPTimestampMessage *msg;
+
+                        if (!GSSDP_IS_TIMESTAMP_MESSAGE (messages[i]))
+                                continue;
+
+                        msg = GSSDP_TIMESTAMP_MESSAGE (messages[i]);
+                        message->received =
+                                gssdp_timestamp_message_get_time (msg);
+                        record_latency (priv,
+                                        GSSDP_LATENCY_KERNEL_TO_PARSE,
+                                        message->received,
+                                        message->parsed);
+                }
+        }
+#endif
+
+        return message;
+}
+
+/*
+ * Hands a received message to everybody interested in it and drops the
+ * reference to it.
+ */
+static void
+deliver_message (GSSDPClient  *client,
+                 GSSDPMessage *message)
+{
+        _gssdp_client_record_latency (client,
+                                      GSSDP_LATENCY_PARSE_TO_DISPATCH,
+                                      message->parsed);
+
+        /* update client cache */
+        if (message->agent)
+                gssdp_client_add_cache_entry (client,
+                                              message->from_ip,
+                                              message->agent);
+
+        dispatch_message (client, message);
+
+        /* Only build the SoupMessageHeaders if somebody outside of GSSDP is
+         * still listening for them */
+        if (g_signal_has_handler_pending (client,
+                                          signals[MESSAGE_RECEIVED],
+                                          0,
+                                          FALSE))
+                g_signal_emit (client,
+                               signals[MESSAGE_RECEIVED],
+                               0,
+                               message->from_ip,
+                               message->from_port,
+                               message->type,
+                               _gssdp_message_get_soup_headers (message));
+
+        _gssdp_message_unref (message);
+}
+
+/*
+ * Handles a single datagram received on @socket_source. The message is either
+ * delivered right away or, if @ring is given, queued up for the main context.
+ * @address and @messages stay owned by the caller.
+ *
+ * Returns: %TRUE if a message was queued on @ring
+ */
+static gboolean
+handle_datagram (GSSDPClient            *client,
+                 GSSDPSocketSource      *socket_source,
+                 char                   *buf,
+                 gssize                  bytes,
+                 GSocketAddress         *address,
+                 GSocketControlMessage **messages,
+                 guint                   num_messages,
+                 GSSDPRing              *ring)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSSDPMessage *message = NULL;
+
+#ifdef HAVE_RXQ_OVFL
+        {
+                guint i;
+
+                for (i = 0; i < num_messages; i++) {
+                        GSocketControlMessage *msg = messages[i];
+
+                        if (GSSDP_IS_OVERFLOW_MESSAGE (msg))
+                                gssdp_socket_source_update_drops
+                                        (socket_source,
+                                         gssdp_overflow_message_get_drops
+                                                (GSSDP_OVERFLOW_MESSAGE (msg)));
+                }
+        }
+#endif
+
+        if (address != NULL)
+                message = parse_datagram
+                        (client,
+                         buf,
+                         bytes,
+                         address,
+                         messages,
+                         num_messages,
+                         !(socket_source == priv->multicast_socket &&
+                           priv->multicast_on_own_address));
+
+        if (message == NULL)
+                return FALSE;
+
+        if (ring == NULL) {
+                deliver_message (client, message);
+        } else if (gssdp_ring_push (ring, message)) {
+                return TRUE;
+        } else {
+                g_atomic_int_inc (&priv->dropped_messages);
+                _gssdp_message_unref (message);
+        }
+
+        return FALSE;
+}
+
+/*
+ * Called when data can be read from the socket. The datagrams are read into
+ * @buffers, which is (re-)allocated as needed, and the messages are either
+ * delivered right away or, if @ring is given, queued up for the main
+ * context.
+ */
+static gboolean
+socket_source_cb (GSSDPSocketSource *socket_source,
+                  GSSDPClient       *client,
+                  char             **buffers,
+                  guint             *buffers_count,
+                  GSSDPRing         *ring)
+{
+        GSocket *socket;
+        GError *error = NULL;
+        GInputMessage messages[MAX_RECEIVE_BATCH_SIZE];
+        GInputVector vectors[MAX_RECEIVE_BATCH_SIZE];
+        GSocketAddress *addresses[MAX_RECEIVE_BATCH_SIZE];
+        GSocketControlMessage **control_messages[MAX_RECEIVE_BATCH_SIZE];
+        guint num_control_messages[MAX_RECEIVE_BATCH_SIZE];
+        gint received, i;
+        guint batch_size;
+        gboolean queued = FALSE;
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+        batch_size = (guint) g_atomic_int_get
+                                ((gint *) &priv->receive_batch_size);
+        if (*buffers_count != batch_size) {
+                g_free (*buffers);
+                *buffers_count = batch_size;
+                *buffers = g_malloc (*buffers_count * BUF_SIZE);
+        }
+
+        for (i = 0; i < (gint) *buffers_count; i++) {
+                vectors[i].buffer = *buffers + i * BUF_SIZE;
+                vectors[i].size = BUF_SIZE;
+
+                addresses[i] = NULL;
+                control_messages[i] = NULL;
+                num_control_messages[i] = 0;
+
+                messages[i].address = &addresses[i];
+                messages[i].vectors = &vectors[i];
+                messages[i].num_vectors = 1;
+                messages[i].bytes_received = 0;
+                messages[i].flags = G_SOCKET_MSG_NONE;
+                messages[i].control_messages = &control_messages[i];
+                messages[i].num_control_messages = &num_control_messages[i];
+        }
+
+        /* Get Socket */
+        socket = gssdp_socket_source_get_socket (socket_source);
+
+        /* Each datagram gets its own control messages, so the IP_PKTINFO
+         * based interface filtering keeps working per packet */
+        received = g_socket_receive_messages (socket,
+                                              messages,
+                                              *buffers_count,
+                                              G_SOCKET_MSG_NONE,
+                                              NULL,
+                                              &error);
+
+        if (received == -1) {
+                gssdp_diagnostic (&priv->diagnostics,
+                                  GSSDP_DIAGNOSTIC_RECEIVE_ERROR,
+                                  NULL,
+                                  NULL,
+                                  "Failed to receive from socket: %s",
+                                  error->message);
+                g_error_free (error);
+
+                return TRUE;
+        }
+
+        count (&priv->receive_wakeups);
+        g_atomic_pointer_add (&priv->received_datagrams, received);
+
+        for (i = 0; i < received; i++) {
+                guint j;
+
+                if (handle_datagram (client,
+                                     socket_source,
+                                     vectors[i].buffer,
+                                     messages[i].bytes_received,
+                                     addresses[i],
+                                     control_messages[i],
+                                     num_control_messages[i],
+                                     ring))
+                        queued = TRUE;
+
+                g_clear_object (&addresses[i]);
+
+                for (j = 0; j < num_control_messages[i]; j++)
+                        g_object_unref (control_messages[i][j]);
+                g_free (control_messages[i]);
+        }
+
+        if (queued)
+                g_main_context_wakeup (priv->main_context);
+
+        return TRUE;
+}
+
+typedef struct {
+        GSource      source;
+        GSSDPClient *client;
+} DeliverySource;
+
+static gboolean
+delivery_source_prepare (GSource *source,
+                         gint    *timeout)
+{
+        DeliverySource *delivery = (DeliverySource *) source;
+        GSSDPClientPrivate *priv =
+                gssdp_client_get_instance_private (delivery->client);
+        guint i;
+
+        *timeout = -1;
+
+        if (priv->received_messages != NULL &&
+            !gssdp_ring_is_empty (priv->received_messages))
+                return TRUE;
+
+        for (i = 0; i < priv->n_search_workers; i++) {
+                GSSDPRing *ring = priv->search_workers != NULL ?
+                                  priv->search_workers[i].ring : NULL;
+
+                if (ring != NULL && !gssdp_ring_is_empty (ring))
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+static gboolean
+delivery_source_check (GSource *source)
+{
+        gint timeout;
+
+        return delivery_source_prepare (source, &timeout);
+}
+
+/*
+ * Delivers what @ring holds right now. Messages arriving meanwhile wait for
+ * the next main loop iteration, so a flood can't starve the application.
+ */
+static void
+deliver_queued_messages (GSource     *source,
+                         GSSDPClient *client,
+                         GSSDPRing   *ring)
+{
+        guint n = gssdp_ring_get_capacity (ring);
+        GSSDPMessage *message;
+
+        while (n-- > 0 &&
+               !g_source_is_destroyed (source) &&
+               (message = gssdp_ring_pop (ring)) != NULL)
+                deliver_message (client, message);
+}
+
+static gboolean
+delivery_source_dispatch (GSource                  *source,
+                          G_GNUC_UNUSED GSourceFunc callback,
+                          G_GNUC_UNUSED gpointer    user_data)
+{
+        DeliverySource *delivery = (DeliverySource *) source;
+        GSSDPClient *client = delivery->client;
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        guint i;
+
+        g_object_ref (client);
+
+        if (priv->received_messages != NULL)
+                deliver_queued_messages (source,
+                                         client,
+                                         priv->received_messages);
+
+        for (i = 0;
+             i < priv->n_search_workers && !g_source_is_destroyed (source);
+             i++) {
+                if (priv->search_workers != NULL &&
+                    priv->search_workers[i].ring != NULL)
+                        deliver_queued_messages (source,
+                                                 client,
+                                                 priv->search_workers[i].ring);
+        }
+
+        g_object_unref (client);
+
+        return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs delivery_source_funcs = {
+        delivery_source_prepare,
+        delivery_source_check,
+        delivery_source_dispatch,
+        NULL,
+        NULL,
+        NULL
+};
+
+/*
+ * Sets up passing messages from other threads back to the current
+ * thread-default main context.
+ */
+static void
+ensure_delivery (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        DeliverySource *delivery;
+
+        if (priv->delivery_source != NULL)
+                return;
+
+        priv->main_context = g_main_context_ref_thread_default ();
+
+        priv->delivery_source = g_source_new (&delivery_source_funcs,
+                                              sizeof (DeliverySource));
+        g_source_set_name (priv->delivery_source, "GSSDPClient delivery");
+        delivery = (DeliverySource *) priv->delivery_source;
+        delivery->client = client;
+        g_source_attach (priv->delivery_source, priv->main_context);
+}
+
+/* Only call this once no thread is queueing messages any more */
+static void
+stop_delivery (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+        if (priv->delivery_source == NULL)
+                return;
+
+        g_source_destroy (priv->delivery_source);
+        g_clear_pointer (&priv->delivery_source, g_source_unref);
+        g_clear_pointer (&priv->main_context, g_main_context_unref);
+}
+
+static void
+drop_queued_messages (GSSDPRing *ring)
+{
+        GSSDPMessage *message;
+
+        while ((message = gssdp_ring_pop (ring)) != NULL)
+                _gssdp_message_unref (message);
+
+        gssdp_ring_free (ring);
+}
+
+static gpointer
+receive_thread_func (gpointer user_data)
+{
+        GMainLoop *loop = user_data;
+        GMainContext *context = g_main_loop_get_context (loop);
+
+        g_main_context_push_thread_default (context);
+        g_main_loop_run (loop);
+        g_main_context_pop_thread_default (context);
+
+        return NULL;
+}
+
+static gboolean
+quit_receive_loop (gpointer user_data)
+{
+        g_main_loop_quit (user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Stops a thread running receive_thread_func() and waits for it */
+static void
+join_receive_thread (GThread   *thread,
+                     GMainLoop *loop)
+{
+        GSource *source;
+
+        /* Quitting right away would be lost if the loop is not running
+         * yet */
+        source = g_idle_source_new ();
+        g_source_set_callback (source, quit_receive_loop, loop, NULL);
+        g_source_attach (source, g_main_loop_get_context (loop));
+        g_source_unref (source);
+
+        g_thread_join (thread);
+}
+
+/*
+ * Starts reading the sockets, which are attached to priv->io_context
+ * already, on a thread of their own. Messages are passed back to the
+ * current thread-default main context.
+ */
+static void
+start_receive_thread (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+        ensure_delivery (client);
+        priv->received_messages = gssdp_ring_new (RECEIVE_RING_SIZE);
+
+        priv->io_loop = g_main_loop_new (priv->io_context, FALSE);
+        priv->io_thread = g_thread_new ("gssdp-receive",
+                                        receive_thread_func,
+                                        priv->io_loop);
+}
+
+static void
+stop_receive_thread (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+        if (priv->io_thread == NULL)
+                return;
+
+        join_receive_thread (priv->io_thread, priv->io_loop);
+        priv->io_thread = NULL;
+        g_clear_pointer (&priv->io_loop, g_main_loop_unref);
+
+        g_clear_pointer (&priv->received_messages, drop_queued_messages);
+}
+
+static gboolean
+search_worker_source_cb (G_GNUC_UNUSED GIOChannel  *source,
+                         G_GNUC_UNUSED GIOCondition condition,
+                         gpointer                   user_data)
+{
+        SearchWorker *worker = user_data;
+
+        return socket_source_cb (worker->socket,
+                                 worker->client,
+                                 &worker->buffers,
+                                 &worker->buffers_count,
+                                 worker->ring);
+}
+
+/*
+ * Opens another search socket on the port of the first one. GSocket enables
+ * SO_REUSEPORT on datagram sockets it binds with address reuse, so the
+ * kernel balances the responses over all of them.
+ */
+static GSSDPSocketSource *
+open_search_socket (GSSDPClient *client,
+                    guint        port,
+                    GError     **error)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+
+        return g_initable_new (GSSDP_TYPE_SOCKET_SOURCE,
+                               NULL,
+                               error,
+                               "type", GSSDP_SOCKET_SOURCE_TYPE_SEARCH,
+                               "host-ip", gssdp_client_get_host_ip (client),
+                               "ttl", priv->socket_ttl,
+                               "port", port,
+                               "device-name", priv->device.iface_name,
+                               NULL);
+}
+
+/*
+ * Moves reading priv->search_socket to a worker thread and starts
+ * priv->n_search_workers - 1 more workers with sockets of their own. If some
+ * of them can't be set up, the client just runs with fewer.
+ */
+static void
+start_search_workers (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSocketAddress *address;
+        guint port, i;
+
+        address = g_socket_get_local_address
+                        (gssdp_socket_source_get_socket (priv->search_socket),
+                         NULL);
+        port = address != NULL ?
+               g_inet_socket_address_get_port
+                        (G_INET_SOCKET_ADDRESS (address)) : 0;
+        g_clear_object (&address);
+
+        ensure_delivery (client);
+        priv->search_workers = g_new0 (SearchWorker, priv->n_search_workers);
+
+        for (i = 0; i < priv->n_search_workers; i++) {
+                SearchWorker *worker = &priv->search_workers[i];
+                GError *error = NULL;
+                char *name;
+
+                if (i == 0) {
+                        worker->socket = g_object_ref (priv->search_socket);
+                } else if (port != 0) {
+                        worker->socket = open_search_socket (client,
+                                                             port,
+                                                             &error);
+                        if (worker->socket == NULL) {
+                                g_warning ("Failed to open search socket: %s",
+                                           error->message);
+                                g_error_free (error);
+                        }
+                }
+
+                if (worker->socket == NULL)
+                        continue;
+
+                worker->client = client;
+                worker->ring = gssdp_ring_new (RECEIVE_RING_SIZE);
+                worker->context = g_main_context_new ();
+
+                gssdp_socket_source_set_callback
+                                        (worker->socket,
+                                         (GSourceFunc) search_worker_source_cb,
+                                         worker);
+                g_main_context_push_thread_default (worker->context);
+                gssdp_socket_source_attach (worker->socket);
+                g_main_context_pop_thread_default (worker->context);
+
+                name = g_strdup_printf ("gssdp-search-%u", i);
+                worker->loop = g_main_loop_new (worker->context, FALSE);
+                worker->thread = g_thread_new (name,
+                                               receive_thread_func,
+                                               worker->loop);
+                g_free (name);
+        }
+}
+
+static void
+stop_search_workers (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        guint i;
+
+        if (priv->search_workers == NULL)
+                return;
+
+        for (i = 0; i < priv->n_search_workers; i++) {
+                SearchWorker *worker = &priv->search_workers[i];
+
+                if (worker->thread == NULL)
+                        continue;
+
+                join_receive_thread (worker->thread, worker->loop);
+                worker->thread = NULL;
+        }
+
+        for (i = 0; i < priv->n_search_workers; i++) {
+                SearchWorker *worker = &priv->search_workers[i];
+
+                /* Destroys the socket's source on the worker context */
+                g_clear_object (&worker->socket);
+                g_clear_pointer (&worker->loop, g_main_loop_unref);
+                g_clear_pointer (&worker->context, g_main_context_unref);
+                g_clear_pointer (&worker->ring, drop_queued_messages);
+                g_clear_pointer (&worker->buffers, g_free);
+        }
+
+        g_clear_pointer (&priv->search_workers, g_free);
+}
+
+#ifdef HAVE_LIBURING
+static void
+uring_receive_cb (GSSDPSocketSource      *socket_source,
+                  char                   *buf,
+                  gsize                   length,
+                  GSocketAddress         *address,
+                  GSocketControlMessage **messages,
+                  guint                   num_messages,
+                  gpointer                user_data)
+{
+        handle_datagram (GSSDP_CLIENT (user_data),
+                         socket_source,
+                         buf,
+                         length,
+                         address,
+                         messages,
+                         num_messages,
+                         NULL);
+}
+
+/*
+ * Hands receiving on all sockets and sending over to an io_uring, see
+ * GSSDPClient:io-uring. The poll sources of the sockets are left unattached
+ * if this succeeds.
+ */
+static gboolean
+start_uring (GSSDPClient *client)
+{
+        GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
+        GSSDPSocketSource *sockets[3];
+        GError *error = NULL;
+        guint i;
+
+        if (priv->receive_thread || priv->n_search_workers > 1) {
+                g_debug ("Not using io_uring together with receive threads");
+
+                return FALSE;
+        }
+
+        priv->uring = gssdp_uring_new (&priv->diagnostics, &error);
+        if (priv->uring == NULL)
+                goto fail;
+
+        sockets[0] = priv->request_socket;
+        sockets[1] = priv->multicast_socket;
+        sockets[2] = priv->search_socket;
+        for (i = 0; i < G_N_ELEMENTS (sockets); i++) {
+                if (!gssdp_uring_add_socket (priv->uring,
+                                             sockets[i],
+                                             uring_receive_cb,
+                                             client,
+                                             &error))
+                        goto fail;
+        }
+
+        gssdp_uring_attach (priv->uring,
+                            g_main_context_get_thread_default ());
 
         return TRUE;
+
+fail:
+        g_debug ("Falling back to polling the sockets: %s", error->message);
+        g_error_free (error);
+        g_clear_pointer (&priv->uring, gssdp_uring_free);
+
+        return FALSE;
+}
+#else
+static gboolean
+start_uring (G_GNUC_UNUSED GSSDPClient *client)
+{
+        g_debug ("Built without io_uring support, polling the sockets");
+
+        return FALSE;
 }
+#endif
 
 static gboolean
 request_socket_source_cb (G_GNUC_UNUSED GIOChannel  *source,
@@ -1275,7 +3837,11 @@ request_socket_source_cb (G_GNUC_UNUSED GIOChannel  *source,
         GSSDPClient *client = GSSDP_CLIENT (user_data);
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
-        return socket_source_cb (priv->request_socket, client);
+        return socket_source_cb (priv->request_socket,
+                                 client,
+                                 &priv->receive_buffers,
+                                 &priv->receive_buffers_count,
+                                 priv->received_messages);
 }
 
 static gboolean
@@ -1286,7 +3852,11 @@ multicast_socket_source_cb (G_GNUC_UNUSED GIOChannel  *source,
         GSSDPClient *client = GSSDP_CLIENT (user_data);
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
-        return socket_source_cb (priv->multicast_socket, client);
+        return socket_source_cb (priv->multicast_socket,
+                                 client,
+                                 &priv->receive_buffers,
+                                 &priv->receive_buffers_count,
+                                 priv->received_messages);
 }
 
 static gboolean
@@ -1297,7 +3867,11 @@ search_socket_source_cb (G_GNUC_UNUSED GIOChannel  *source,
         GSSDPClient *client = GSSDP_CLIENT (user_data);
         GSSDPClientPrivate *priv = gssdp_client_get_instance_private (client);
 
-        return socket_source_cb (priv->search_socket, client);
+        return socket_source_cb (priv->search_socket,
+                                 client,
+                                 &priv->receive_buffers,
+                                 &priv->receive_buffers_count,
+                                 priv->received_messages);
 }
 
 static gboolean
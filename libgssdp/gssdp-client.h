@@ -43,6 +43,29 @@ struct _GSSDPClientClass {
         void (* _gssdp_reserved4) (void);
 };
 
+/**
+ * GSSDPLatencyStage:
+ * @GSSDP_LATENCY_KERNEL_TO_PARSE: From the kernel receiving a datagram to
+ * GSSDP having parsed it. Only measured where the kernel timestamps received
+ * datagrams.
+ * @GSSDP_LATENCY_PARSE_TO_DISPATCH: From parsing a message to handing it to
+ * resource browsers and groups.
+ * @GSSDP_LATENCY_SEARCH_TO_RESPONSE: From receiving a discovery request to
+ * sending a response to it. This includes the random delay of up to MX
+ * seconds that responses are spread over.
+ * @GSSDP_LATENCY_RECEIVE_TO_AVAILABLE: From receiving an announcement or
+ * discovery response to #GSSDPResourceBrowser::resource-available being
+ * emitted for it.
+ *
+ * The stages gssdp_client_get_latency_histogram() keeps track of.
+ */
+typedef enum {
+        GSSDP_LATENCY_KERNEL_TO_PARSE,
+        GSSDP_LATENCY_PARSE_TO_DISPATCH,
+        GSSDP_LATENCY_SEARCH_TO_RESPONSE,
+        GSSDP_LATENCY_RECEIVE_TO_AVAILABLE
+} GSSDPLatencyStage;
+
 GSSDPClient *
 gssdp_client_new              (const char   *iface,
                                GError      **error);
@@ -96,6 +119,69 @@ const char *
 gssdp_client_guess_user_agent (GSSDPClient *client,
                                const char  *ip_address);
 
+void
+gssdp_client_set_receive_batch_size (GSSDPClient *client,
+                                     guint        batch_size);
+
+guint
+gssdp_client_get_receive_batch_size (GSSDPClient *client);
+
+gdouble
+gssdp_client_get_receive_batch_depth (GSSDPClient *client);
+
+void
+gssdp_client_set_receive_buffer_size (GSSDPClient *client,
+                                      guint        size);
+
+guint
+gssdp_client_get_receive_buffer_size (GSSDPClient *client);
+
+guint64
+gssdp_client_get_dropped_datagrams   (GSSDPClient *client);
+
+GVariant *
+gssdp_client_get_statistics          (GSSDPClient *client);
+
+guint64 *
+gssdp_client_get_latency_histogram   (GSSDPClient       *client,
+                                      GSSDPLatencyStage  stage,
+                                      guint             *n_buckets);
+
+void
+gssdp_client_set_message_rate  (GSSDPClient *client,
+                                guint        rate);
+
+guint
+gssdp_client_get_message_rate  (GSSDPClient *client);
+
+void
+gssdp_client_set_message_burst (GSSDPClient *client,
+                                guint        burst);
+
+guint
+gssdp_client_get_message_burst (GSSDPClient *client);
+
+void
+gssdp_client_set_user_agent_cache_size (GSSDPClient *client,
+                                        guint        size);
+
+guint
+gssdp_client_get_user_agent_cache_size (GSSDPClient *client);
+
+void
+gssdp_client_set_user_agent_cache_ttl  (GSSDPClient *client,
+                                        guint        ttl);
+
+guint
+gssdp_client_get_user_agent_cache_ttl  (GSSDPClient *client);
+
+void
+gssdp_client_set_kernel_filter         (GSSDPClient *client,
+                                        gboolean     kernel_filter);
+
+gboolean
+gssdp_client_get_kernel_filter         (GSSDPClient *client);
+
 G_END_DECLS
 
 #endif /* GSSDP_CLIENT_H */
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Rate limited warnings for things that can go wrong once per packet.
+ *
+ * Every kind of diagnostic may be logged a few times per interval; the rest
+ * only bump a counter, and how many were swallowed is reported with the next
+ * message that gets through. Where GLib supports it, messages are logged
+ * with structured fields so the sender and the offending header can be
+ * filtered on.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-diagnostics.h"
+
+static const char *diagnostic_names[GSSDP_N_DIAGNOSTICS] = {
+        "invalid-cache-control",
+        "invalid-expires",
+        "missing-expiry",
+        "invalid-search",
+        "oversized-datagram",
+        "send-error",
+        "receive-error"
+};
+
+/*
+ * gssdp_diagnostics_init:
+ * @burst: Number of messages of each kind logged per interval
+ * @interval: Length of the interval in milliseconds
+ */
+void
+gssdp_diagnostics_init (GSSDPDiagnostics *diagnostics,
+                        guint             burst,
+                        guint             interval)
+{
+        guint i;
+
+        g_mutex_init (&diagnostics->lock);
+        diagnostics->burst = burst;
+        diagnostics->interval = (gint64) interval * 1000;
+
+        for (i = 0; i < GSSDP_N_DIAGNOSTICS; i++) {
+                GSSDPDiagnosticState *state = &diagnostics->states[i];
+
+                state->count = 0;
+                /* The first diagnostic opens a new interval */
+                state->window_start = g_get_monotonic_time () -
+                                      diagnostics->interval;
+                state->n_logged = 0;
+                state->n_suppressed = 0;
+                state->total_suppressed = 0;
+        }
+}
+
+void
+gssdp_diagnostics_clear (GSSDPDiagnostics *diagnostics)
+{
+        g_mutex_clear (&diagnostics->lock);
+}
+
+/*
+ * Counts @diagnostic and checks whether it may be logged. If so,
+ * @n_suppressed is set to the number of messages of this kind that were
+ * swallowed since the last one was logged.
+ *
+ * Return value: %TRUE if the diagnostic should be logged
+ */
+gboolean
+gssdp_diagnostics_take (GSSDPDiagnostics *diagnostics,
+                        GSSDPDiagnostic   diagnostic,
+                        guint            *n_suppressed)
+{
+        GSSDPDiagnosticState *state = &diagnostics->states[diagnostic];
+        gboolean take;
+        gint64 now;
+
+        gssdp_diagnostics_count (diagnostics, diagnostic);
+
+        now = g_get_monotonic_time ();
+        *n_suppressed = 0;
+
+        g_mutex_lock (&diagnostics->lock);
+
+        if (now - state->window_start >= diagnostics->interval) {
+                *n_suppressed = state->n_suppressed;
+                state->window_start = now;
+                state->n_logged = 0;
+                state->n_suppressed = 0;
+        }
+
+        take = state->n_logged < diagnostics->burst;
+        if (take) {
+                state->n_logged++;
+        } else {
+                state->n_suppressed++;
+                state->total_suppressed++;
+        }
+
+        g_mutex_unlock (&diagnostics->lock);
+
+        return take;
+}
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+static void
+add_field (GLogField  *fields,
+           gsize      *n_fields,
+           const char *key,
+           const char *value)
+{
+        fields[*n_fields].key = key;
+        fields[*n_fields].value = value;
+        fields[*n_fields].length = -1;
+        (*n_fields)++;
+}
+#endif
+
+/*
+ * Logs @diagnostic as a warning. @from_ip and @header may be %NULL.
+ */
+void
+gssdp_diagnostics_log (GSSDPDiagnostic  diagnostic,
+                       guint            n_suppressed,
+                       const char      *from_ip,
+                       const char      *header,
+                       const char      *format,
+                       ...)
+{
+        GString *message;
+        va_list args;
+
+        message = g_string_new (NULL);
+
+        va_start (args, format);
+        g_string_append_vprintf (message, format, args);
+        va_end (args);
+
+        if (from_ip != NULL)
+                g_string_append_printf (message, " (from %s)", from_ip);
+
+        if (header != NULL)
+                g_string_append_printf (message, "\nHeader was:\n%s", header);
+
+        if (n_suppressed > 0)
+                g_string_append_printf (message,
+                                        "\n%u similar messages were "
+                                        "suppressed",
+                                        n_suppressed);
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+        {
+                GLogField fields[7];
+                gsize n_fields = 0;
+                const char *domain = G_LOG_DOMAIN;
+                char suppressed[16];
+
+                add_field (fields, &n_fields, "MESSAGE", message->str);
+                add_field (fields, &n_fields, "PRIORITY", "4");
+
+                /* Keep G_MESSAGES_DEBUG and the default writer's filtering
+                 * working like for g_log () */
+                if (domain != NULL)
+                        add_field (fields, &n_fields, "GLIB_DOMAIN", domain);
+
+                add_field (fields,
+                           &n_fields,
+                           "GSSDP_DIAGNOSTIC",
+                           diagnostic_names[diagnostic]);
+
+                if (from_ip != NULL)
+                        add_field (fields,
+                                   &n_fields,
+                                   "GSSDP_SOURCE_IP",
+                                   from_ip);
+
+                if (header != NULL)
+                        add_field (fields, &n_fields, "GSSDP_HEADER", header);
+
+                g_snprintf (suppressed,
+                            sizeof (suppressed),
+                            "%u",
+                            n_suppressed);
+                add_field (fields, &n_fields, "GSSDP_SUPPRESSED", suppressed);
+
+                g_log_structured_array (G_LOG_LEVEL_WARNING, fields, n_fields);
+        }
+#else
+        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "%s", message->str);
+#endif
+
+        g_string_free (message, TRUE);
+}
+
+/*
+ * Adds a diagnostics-<kind> counter for every kind of diagnostic and the
+ * total number of suppressed messages to the a{sv} @builder.
+ */
+void
+gssdp_diagnostics_add_statistics (GSSDPDiagnostics *diagnostics,
+                                  GVariantBuilder  *builder)
+{
+        guint64 suppressed = 0;
+        guint i;
+
+        for (i = 0; i < GSSDP_N_DIAGNOSTICS; i++) {
+                char *key;
+                gsize count;
+
+                count = (gsize) g_atomic_pointer_get
+                                        (&diagnostics->states[i].count);
+                key = g_strconcat ("diagnostics-", diagnostic_names[i], NULL);
+                g_variant_builder_add (builder,
+                                       "{sv}",
+                                       key,
+                                       g_variant_new_uint64 (count));
+                g_free (key);
+        }
+
+        g_mutex_lock (&diagnostics->lock);
+        for (i = 0; i < GSSDP_N_DIAGNOSTICS; i++)
+                suppressed += diagnostics->states[i].total_suppressed;
+        g_mutex_unlock (&diagnostics->lock);
+
+        g_variant_builder_add (builder,
+                               "{sv}",
+                               "suppressed-diagnostics",
+                               g_variant_new_uint64 (suppressed));
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_DIAGNOSTICS_H
+#define GSSDP_DIAGNOSTICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Problems with the network or with other devices that can happen once per
+ * packet. Each kind is rate limited on its own. */
+typedef enum {
+        GSSDP_DIAGNOSTIC_INVALID_CACHE_CONTROL,
+        GSSDP_DIAGNOSTIC_INVALID_EXPIRES,
+        GSSDP_DIAGNOSTIC_MISSING_EXPIRY,
+        GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+        GSSDP_DIAGNOSTIC_OVERSIZED_DATAGRAM,
+        GSSDP_DIAGNOSTIC_SEND_ERROR,
+        GSSDP_DIAGNOSTIC_RECEIVE_ERROR,
+        GSSDP_N_DIAGNOSTICS
+} GSSDPDiagnostic;
+
+typedef struct {
+        /* Updated atomically, also when diagnostics are compiled out */
+        gsize  count;
+
+        gint64 window_start;
+        guint  n_logged;
+        guint  n_suppressed;
+        gsize  total_suppressed;
+} GSSDPDiagnosticState;
+
+/*
+ * Counters and rate limits for the diagnostics of one client. Meant to be
+ * embedded into the structure it belongs to. Safe to use from any thread.
+ */
+typedef struct {
+        GMutex               lock;
+        guint                burst;
+        gint64               interval;
+        GSSDPDiagnosticState states[GSSDP_N_DIAGNOSTICS];
+} GSSDPDiagnostics;
+
+G_GNUC_INTERNAL void
+gssdp_diagnostics_init           (GSSDPDiagnostics *diagnostics,
+                                  guint             burst,
+                                  guint             interval);
+
+G_GNUC_INTERNAL void
+gssdp_diagnostics_clear          (GSSDPDiagnostics *diagnostics);
+
+G_GNUC_INTERNAL gboolean
+gssdp_diagnostics_take           (GSSDPDiagnostics *diagnostics,
+                                  GSSDPDiagnostic   diagnostic,
+                                  guint            *n_suppressed);
+
+G_GNUC_INTERNAL void
+gssdp_diagnostics_log            (GSSDPDiagnostic   diagnostic,
+                                  guint             n_suppressed,
+                                  const char       *from_ip,
+                                  const char       *header,
+                                  const char       *format,
+                                  ...) G_GNUC_PRINTF (5, 6);
+
+G_GNUC_INTERNAL void
+gssdp_diagnostics_add_statistics (GSSDPDiagnostics *diagnostics,
+                                  GVariantBuilder  *builder);
+
+static inline void
+gssdp_diagnostics_count          (GSSDPDiagnostics *diagnostics,
+                                  GSSDPDiagnostic   diagnostic)
+{
+        g_atomic_pointer_add (&diagnostics->states[diagnostic].count, 1);
+}
+
+/*
+ * Reports @diagnostic, with @from_ip and @header being the sender and the
+ * offending header value if known. The message is only formatted if the rate
+ * limit lets it through. Building with GSSDP_DISABLE_DIAGNOSTICS defined
+ * reduces this to bumping the counter.
+ */
+#ifdef GSSDP_DISABLE_DIAGNOSTICS
+#define gssdp_diagnostic(diagnostics, diagnostic, from_ip, header, ...) \
+        gssdp_diagnostics_count ((diagnostics), (diagnostic))
+#else
+#define gssdp_diagnostic(diagnostics, diagnostic, from_ip, header, ...) \
+        G_STMT_START {                                                  \
+                guint _n_suppressed;                                    \
+                                                                        \
+                if (gssdp_diagnostics_take ((diagnostics),              \
+                                            (diagnostic),               \
+                                            &_n_suppressed))            \
+                        gssdp_diagnostics_log ((diagnostic),            \
+                                               _n_suppressed,           \
+                                               (from_ip),               \
+                                               (header),                \
+                                               __VA_ARGS__);            \
+        } G_STMT_END
+#endif
+
+G_END_DECLS
+
+#endif /* GSSDP_DIAGNOSTICS_H */
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * A GSSDPMessage is created once per received datagram by the client and
+ * handed to every resource browser and group, so the headers are only looked
+ * up and decoded once no matter how many listeners there are.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-message.h"
+#include "gssdp-protocol.h"
+#include "gssdp-target.h"
+
+#include <string.h>
+
+static const char *
+skip_space (const char *p)
+{
+        while (*p == ' ' || *p == '\t')
+                p++;
+
+        return p;
+}
+
+/*
+ * Returns the max-age directive of @cache_control, or -1 if there is none
+ */
+int
+_gssdp_message_parse_max_age (const char *cache_control)
+{
+        const char *p = cache_control;
+
+        while (p != NULL && *p != '\0') {
+                p = skip_space (p);
+
+                if (g_ascii_strncasecmp (p, "max-age", 7) == 0) {
+                        const char *value = skip_space (p + 7);
+
+                        if (*value == '=') {
+                                guint64 max_age;
+                                char *end;
+
+                                value = skip_space (value + 1);
+                                if (!g_ascii_isdigit (*value))
+                                        return -1;
+
+                                max_age = g_ascii_strtoull (value, &end, 10);
+                                end = (char *) skip_space (end);
+                                if ((*end != ',' && *end != '\0') ||
+                                    max_age > G_MAXINT)
+                                        return -1;
+
+                                return (int) max_age;
+                        }
+                }
+
+                p = strchr (p, ',');
+                if (p != NULL)
+                        p++;
+        }
+
+        return -1;
+}
+
+static _GSSDPMessageNTS
+parse_nts (const char *nts)
+{
+        if (nts == NULL)
+                return _GSSDP_NTS_NONE;
+
+        if (strncmp (nts, SSDP_ALIVE_NTS, strlen (SSDP_ALIVE_NTS)) == 0)
+                return _GSSDP_NTS_ALIVE;
+        else if (strncmp (nts, SSDP_BYEBYE_NTS, strlen (SSDP_BYEBYE_NTS)) == 0)
+                return _GSSDP_NTS_BYEBYE;
+
+        return _GSSDP_NTS_UNKNOWN;
+}
+
+/*
+ * Copies the header block of @buf that was parsed into @parser and decodes the
+ * well-known headers. The message takes ownership of @from_ip.
+ */
+GSSDPMessage *
+_gssdp_message_new (const GSSDPParser *parser,
+                    const char        *buf,
+                    char              *from_ip,
+                    gushort            from_port)
+{
+        GSSDPMessage *message;
+        const char *target;
+        char *data;
+        guint i;
+
+        /* Header slices and the header block share one allocation with the
+         * message itself */
+        message = g_malloc (sizeof (GSSDPMessage) +
+                            parser->n_headers * sizeof (GSSDPParserHeader) +
+                            parser->length + 1);
+        message->headers = (GSSDPParserHeader *) (message + 1);
+        data = (char *) (message->headers + parser->n_headers);
+
+        memcpy (data, buf, parser->length);
+        data[parser->length] = '\0';
+
+        message->n_headers = parser->n_headers;
+        for (i = 0; i < parser->n_headers; i++) {
+                message->headers[i].name =
+                        data + (parser->headers[i].name - buf);
+                message->headers[i].value =
+                        data + (parser->headers[i].value - buf);
+        }
+
+        message->ref_count = 1;
+        message->type = parser->type;
+        message->from_ip = from_ip;
+        message->from_port = from_port;
+        message->parsed = g_get_real_time ();
+        message->received = message->parsed;
+        message->soup_headers = NULL;
+
+        message->st = _gssdp_message_get_header (message, "ST");
+        message->nt = _gssdp_message_get_header (message, "NT");
+        message->nts = parse_nts (_gssdp_message_get_header (message, "NTS"));
+        message->usn = _gssdp_message_get_header (message, "USN");
+        message->location = _gssdp_message_get_header (message, "Location");
+        message->al = _gssdp_message_get_header (message, "AL");
+        message->man = _gssdp_message_get_header (message, "MAN");
+
+        message->agent = _gssdp_message_get_header (message, "Server");
+        if (message->agent == NULL)
+                message->agent = _gssdp_message_get_header (message,
+                                                            "User-Agent");
+
+        message->cache_control = _gssdp_message_get_header (message,
+                                                            "Cache-Control");
+        message->max_age = _gssdp_message_parse_max_age
+                                        (message->cache_control);
+
+        message->mx = -1;
+        if (message->type == _GSSDP_DISCOVERY_REQUEST) {
+                const char *mx;
+
+                /* Be as lenient as atoi() about trailing garbage */
+                mx = _gssdp_message_get_header (message, "MX");
+                if (mx != NULL && g_ascii_isdigit (*mx))
+                        message->mx = (int) MIN (g_ascii_strtoull (mx, NULL, 10),
+                                                 G_MAXINT);
+        }
+
+        target = message->type == _GSSDP_ANNOUNCEMENT ? message->nt
+                                                      : message->st;
+        message->version = 0;
+        if (target != NULL)
+                gssdp_target_prefix_length (target, &message->version);
+
+        return message;
+}
+
+GSSDPMessage *
+_gssdp_message_ref (GSSDPMessage *message)
+{
+        g_return_val_if_fail (message != NULL, NULL);
+
+        g_atomic_int_inc (&message->ref_count);
+
+        return message;
+}
+
+void
+_gssdp_message_unref (GSSDPMessage *message)
+{
+        g_return_if_fail (message != NULL);
+
+        if (!g_atomic_int_dec_and_test (&message->ref_count))
+                return;
+
+        if (message->soup_headers != NULL)
+                soup_message_headers_free (message->soup_headers);
+
+        g_free (message->from_ip);
+        g_free (message);
+}
+
+/*
+ * Looks up any header of @message. The common ones are available as members
+ * of #GSSDPMessage already.
+ */
+const char *
+_gssdp_message_get_header (GSSDPMessage *message,
+                           const char   *name)
+{
+        guint i;
+
+        for (i = 0; i < message->n_headers; i++) {
+                if (g_ascii_strcasecmp (message->headers[i].name, name) == 0)
+                        return message->headers[i].value;
+        }
+
+        return NULL;
+}
+
+/*
+ * Returns the headers of @message as #SoupMessageHeaders. They are only built
+ * on first use and owned by @message.
+ */
+SoupMessageHeaders *
+_gssdp_message_get_soup_headers (GSSDPMessage *message)
+{
+        SoupMessageHeadersType type;
+        guint i;
+
+        if (message->soup_headers != NULL)
+                return message->soup_headers;
+
+        if (message->type == _GSSDP_DISCOVERY_RESPONSE)
+                type = SOUP_MESSAGE_HEADERS_RESPONSE;
+        else
+                type = SOUP_MESSAGE_HEADERS_REQUEST;
+
+        message->soup_headers = soup_message_headers_new (type);
+        for (i = 0; i < message->n_headers; i++)
+                soup_message_headers_append (message->soup_headers,
+                                             message->headers[i].name,
+                                             message->headers[i].value);
+
+        return message->soup_headers;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_MESSAGE_H
+#define GSSDP_MESSAGE_H
+
+#include <libsoup/soup.h>
+
+#include "gssdp-client-private.h"
+#include "gssdp-parser.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+        _GSSDP_NTS_NONE,
+        _GSSDP_NTS_ALIVE,
+        _GSSDP_NTS_BYEBYE,
+        _GSSDP_NTS_UNKNOWN
+} _GSSDPMessageNTS;
+
+/*
+ * A received SSDP message with the fields GSSDP cares about already looked
+ * up and decoded. All string members point into the message and are %NULL if
+ * the header was not present.
+ */
+struct _GSSDPMessage {
+        volatile gint       ref_count;
+
+        _GSSDPMessageType   type;
+        char               *from_ip;
+        gushort             from_port;
+
+        /* Wall clock times in microseconds at which the kernel received the
+         * datagram and at which it was parsed. Without kernel timestamps,
+         * both are the time of parsing. */
+        gint64              received;
+        gint64              parsed;
+
+        const char         *st;
+        const char         *nt;
+        _GSSDPMessageNTS    nts;
+        const char         *usn;
+        const char         *location;
+        const char         *al;
+        const char         *man;
+        const char         *agent;
+        const char         *cache_control;
+
+        /* max-age from Cache-Control, or -1 if missing or invalid */
+        int                 max_age;
+
+        /* MX of a discovery request, or -1 if missing or invalid */
+        int                 mx;
+
+        /* Version of the ST or NT target, or 0 if it does not have one */
+        guint               version;
+
+        GSSDPParserHeader  *headers;
+        guint               n_headers;
+
+        SoupMessageHeaders *soup_headers;
+};
+
+G_GNUC_INTERNAL GSSDPMessage *
+_gssdp_message_new              (const GSSDPParser *parser,
+                                 const char        *buf,
+                                 char              *from_ip,
+                                 gushort            from_port);
+
+G_GNUC_INTERNAL GSSDPMessage *
+_gssdp_message_ref              (GSSDPMessage      *message);
+
+G_GNUC_INTERNAL void
+_gssdp_message_unref            (GSSDPMessage      *message);
+
+G_GNUC_INTERNAL const char *
+_gssdp_message_get_header       (GSSDPMessage      *message,
+                                 const char        *name);
+
+G_GNUC_INTERNAL SoupMessageHeaders *
+_gssdp_message_get_soup_headers (GSSDPMessage      *message);
+
+G_GNUC_INTERNAL int
+_gssdp_message_parse_max_age    (const char        *cache_control);
+
+G_END_DECLS
+
+#endif /* GSSDP_MESSAGE_H */
@@ -80,6 +80,13 @@ gssdp_net_query_ifindex (GSSDPNetworkDevice *device)
 #endif
 }
 
+gboolean
+gssdp_net_is_only_host_ip (GSSDPNetworkDevice *device)
+{
+        /* Nothing relies on it being known here */
+        return FALSE;
+}
+
 char *
 gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
 {
@@ -103,6 +110,8 @@ gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
                 return g_strdup (ip_address);
 
         if (ioctl (fd, SIOCGARP, (caddr_t) &req) < 0) {
+                close (fd);
+
                 return NULL;
         }
         close (fd);
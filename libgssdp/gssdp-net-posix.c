@@ -38,17 +38,328 @@
 
 #ifdef __linux__
 #include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+/*
+ * Process-wide copy of the kernel's IPv4 neighbour table, kept up to date
+ * through an RTNETLINK subscription, so looking up the hardware address of a
+ * peer does not cost any system call per received packet.
+ */
+typedef struct {
+        char *hwaddr;
+        int   ifindex;
+} Neighbour;
+
+/* Pick up removals and changes at least this often (in microseconds) */
+#define NEIGHBOUR_REFRESH_INTERVAL G_USEC_PER_SEC
+
+/* Start over with a fresh dump if the table ever gets this large */
+#define NEIGHBOUR_TABLE_MAX 8192
+
+static GMutex neighbour_mutex;
+static guint neighbour_users;
+static int neighbour_fd = -1;
+static GHashTable *neighbours;
+static gint64 neighbour_last_refresh;
+
+/* Whether a dump of the table was asked for, and whether one arrived
+ * completely. Until then, lookups ask the kernel directly. */
+static gboolean neighbour_dump_requested;
+static gboolean neighbour_table_ready;
+
+/* Addresses recently found not to be neighbours, with the time (in
+ * microseconds) until which to believe that */
+static GHashTable *non_neighbours;
+
+static void
+neighbour_free (Neighbour *neighbour)
+{
+        g_free (neighbour->hwaddr);
+        g_slice_free (Neighbour, neighbour);
+}
+
+static gboolean
+neighbour_request_dump (void)
+{
+        struct {
+                struct nlmsghdr header;
+                struct ndmsg    message;
+        } request;
+
+        memset (&request, 0, sizeof (request));
+        request.header.nlmsg_len = NLMSG_LENGTH (sizeof (struct ndmsg));
+        request.header.nlmsg_type = RTM_GETNEIGH;
+        request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.message.ndm_family = AF_INET;
+
+        return send (neighbour_fd, &request, request.header.nlmsg_len, 0) >= 0;
+}
+
+static void
+neighbour_update (struct nlmsghdr *header)
+{
+        struct ndmsg *message = NLMSG_DATA (header);
+        struct rtattr *attr;
+        int length;
+        const guint8 *dst = NULL;
+        const guint8 *lladdr = NULL;
+        char ip[INET_ADDRSTRLEN];
+        Neighbour *neighbour;
+
+        if (header->nlmsg_len < NLMSG_LENGTH (sizeof (struct ndmsg)) ||
+            message->ndm_family != AF_INET)
+                return;
+
+        length = NLMSG_PAYLOAD (header, sizeof (struct ndmsg));
+        for (attr = (struct rtattr *) ((char *) message +
+                                       NLMSG_ALIGN (sizeof (struct ndmsg)));
+             RTA_OK (attr, length);
+             attr = RTA_NEXT (attr, length)) {
+                if (attr->rta_type == NDA_DST &&
+                    RTA_PAYLOAD (attr) == 4)
+                        dst = RTA_DATA (attr);
+                else if (attr->rta_type == NDA_LLADDR &&
+                         RTA_PAYLOAD (attr) == 6)
+                        lladdr = RTA_DATA (attr);
+        }
+
+        if (dst == NULL ||
+            inet_ntop (AF_INET, dst, ip, sizeof (ip)) == NULL)
+                return;
+
+        if (header->nlmsg_type == RTM_DELNEIGH ||
+            message->ndm_state & (NUD_FAILED | NUD_INCOMPLETE)) {
+                g_hash_table_remove (neighbours, ip);
+
+                return;
+        }
+
+        g_hash_table_remove (non_neighbours, ip);
+
+        neighbour = g_slice_new (Neighbour);
+        neighbour->ifindex = message->ndm_ifindex;
+
+        /* Like SIOCGARP without ATF_COM, known peers without a hardware
+         * address are identified by their IP */
+        if (lladdr != NULL)
+                neighbour->hwaddr = g_strdup_printf
+                                        ("%02X:%02X:%02X:%02X:%02X:%02X",
+                                         lladdr[0],
+                                         lladdr[1],
+                                         lladdr[2],
+                                         lladdr[3],
+                                         lladdr[4],
+                                         lladdr[5]);
+        else
+                neighbour->hwaddr = g_strdup (ip);
+
+        g_hash_table_replace (neighbours, g_strdup (ip), neighbour);
+}
+
+/*
+ * Throws the table away and asks for a fresh dump. If that cannot be asked
+ * for right now, it is retried with the next refresh. Called with the lock
+ * held.
+ */
+static void
+neighbour_table_restart (void)
+{
+        g_hash_table_remove_all (neighbours);
+        g_hash_table_remove_all (non_neighbours);
+        neighbour_table_ready = FALSE;
+        neighbour_dump_requested = neighbour_request_dump ();
+}
+
+/* Applies all pending neighbour notifications. Called with the lock held. */
+static void
+neighbour_drain (void)
+{
+        char buffer[8192];
+        ssize_t length;
+
+        while ((length = recv (neighbour_fd,
+                               buffer,
+                               sizeof (buffer),
+                               MSG_DONTWAIT)) != 0) {
+                struct nlmsghdr *header;
+                int remaining = (int) length;
+
+                if (length < 0) {
+                        /* Missed some notifications, start over */
+                        if (errno == ENOBUFS) {
+                                neighbour_table_restart ();
+
+                                continue;
+                        }
+
+                        if (errno == EINTR)
+                                continue;
+
+                        break;
+                }
+
+                for (header = (struct nlmsghdr *) buffer;
+                     NLMSG_OK (header, remaining);
+                     header = NLMSG_NEXT (header, remaining)) {
+                        if (header->nlmsg_type == RTM_NEWNEIGH ||
+                            header->nlmsg_type == RTM_DELNEIGH)
+                                neighbour_update (header);
+                        else if (header->nlmsg_type == NLMSG_DONE &&
+                                 neighbour_dump_requested) {
+                                neighbour_dump_requested = FALSE;
+                                neighbour_table_ready = TRUE;
+                        }
+                }
+        }
+
+        if (g_hash_table_size (neighbours) > NEIGHBOUR_TABLE_MAX)
+                neighbour_table_restart ();
+        else if (!neighbour_table_ready && !neighbour_dump_requested)
+                neighbour_dump_requested = neighbour_request_dump ();
+
+        if (g_hash_table_size (non_neighbours) > NEIGHBOUR_TABLE_MAX)
+                g_hash_table_remove_all (non_neighbours);
+
+        neighbour_last_refresh = g_get_monotonic_time ();
+}
+
+static void
+neighbour_table_open (void)
+{
+        struct sockaddr_nl address;
+
+        neighbour_fd = socket (AF_NETLINK,
+                               SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                               NETLINK_ROUTE);
+        if (neighbour_fd < 0)
+                return;
+
+        memset (&address, 0, sizeof (address));
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = RTMGRP_NEIGH;
+
+        if (bind (neighbour_fd,
+                  (struct sockaddr *) &address,
+                  sizeof (address)) < 0 ||
+            !neighbour_request_dump ()) {
+                g_debug ("Failed to subscribe to neighbour updates: %s",
+                         g_strerror (errno));
+                close (neighbour_fd);
+                neighbour_fd = -1;
+
+                return;
+        }
+
+        neighbours = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) neighbour_free);
+        non_neighbours = g_hash_table_new_full (g_str_hash,
+                                                g_str_equal,
+                                                g_free,
+                                                g_free);
+        neighbour_last_refresh = 0;
+        neighbour_dump_requested = TRUE;
+        neighbour_table_ready = FALSE;
+}
+
+static void
+neighbour_table_close (void)
+{
+        if (neighbour_fd >= 0) {
+                close (neighbour_fd);
+                neighbour_fd = -1;
+        }
+
+        g_clear_pointer (&neighbours, g_hash_table_unref);
+        g_clear_pointer (&non_neighbours, g_hash_table_unref);
+}
+
+/*
+ * Looks @ip_address up in the neighbour table. Returns %FALSE if the table is
+ * not available or not complete, in which case the kernel needs to be asked
+ * directly.
+ */
+static gboolean
+neighbour_lookup (GSSDPNetworkDevice *device,
+                  const char         *ip_address,
+                  char              **hwaddr)
+{
+        Neighbour *neighbour = NULL;
+        gint64 *until;
+        gint64 now;
+
+        g_mutex_lock (&neighbour_mutex);
+
+        if (neighbour_fd < 0) {
+                g_mutex_unlock (&neighbour_mutex);
+
+                return FALSE;
+        }
+
+        now = g_get_monotonic_time ();
+        if (now - neighbour_last_refresh > NEIGHBOUR_REFRESH_INTERVAL)
+                neighbour_drain ();
+
+        if (!neighbour_table_ready) {
+                g_mutex_unlock (&neighbour_mutex);
+
+                return FALSE;
+        }
+
+        /* Peers that are not in the table yet show up with the next refresh
+         * at the latest, so there is no point in draining for every miss */
+        until = g_hash_table_lookup (non_neighbours, ip_address);
+        if (until == NULL || *until < now) {
+                neighbour = g_hash_table_lookup (neighbours, ip_address);
+                if (neighbour == NULL) {
+                        until = g_new (gint64, 1);
+                        *until = now + NEIGHBOUR_REFRESH_INTERVAL;
+                        g_hash_table_replace (non_neighbours,
+                                              g_strdup (ip_address),
+                                              until);
+                }
+        }
+
+        if (neighbour != NULL &&
+            device->index > 0 &&
+            neighbour->ifindex != device->index)
+                neighbour = NULL;
+
+        *hwaddr = neighbour != NULL ? g_strdup (neighbour->hwaddr) : NULL;
+
+        g_mutex_unlock (&neighbour_mutex);
+
+        return TRUE;
+}
 #endif
 
 gboolean
 gssdp_net_init (GError **error)
 {
+#ifdef __linux__
+        g_mutex_lock (&neighbour_mutex);
+        if (neighbour_users++ == 0)
+                neighbour_table_open ();
+        g_mutex_unlock (&neighbour_mutex);
+#endif
+
         return TRUE;
 }
 
 void
 gssdp_net_shutdown (void)
 {
+#ifdef __linux__
+        g_mutex_lock (&neighbour_mutex);
+        if (neighbour_users > 0 && --neighbour_users == 0)
+                neighbour_table_close ();
+        g_mutex_unlock (&neighbour_mutex);
+#endif
 }
 
 int
@@ -88,6 +399,10 @@ gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
         struct arpreq req;
         struct sockaddr_in *sin;
         int fd = -1;
+        char *hwaddr;
+
+        if (neighbour_lookup (device, ip_address, &hwaddr))
+                return hwaddr;
 
         memset (&req, 0, sizeof (req));
 
@@ -104,6 +419,8 @@ gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
                 return g_strdup (ip_address);
 
         if (ioctl (fd, SIOCGARP, (caddr_t) &req) < 0) {
+                close (fd);
+
                 return NULL;
         }
         close (fd);
@@ -126,6 +443,44 @@ gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
 #endif
 }
 
+/*
+ * Returns %TRUE if the host address of @device is the only IPv4 address of
+ * its interface, so anything received on that interface is for it.
+ */
+gboolean
+gssdp_net_is_only_host_ip (GSSDPNetworkDevice *device)
+{
+        struct ifaddrs *ifa_list, *ifa;
+        guint n_addresses = 0;
+        gboolean ours = FALSE;
+
+        if (device->iface_name == NULL ||
+            device->host_ip == NULL ||
+            getifaddrs (&ifa_list) != 0)
+                return FALSE;
+
+        for (ifa = ifa_list; ifa != NULL; ifa = ifa->ifa_next) {
+                struct sockaddr_in *s4;
+                char ip[INET_ADDRSTRLEN];
+
+                if (ifa->ifa_addr == NULL ||
+                    ifa->ifa_addr->sa_family != AF_INET ||
+                    !g_str_equal (device->iface_name, ifa->ifa_name))
+                        continue;
+
+                n_addresses++;
+
+                s4 = (struct sockaddr_in *) ifa->ifa_addr;
+                if (inet_ntop (AF_INET, &s4->sin_addr, ip, sizeof (ip)) &&
+                    g_str_equal (ip, device->host_ip))
+                        ours = TRUE;
+        }
+
+        freeifaddrs (ifa_list);
+
+        return n_addresses == 1 && ours;
+}
+
 gboolean
 gssdp_net_get_host_ip (GSSDPNetworkDevice *device)
 {
@@ -105,6 +105,13 @@ gssdp_net_query_ifindex (GSSDPNetworkDevice *device)
         return -1;
 }
 
+gboolean
+gssdp_net_is_only_host_ip (GSSDPNetworkDevice *device)
+{
+        /* Nothing relies on it being known here */
+        return FALSE;
+}
+
 char *
 gssdp_net_arp_lookup (GSSDPNetworkDevice *device, const char *ip_address)
 {
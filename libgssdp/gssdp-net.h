@@ -58,6 +58,9 @@ gssdp_net_get_host_ip           (GSSDPNetworkDevice *device);
 G_GNUC_INTERNAL int
 gssdp_net_query_ifindex         (GSSDPNetworkDevice *device);
 
+G_GNUC_INTERNAL gboolean
+gssdp_net_is_only_host_ip       (GSSDPNetworkDevice *device);
+
 G_GNUC_INTERNAL char*
 gssdp_net_arp_lookup            (GSSDPNetworkDevice *device,
                                  const char *ip_address);
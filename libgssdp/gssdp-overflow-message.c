@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/*
+ * SO_RXQ_OVFL control message. The kernel attaches it to received datagrams
+ * once the socket dropped any for lack of receive buffer space, carrying the
+ * total number of drops so far.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-overflow-message.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+struct _GSSDPOverflowMessage {
+        GSocketControlMessage parent;
+
+        guint32               drops;
+};
+
+struct _GSSDPOverflowMessageClass {
+        GSocketControlMessageClass parent_class;
+};
+
+G_DEFINE_TYPE (GSSDPOverflowMessage,
+               gssdp_overflow_message,
+               G_TYPE_SOCKET_CONTROL_MESSAGE)
+
+enum {
+        PROP_0,
+        PROP_DROPS
+};
+
+static gsize
+gssdp_overflow_message_get_size (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return sizeof (guint32);
+}
+
+static int
+gssdp_overflow_message_get_level (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return SOL_SOCKET;
+}
+
+static int
+gssdp_overflow_message_get_msg_type (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return SO_RXQ_OVFL;
+}
+
+static void
+gssdp_overflow_message_serialize (GSocketControlMessage *msg,
+                                  gpointer               data)
+{
+        GSSDPOverflowMessage *self = GSSDP_OVERFLOW_MESSAGE (msg);
+
+        memcpy (data, &self->drops, sizeof (guint32));
+}
+
+static GSocketControlMessage *
+gssdp_overflow_message_deserialize (int      level,
+                                    int      type,
+                                    gsize    size,
+                                    gpointer data)
+{
+        guint32 drops;
+
+        if (level != SOL_SOCKET ||
+            type != SO_RXQ_OVFL ||
+            size < sizeof (guint32))
+                return NULL;
+
+        memcpy (&drops, data, sizeof (guint32));
+
+        return gssdp_overflow_message_new (drops);
+}
+
+static void
+gssdp_overflow_message_get_property (GObject    *object,
+                                     guint       property_id,
+                                     GValue     *value,
+                                     GParamSpec *pspec)
+{
+        GSSDPOverflowMessage *self = GSSDP_OVERFLOW_MESSAGE (object);
+
+        switch (property_id)
+        {
+        case PROP_DROPS:
+                g_value_set_uint (value, self->drops);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+                break;
+        }
+}
+
+static void
+gssdp_overflow_message_set_property (GObject      *object,
+                                     guint         property_id,
+                                     const GValue *value,
+                                     GParamSpec   *pspec)
+{
+        GSSDPOverflowMessage *self = GSSDP_OVERFLOW_MESSAGE (object);
+
+        switch (property_id)
+        {
+        case PROP_DROPS:
+                self->drops = g_value_get_uint (value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+                break;
+        }
+}
+
+static void
+gssdp_overflow_message_init (G_GNUC_UNUSED GSSDPOverflowMessage *self)
+{
+}
+
+static void
+gssdp_overflow_message_class_init (GSSDPOverflowMessageClass *klass)
+{
+        GSocketControlMessageClass *scm_class =
+                G_SOCKET_CONTROL_MESSAGE_CLASS (klass);
+
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        scm_class->get_size = gssdp_overflow_message_get_size;
+        scm_class->get_level = gssdp_overflow_message_get_level;
+        scm_class->get_type = gssdp_overflow_message_get_msg_type;
+        scm_class->serialize = gssdp_overflow_message_serialize;
+        scm_class->deserialize = gssdp_overflow_message_deserialize;
+
+        object_class->get_property = gssdp_overflow_message_get_property;
+        object_class->set_property = gssdp_overflow_message_set_property;
+
+        g_object_class_install_property
+                (object_class,
+                 PROP_DROPS,
+                 g_param_spec_uint ("drops",
+                                    "drops",
+                                    "Datagrams dropped by the socket so far",
+                                    0,
+                                    G_MAXUINT32,
+                                    0,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_CONSTRUCT |
+                                    G_PARAM_STATIC_STRINGS));
+}
+
+GSocketControlMessage *
+gssdp_overflow_message_new (guint32 drops)
+{
+        return G_SOCKET_CONTROL_MESSAGE (
+                g_object_new (GSSDP_TYPE_OVERFLOW_MESSAGE,
+                              "drops", drops,
+                              NULL));
+}
+
+guint32
+gssdp_overflow_message_get_drops (GSSDPOverflowMessage *message)
+{
+        g_return_val_if_fail (GSSDP_IS_OVERFLOW_MESSAGE (message), 0);
+
+        return message->drops;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef GSSDP_OVERFLOW_MESSAGE_H
+#define GSSDP_OVERFLOW_MESSAGE_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GSSDP_TYPE_OVERFLOW_MESSAGE (gssdp_overflow_message_get_type())
+
+G_DECLARE_FINAL_TYPE (GSSDPOverflowMessage,
+                      gssdp_overflow_message,
+                      GSSDP,
+                      OVERFLOW_MESSAGE,
+                      GSocketControlMessage)
+
+G_GNUC_INTERNAL GSocketControlMessage *
+gssdp_overflow_message_new (guint32 drops);
+
+G_GNUC_INTERNAL guint32
+gssdp_overflow_message_get_drops (GSSDPOverflowMessage *message);
+
+G_END_DECLS
+
+#endif /* GSSDP_OVERFLOW_MESSAGE_H */
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Token bucket limiting the rate at which a client sends SSDP messages.
+ *
+ * The bucket fills up at a fixed number of tokens per second, up to the burst
+ * size, and every message sent takes one token out of it. Messages that do
+ * not get a token right away are queued by priority and flushed in batches
+ * from a single GSource once enough tokens have accumulated.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-pacer.h"
+
+/* Maximum number of messages handed to the send function at once */
+#define PACER_BATCH_SIZE 64
+
+struct _GSSDPPacer {
+        GSource        source;
+
+        GSSDPPacerFunc func;
+        gpointer       user_data;
+
+        /* Tokens per second, or 0 for no limit */
+        gdouble        rate;
+        guint          burst;
+
+        gdouble        tokens;
+        gint64         last_refill;
+
+        GQueue         queues[GSSDP_PACER_N_PRIORITIES];
+        guint          n_queued;
+};
+
+static void
+pacer_item_free (GSSDPPacerItem *item)
+{
+        g_bytes_unref (item->message);
+        g_free (item->dest_ip);
+        g_slice_free (GSSDPPacerItem, item);
+}
+
+static void
+refill (GSSDPPacer *pacer)
+{
+        gint64 now;
+
+        if (pacer->rate <= 0)
+                return;
+
+        now = g_get_monotonic_time ();
+        pacer->tokens += (now - pacer->last_refill) * pacer->rate /
+                         G_USEC_PER_SEC;
+        pacer->tokens = MIN (pacer->tokens, (gdouble) pacer->burst);
+        pacer->last_refill = now;
+}
+
+static guint
+available_tokens (GSSDPPacer *pacer)
+{
+        if (pacer->rate <= 0)
+                return G_MAXUINT;
+
+        return (guint) pacer->tokens;
+}
+
+static void
+update_ready_time (GSSDPPacer *pacer)
+{
+        gint64 wait;
+
+        if (g_source_is_destroyed ((GSource *) pacer))
+                return;
+
+        if (pacer->n_queued == 0) {
+                g_source_set_ready_time ((GSource *) pacer, -1);
+
+                return;
+        }
+
+        if (available_tokens (pacer) > 0) {
+                g_source_set_ready_time ((GSource *) pacer, 0);
+
+                return;
+        }
+
+        wait = (gint64) ((1.0 - pacer->tokens) * G_USEC_PER_SEC /
+                         pacer->rate) + 1;
+        g_source_set_ready_time ((GSource *) pacer,
+                                 pacer->last_refill + wait);
+}
+
+/* Moves up to @max queued messages, highest priority first, into @items */
+static guint
+take_batch (GSSDPPacer     *pacer,
+            GSSDPPacerItem *items,
+            guint           max)
+{
+        guint i, n = 0;
+
+        max = MIN (max, PACER_BATCH_SIZE);
+
+        for (i = 0; i < GSSDP_PACER_N_PRIORITIES && n < max; i++) {
+                while (n < max && !g_queue_is_empty (&pacer->queues[i])) {
+                        GSSDPPacerItem *item;
+
+                        item = g_queue_pop_head (&pacer->queues[i]);
+                        items[n++] = *item;
+                        g_slice_free (GSSDPPacerItem, item);
+                }
+        }
+
+        pacer->n_queued -= n;
+
+        return n;
+}
+
+static void
+send_batch (GSSDPPacer     *pacer,
+            GSSDPPacerItem *items,
+            guint           n_items)
+{
+        guint i;
+
+        pacer->func (items, n_items, pacer->user_data);
+
+        for (i = 0; i < n_items; i++) {
+                g_bytes_unref (items[i].message);
+                g_free (items[i].dest_ip);
+        }
+}
+
+static gboolean
+gssdp_pacer_dispatch (GSource                  *source,
+                      G_GNUC_UNUSED GSourceFunc callback,
+                      G_GNUC_UNUSED gpointer    user_data)
+{
+        GSSDPPacer *pacer = (GSSDPPacer *) source;
+        GSSDPPacerItem items[PACER_BATCH_SIZE];
+        guint n;
+
+        refill (pacer);
+
+        while ((n = take_batch (pacer, items, available_tokens (pacer))) > 0) {
+                if (pacer->rate > 0)
+                        pacer->tokens -= n;
+
+                send_batch (pacer, items, n);
+        }
+
+        update_ready_time (pacer);
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+gssdp_pacer_finalize (GSource *source)
+{
+        GSSDPPacer *pacer = (GSSDPPacer *) source;
+        guint i;
+
+        for (i = 0; i < GSSDP_PACER_N_PRIORITIES; i++) {
+                GSSDPPacerItem *item;
+
+                while ((item = g_queue_pop_head (&pacer->queues[i])) != NULL)
+                        pacer_item_free (item);
+        }
+}
+
+static GSourceFuncs gssdp_pacer_funcs = {
+        NULL,
+        NULL,
+        gssdp_pacer_dispatch,
+        gssdp_pacer_finalize,
+        NULL,
+        NULL
+};
+
+/*
+ * gssdp_pacer_new:
+ * @func: Function sending a batch of messages
+ * @user_data: User data for @func
+ *
+ * Return value: A new #GSSDPPacer without a rate limit. Free it with
+ * gssdp_pacer_destroy().
+ */
+GSSDPPacer *
+gssdp_pacer_new (GSSDPPacerFunc func,
+                 gpointer       user_data)
+{
+        GSSDPPacer *pacer;
+        guint i;
+
+        g_return_val_if_fail (func != NULL, NULL);
+
+        pacer = (GSSDPPacer *) g_source_new (&gssdp_pacer_funcs,
+                                             sizeof (GSSDPPacer));
+        g_source_set_name ((GSource *) pacer, "GSSDPPacer");
+
+        pacer->func = func;
+        pacer->user_data = user_data;
+        pacer->rate = 0;
+        pacer->burst = 1;
+        pacer->tokens = 1;
+        pacer->last_refill = g_get_monotonic_time ();
+        pacer->n_queued = 0;
+
+        for (i = 0; i < GSSDP_PACER_N_PRIORITIES; i++)
+                g_queue_init (&pacer->queues[i]);
+
+        return pacer;
+}
+
+void
+gssdp_pacer_attach (GSSDPPacer   *pacer,
+                    GMainContext *context)
+{
+        g_source_attach ((GSource *) pacer, context);
+}
+
+/*
+ * Stops @pacer and frees it, dropping any message that is still queued. Use
+ * gssdp_pacer_flush() first to send them.
+ */
+void
+gssdp_pacer_destroy (GSSDPPacer *pacer)
+{
+        g_source_destroy ((GSource *) pacer);
+        g_source_unref ((GSource *) pacer);
+}
+
+/*
+ * Limits @pacer to @rate messages per second on average, and @burst messages
+ * at once after having been idle. A @rate of 0 disables the limit.
+ */
+void
+gssdp_pacer_set_rate (GSSDPPacer *pacer,
+                      gdouble     rate,
+                      guint       burst)
+{
+        refill (pacer);
+
+        pacer->rate = MAX (rate, 0);
+        pacer->burst = MAX (burst, 1);
+        pacer->tokens = MIN (pacer->tokens, (gdouble) pacer->burst);
+        pacer->last_refill = g_get_monotonic_time ();
+
+        update_ready_time (pacer);
+}
+
+/*
+ * Queues @message for @dest_ip, or for the SSDP multicast group if @dest_ip
+ * is %NULL. Messages queued during one main loop iteration are sent together.
+ * @owner and @id identify the message for gssdp_pacer_cancel() and
+ * gssdp_pacer_flush_owner(). @request_time is only handed back with the item.
+ */
+void
+gssdp_pacer_push (GSSDPPacer         *pacer,
+                  GSSDPPacerPriority  priority,
+                  gpointer            owner,
+                  guint               id,
+                  const char         *dest_ip,
+                  gushort             dest_port,
+                  gint64              request_time,
+                  GBytes             *message)
+{
+        GSSDPPacerItem *item;
+
+        g_return_if_fail (priority < GSSDP_PACER_N_PRIORITIES);
+        g_return_if_fail (message != NULL);
+
+        item = g_slice_new (GSSDPPacerItem);
+        item->owner = owner;
+        item->id = id;
+        item->message = g_bytes_ref (message);
+        item->dest_ip = g_strdup (dest_ip);
+        item->dest_port = dest_port;
+        item->request_time = request_time;
+
+        g_queue_push_tail (&pacer->queues[priority], item);
+        pacer->n_queued++;
+
+        refill (pacer);
+        update_ready_time (pacer);
+}
+
+/*
+ * Drops all messages of @priority queued by @owner with @id
+ */
+void
+gssdp_pacer_cancel (GSSDPPacer         *pacer,
+                    GSSDPPacerPriority  priority,
+                    gpointer            owner,
+                    guint               id)
+{
+        GQueue *queue;
+        GList *l;
+
+        g_return_if_fail (priority < GSSDP_PACER_N_PRIORITIES);
+
+        queue = &pacer->queues[priority];
+        l = queue->head;
+        while (l != NULL) {
+                GSSDPPacerItem *item = l->data;
+                GList *next = l->next;
+
+                if (item->owner == owner && item->id == id) {
+                        g_queue_delete_link (queue, l);
+                        pacer_item_free (item);
+                        pacer->n_queued--;
+                }
+
+                l = next;
+        }
+
+        update_ready_time (pacer);
+}
+
+/*
+ * Takes a token for a message of @priority that the caller is going to send
+ * right away, so it does not need to be copied into the queue. This fails if
+ * the bucket is empty or a message of the same or a higher priority is
+ * already waiting.
+ */
+gboolean
+gssdp_pacer_try_take (GSSDPPacer         *pacer,
+                      GSSDPPacerPriority  priority)
+{
+        guint i;
+
+        for (i = 0; i <= priority && i < GSSDP_PACER_N_PRIORITIES; i++)
+                if (!g_queue_is_empty (&pacer->queues[i]))
+                        return FALSE;
+
+        if (pacer->rate <= 0)
+                return TRUE;
+
+        refill (pacer);
+        if (pacer->tokens < 1)
+                return FALSE;
+
+        pacer->tokens -= 1;
+
+        return TRUE;
+}
+
+/*
+ * Sends all queued messages right now, regardless of the rate limit
+ */
+void
+gssdp_pacer_flush (GSSDPPacer *pacer)
+{
+        GSSDPPacerItem items[PACER_BATCH_SIZE];
+        guint n;
+
+        while ((n = take_batch (pacer, items, G_MAXUINT)) > 0)
+                send_batch (pacer, items, n);
+
+        update_ready_time (pacer);
+}
+
+/*
+ * Sends all messages queued by @owner right now, regardless of the rate limit,
+ * so none are left behind once @owner goes away
+ */
+void
+gssdp_pacer_flush_owner (GSSDPPacer *pacer,
+                         gpointer    owner)
+{
+        GSSDPPacerItem items[PACER_BATCH_SIZE];
+        guint i, n = 0;
+
+        for (i = 0; i < GSSDP_PACER_N_PRIORITIES; i++) {
+                GQueue *queue = &pacer->queues[i];
+                GList *l = queue->head;
+
+                while (l != NULL) {
+                        GSSDPPacerItem *item = l->data;
+                        GList *next = l->next;
+
+                        if (item->owner == owner) {
+                                g_queue_delete_link (queue, l);
+                                items[n++] = *item;
+                                g_slice_free (GSSDPPacerItem, item);
+                                pacer->n_queued--;
+
+                                if (n == PACER_BATCH_SIZE) {
+                                        send_batch (pacer, items, n);
+                                        n = 0;
+                                }
+                        }
+
+                        l = next;
+                }
+        }
+
+        if (n > 0)
+                send_batch (pacer, items, n);
+
+        update_ready_time (pacer);
+}
+
+guint
+gssdp_pacer_get_n_queued (GSSDPPacer *pacer)
+{
+        return pacer->n_queued;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_PACER_H
+#define GSSDP_PACER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GSSDPPacer GSSDPPacer;
+
+/* Queued messages of a higher priority always go out first */
+typedef enum {
+        GSSDP_PACER_PRIORITY_RESPONSE,
+        GSSDP_PACER_PRIORITY_BYEBYE,
+        GSSDP_PACER_PRIORITY_ALIVE,
+        GSSDP_PACER_N_PRIORITIES
+} GSSDPPacerPriority;
+
+typedef struct {
+        /* Whoever queued the message, and what it is about. Ids rather than
+         * pointers, as the pointers might be reused once freed. */
+        gpointer owner;
+        guint    id;
+
+        GBytes  *message;
+        char    *dest_ip;
+        gushort  dest_port;
+
+        /* Receipt time of the request this responds to, or 0 */
+        gint64   request_time;
+} GSSDPPacerItem;
+
+typedef void (* GSSDPPacerFunc) (GSSDPPacerItem *items,
+                                 guint           n_items,
+                                 gpointer        user_data);
+
+G_GNUC_INTERNAL GSSDPPacer *
+gssdp_pacer_new      (GSSDPPacerFunc      func,
+                      gpointer            user_data);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_attach   (GSSDPPacer         *pacer,
+                      GMainContext       *context);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_destroy  (GSSDPPacer         *pacer);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_set_rate (GSSDPPacer         *pacer,
+                      gdouble             rate,
+                      guint               burst);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_push     (GSSDPPacer         *pacer,
+                      GSSDPPacerPriority  priority,
+                      gpointer            owner,
+                      guint               id,
+                      const char         *dest_ip,
+                      gushort             dest_port,
+                      gint64              request_time,
+                      GBytes             *message);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_cancel   (GSSDPPacer         *pacer,
+                      GSSDPPacerPriority  priority,
+                      gpointer            owner,
+                      guint               id);
+
+G_GNUC_INTERNAL gboolean
+gssdp_pacer_try_take (GSSDPPacer         *pacer,
+                      GSSDPPacerPriority  priority);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_flush    (GSSDPPacer         *pacer);
+
+G_GNUC_INTERNAL void
+gssdp_pacer_flush_owner (GSSDPPacer      *pacer,
+                         gpointer         owner);
+
+G_GNUC_INTERNAL guint
+gssdp_pacer_get_n_queued (GSSDPPacer     *pacer);
+
+G_END_DECLS
+
+#endif /* GSSDP_PACER_H */
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Minimal HTTPU parser for SSDP datagrams.
+ *
+ * The parser works in place on the receive buffer: header names and values
+ * are NUL-terminated where they are and the parser only records pointers to
+ * them, so parsing a packet does not allocate anything.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-parser.h"
+#include "gssdp-client-private.h"
+#include "gssdp-protocol.h"
+
+#include <string.h>
+
+#define HTTP_VERSION_PREFIX "HTTP/1."
+
+/* Returns the position of the next CR or LF, or @end */
+static char *
+find_eol (char *p, char *end)
+{
+        while (p < end && *p != '\r' && *p != '\n')
+                p++;
+
+        return p;
+}
+
+/* Skips a single CRLF or LF at @p */
+static char *
+skip_eol (char *p, char *end)
+{
+        if (p < end && *p == '\r')
+                p++;
+        if (p < end && *p == '\n')
+                p++;
+
+        return p;
+}
+
+static gboolean
+is_space (char c)
+{
+        return c == ' ' || c == '\t';
+}
+
+static gboolean
+token_equal (const char *token, gsize len, const char *expected)
+{
+        return strlen (expected) == len &&
+               g_ascii_strncasecmp (token, expected, len) == 0;
+}
+
+static int
+parse_start_line (char *line, gsize len)
+{
+        const gsize prefix_len = strlen (HTTP_VERSION_PREFIX);
+        char *p, *end = line + len;
+        char *method, *path, *version;
+        gsize method_len;
+
+        if (len > prefix_len &&
+            strncmp (line, HTTP_VERSION_PREFIX, prefix_len) == 0) {
+                /* Status line: HTTP/1.x 200 OK */
+                p = line + prefix_len;
+                if (!g_ascii_isdigit (*p))
+                        return -1;
+                p++;
+
+                if (p >= end || !is_space (*p))
+                        return -1;
+                while (p < end && is_space (*p))
+                        p++;
+
+                if (end - p < 3 || strncmp (p, "200", 3) != 0)
+                        return -1;
+                p += 3;
+
+                if (p < end && !is_space (*p))
+                        return -1;
+
+                return _GSSDP_DISCOVERY_RESPONSE;
+        }
+
+        /* Request line: METHOD * HTTP/1.1 */
+        method = line;
+        for (p = line; p < end && !is_space (*p); p++);
+        method_len = p - method;
+
+        while (p < end && is_space (*p))
+                p++;
+        path = p;
+        for (; p < end && !is_space (*p); p++);
+
+        if (path == p || *path != '*')
+                return -1;
+
+        while (p < end && is_space (*p))
+                p++;
+        version = p;
+
+        /* We need at least HTTP/1.1 */
+        if ((gsize) (end - version) != prefix_len + 1 ||
+            strncmp (version, HTTP_VERSION_PREFIX, prefix_len) != 0 ||
+            version[prefix_len] < '1' ||
+            version[prefix_len] > '9')
+                return -1;
+
+        if (token_equal (method, method_len, SSDP_SEARCH_METHOD))
+                return _GSSDP_DISCOVERY_REQUEST;
+        else if (token_equal (method, method_len, GENA_NOTIFY_METHOD))
+                return _GSSDP_ANNOUNCEMENT;
+
+        return -1;
+}
+
+/*
+ * gssdp_parser_parse:
+ * @parser: The #GSSDPParser to fill
+ * @buf: The datagram. It is modified in place and needs to stay alive as long
+ * as the header pointers in @parser are used.
+ * @len: Length of @buf. @buf needs to have room for one more byte.
+ *
+ * Classifies the start line of @buf and collects its header fields.
+ *
+ * Return value: %TRUE if @buf contained a complete header block with a start
+ * line of a known SSDP message type.
+ */
+gboolean
+gssdp_parser_parse (GSSDPParser *parser,
+                    char        *buf,
+                    gsize        len)
+{
+        char *p, *end, *line_end;
+
+        parser->type = -1;
+        parser->length = 0;
+        parser->n_headers = 0;
+
+        end = buf + len;
+
+        line_end = find_eol (buf, end);
+        if (line_end == end)
+                return FALSE;
+
+        parser->type = parse_start_line (buf, line_end - buf);
+        if (parser->type < 0)
+                return FALSE;
+
+        p = skip_eol (line_end, end);
+
+        while (p < end) {
+                char *name, *name_end, *value, *value_end;
+
+                line_end = find_eol (p, end);
+
+                /* Empty line, end of header block */
+                if (line_end == p) {
+                        if (p == end)
+                                break;
+
+                        parser->length = skip_eol (p, end) - buf;
+
+                        return TRUE;
+                }
+
+                name = p;
+                for (name_end = name;
+                     name_end < line_end && *name_end != ':';
+                     name_end++);
+
+                /* Fold continuation lines into this one by blanking out the
+                 * line break, that way the value stays contiguous */
+                p = skip_eol (line_end, end);
+                while (p < end && is_space (*p)) {
+                        memset (line_end, ' ', p - line_end);
+                        line_end = find_eol (p, end);
+                        p = skip_eol (line_end, end);
+                }
+
+                /* Lines without a colon are ignored */
+                if (name_end == line_end)
+                        continue;
+
+                value = name_end + 1;
+                while (value < line_end && is_space (*value))
+                        value++;
+
+                value_end = line_end;
+                while (value_end > value && is_space (*(value_end - 1)))
+                        value_end--;
+
+                while (name_end > name && is_space (*(name_end - 1)))
+                        name_end--;
+
+                if (name_end == name)
+                        continue;
+
+                if (parser->n_headers == GSSDP_PARSER_MAX_HEADERS)
+                        continue;
+
+                *name_end = '\0';
+                *value_end = '\0';
+
+                parser->headers[parser->n_headers].name = name;
+                parser->headers[parser->n_headers].value = value;
+                parser->n_headers++;
+        }
+
+        /* No terminating empty line */
+        return FALSE;
+}
+
+/*
+ * gssdp_parser_get_header:
+ * @parser: A #GSSDPParser filled by gssdp_parser_parse()
+ * @name: The header to look for, compared case-insensitively
+ *
+ * Return value: The value of the first header called @name or %NULL
+ */
+const char *
+gssdp_parser_get_header (const GSSDPParser *parser,
+                         const char        *name)
+{
+        guint i;
+
+        for (i = 0; i < parser->n_headers; i++) {
+                if (g_ascii_strcasecmp (parser->headers[i].name, name) == 0)
+                        return parser->headers[i].value;
+        }
+
+        return NULL;
+}
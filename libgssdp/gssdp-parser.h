@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_PARSER_H
+#define GSSDP_PARSER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* SSDP messages carry about ten headers; anything beyond this is ignored */
+#define GSSDP_PARSER_MAX_HEADERS 32
+
+typedef struct {
+        const char *name;
+        const char *value;
+} GSSDPParserHeader;
+
+typedef struct {
+        /* One of _GSSDPMessageType or -1 if the start line was not
+         * recognized */
+        int               type;
+
+        /* Length of the header block, including the terminating empty
+         * line */
+        gsize             length;
+
+        GSSDPParserHeader headers[GSSDP_PARSER_MAX_HEADERS];
+        guint             n_headers;
+} GSSDPParser;
+
+G_GNUC_INTERNAL gboolean
+gssdp_parser_parse      (GSSDPParser *parser,
+                         char        *buf,
+                         gsize        len);
+
+G_GNUC_INTERNAL const char *
+gssdp_parser_get_header (const GSSDPParser *parser,
+                         const char        *name);
+
+G_END_DECLS
+
+#endif /* GSSDP_PARSER_H */
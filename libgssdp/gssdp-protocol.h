@@ -36,16 +36,32 @@ G_BEGIN_DECLS
         "MX: %d\r\n"                                \
         "User-Agent: %s GSSDP/" VERSION "\r\n"  \
 
-#define SSDP_DISCOVERY_RESPONSE                     \
+/* A discovery response is sent as
+ *   SSDP_DISCOVERY_RESPONSE_HEAD, USN,
+ *   SSDP_DISCOVERY_RESPONSE_MIDDLE, ST,
+ *   SSDP_DISCOVERY_RESPONSE_DATE, date,
+ *   SSDP_DISCOVERY_RESPONSE_TAIL
+ * so that the parts that differ from one request to the next do not require
+ * re-rendering the whole message. */
+#define SSDP_DISCOVERY_RESPONSE_HEAD                \
         "HTTP/1.1 200 OK\r\n"                       \
         "Location: %s\r\n"                          \
         "%s"                                        \
         "Ext:\r\n"                                  \
-        "USN: %s\r\n"                               \
+        "USN: "
+
+#define SSDP_DISCOVERY_RESPONSE_MIDDLE              \
+        "\r\n"                                      \
         "Server: %s\r\n"                            \
         "Cache-Control: max-age=%d\r\n"             \
-        "ST: %s\r\n"                                \
-        "Date: %s\r\n"                              \
+        "ST: "
+
+#define SSDP_DISCOVERY_RESPONSE_DATE                \
+        "\r\n"                                      \
+        "Date: "
+
+#define SSDP_DISCOVERY_RESPONSE_TAIL                \
+        "\r\n"                                      \
         "Content-Length: 0\r\n"
 
 #define SSDP_ALIVE_MESSAGE                          \
@@ -36,6 +36,9 @@
 
 #include "gssdp-resource-browser.h"
 #include "gssdp-client-private.h"
+#include "gssdp-message.h"
+#include "gssdp-timer-wheel.h"
+#include "gssdp-target.h"
 #include "gssdp-protocol.h"
 
 #include <libsoup/soup.h>
@@ -47,17 +50,22 @@
 #define MAX_DISCOVERY_MESSAGES 3
 #define DISCOVERY_FREQUENCY    500 /* 500 ms */
 
+/* Resource expiry has a resolution of one second, like the
+ * g_timeout_source_new_seconds() sources it replaces */
+#define EXPIRY_TICK  1000 /* 1 second */
+#define EXPIRY_SLOTS 256
+
 struct _GSSDPResourceBrowserPrivate {
         GSSDPClient *client;
 
         char        *target;
-        GRegex      *target_regex;
+        GSSDPTarget  target_matcher;
 
         gushort      mx;
 
         gboolean     active;
 
-        gulong       message_received_id;
+        guint        message_handler_id;
 
         GHashTable  *resources;
                         
@@ -67,6 +75,14 @@ struct _GSSDPResourceBrowserPrivate {
 
         GSource     *refresh_cache_src;
         GHashTable  *fresh_resources;
+
+        GSSDPTimerWheel *expiry_wheel;
+
+        /* See gssdp_resource_browser_get_statistics() */
+        guint64      resources_added;
+        guint64      resources_updated;
+        guint64      resources_removed;
+        guint64      discovery_requests;
 };
 typedef struct _GSSDPResourceBrowserPrivate GSSDPResourceBrowserPrivate;
 
@@ -93,7 +109,7 @@ static guint signals[LAST_SIGNAL];
 typedef struct {
         GSSDPResourceBrowser *resource_browser;
         char                 *usn;
-        GSource              *timeout_src;
+        GSSDPTimer            expiry;
         GList                *locations;
 } Resource;
 
@@ -102,11 +118,8 @@ static void
 gssdp_resource_browser_set_client (GSSDPResourceBrowser *resource_browser,
                                    GSSDPClient          *client);
 static void
-message_received_cb              (GSSDPClient          *client,
-                                  const char           *from_ip,
-                                  gushort               from_port,
-                                  _GSSDPMessageType     type,
-                                  SoupMessageHeaders   *headers,
+message_handler                  (GSSDPClient          *client,
+                                  GSSDPMessage         *message,
                                   gpointer              user_data);
 static void
 resource_free                    (Resource             *data);
@@ -124,7 +137,7 @@ static gboolean
 refresh_cache                    (gpointer data);
 static void
 resource_unavailable             (GSSDPResourceBrowser *resource_browser,
-                                  SoupMessageHeaders   *headers);
+                                  GSSDPMessage         *message);
 
 static void
 gssdp_resource_browser_init (GSSDPResourceBrowser *resource_browser)
@@ -221,12 +234,11 @@ gssdp_resource_browser_dispose (GObject *object)
         priv = gssdp_resource_browser_get_instance_private (resource_browser);
 
         if (priv->client) {
-                if (g_signal_handler_is_connected
-                        (priv->client,
-                         priv->message_received_id)) {
-                        g_signal_handler_disconnect
+                if (priv->message_handler_id != 0) {
+                        _gssdp_client_remove_handler
                                 (priv->client,
-                                 priv->message_received_id);
+                                 priv->message_handler_id);
+                        priv->message_handler_id = 0;
                 }
 
                 stop_discovery (resource_browser);
@@ -237,6 +249,8 @@ gssdp_resource_browser_dispose (GObject *object)
 
         clear_cache (resource_browser);
 
+        g_clear_pointer (&priv->expiry_wheel, gssdp_timer_wheel_destroy);
+
         G_OBJECT_CLASS (gssdp_resource_browser_parent_class)->dispose (object);
 }
 
@@ -249,8 +263,7 @@ gssdp_resource_browser_finalize (GObject *object)
         resource_browser = GSSDP_RESOURCE_BROWSER (object);
         priv = gssdp_resource_browser_get_instance_private (resource_browser);
 
-        if (priv->target_regex)
-                g_regex_unref (priv->target_regex);
+        gssdp_target_clear (&priv->target_matcher);
 
         g_free (priv->target);
 
@@ -434,13 +447,6 @@ gssdp_resource_browser_set_client (GSSDPResourceBrowser *resource_browser,
 
         priv->client = g_object_ref (client);
 
-        priv->message_received_id =
-                g_signal_connect_object (priv->client,
-                                         "message-received",
-                                         G_CALLBACK (message_received_cb),
-                                         resource_browser,
-                                         0);
-
         g_object_notify (G_OBJECT (resource_browser), "client");
 }
 
@@ -474,10 +480,6 @@ void
 gssdp_resource_browser_set_target (GSSDPResourceBrowser *resource_browser,
                                    const char           *target)
 {
-        char *pattern;
-        char *version;
-        const char *version_pattern;
-        GError *error;
         GSSDPResourceBrowserPrivate *priv;
 
         g_return_if_fail (GSSDP_IS_RESOURCE_BROWSER (resource_browser));
@@ -489,40 +491,10 @@ gssdp_resource_browser_set_target (GSSDPResourceBrowser *resource_browser,
         g_free (priv->target);
         priv->target = g_strdup (target);
 
-        if (priv->target_regex)
-                g_regex_unref (priv->target_regex);
-
-        version_pattern = "([0-9]+)";
-        /* Make sure we have enough room for version pattern */
-        pattern = g_strndup (target,
-                             strlen (target) + strlen (version_pattern));
-
-        version = g_strrstr (pattern, ":");
-        if (version != NULL &&
-            (g_strstr_len (pattern, -1, "uuid:") != pattern ||
-             version != g_strstr_len (pattern, -1, ":")) &&
-            g_regex_match_simple (version_pattern,
-                                  version + 1,
-                                  G_REGEX_ANCHORED,
-                                  G_REGEX_MATCH_ANCHORED)) {
-                priv->version = atoi (version + 1);
-                strcpy (version + 1, version_pattern);
-        }
-
-        error = NULL;
-        priv->target_regex = g_regex_new (pattern,
-                                                            0,
-                                                            0,
-                                                            &error);
-        if (error) {
-                g_warning ("Error compiling regular expression '%s': %s",
-                           pattern,
-                           error->message);
-
-                g_error_free (error);
-        }
+        gssdp_target_clear (&priv->target_matcher);
+        gssdp_target_init (&priv->target_matcher, target);
+        priv->version = priv->target_matcher.version;
 
-        g_free (pattern);
         g_object_notify (G_OBJECT (resource_browser), "target");
 }
 
@@ -608,8 +580,19 @@ gssdp_resource_browser_set_active (GSSDPResourceBrowser *resource_browser,
         priv->active = active;
 
         if (active) {
+                /* Only messages matching our target are passed on to us */
+                priv->message_handler_id =
+                        _gssdp_client_add_target_handler (priv->client,
+                                                          priv->target,
+                                                          message_handler,
+                                                          resource_browser);
+
                 start_discovery (resource_browser);
         } else {
+                _gssdp_client_remove_handler (priv->client,
+                                              priv->message_handler_id);
+                priv->message_handler_id = 0;
+
                 stop_discovery (resource_browser);
 
                 clear_cache (resource_browser);
@@ -664,10 +647,65 @@ gssdp_resource_browser_rescan (GSSDPResourceBrowser *resource_browser)
         return FALSE;
 }
 
+/**
+ * gssdp_resource_browser_get_statistics:
+ * @resource_browser: A #GSSDPResourceBrowser
+ *
+ * Get a snapshot of the counters @resource_browser keeps, as a dictionary of
+ * unsigned 64 bit integers. The keys are:
+ *
+ * <itemizedlist>
+ * <listitem><para>resources: Resources currently cached.</para></listitem>
+ * <listitem><para>resources-added: Resources that became
+ * available.</para></listitem>
+ * <listitem><para>resources-updated: Announcements and responses for
+ * resources that were cached already.</para></listitem>
+ * <listitem><para>resources-removed: Resources that went away, expired or
+ * were dropped from the cache otherwise.</para></listitem>
+ * <listitem><para>discovery-requests: Discovery requests
+ * sent.</para></listitem>
+ * </itemizedlist>
+ *
+ * More keys may be added in the future.
+ *
+ * Return value: (transfer full): A #GVariant of type a{sv}. Free with
+ * g_variant_unref().
+ **/
+GVariant *
+gssdp_resource_browser_get_statistics (GSSDPResourceBrowser *resource_browser)
+{
+        GSSDPResourceBrowserPrivate *priv;
+        GVariantBuilder builder;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_BROWSER (resource_browser),
+                              NULL);
+
+        priv = gssdp_resource_browser_get_instance_private (resource_browser);
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+        _gssdp_add_statistic (&builder,
+                              "resources",
+                              g_hash_table_size (priv->resources));
+        _gssdp_add_statistic (&builder,
+                              "resources-added",
+                              priv->resources_added);
+        _gssdp_add_statistic (&builder,
+                              "resources-updated",
+                              priv->resources_updated);
+        _gssdp_add_statistic (&builder,
+                              "resources-removed",
+                              priv->resources_removed);
+        _gssdp_add_statistic (&builder,
+                              "discovery-requests",
+                              priv->discovery_requests);
+
+        return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 /*
  * Resource expired: Remove
  */
-static gboolean
+static void
 resource_expire (gpointer user_data)
 {
         GSSDPResourceBrowser *resource_browser;
@@ -703,17 +741,16 @@ resource_expire (gpointer user_data)
                        usn);
         g_free (usn);
         g_free (canonical_usn);
-
-        return FALSE;
 }
 
 static void
 resource_available (GSSDPResourceBrowser *resource_browser,
-                    SoupMessageHeaders   *headers)
+                    GSSDPMessage         *message)
 {
         GSSDPResourceBrowserPrivate *priv;
         const char *usn;
         const char *header;
+        GSSDPDiagnostics *diagnostics;
         Resource *resource;
         gboolean was_cached;
         guint timeout;
@@ -723,7 +760,7 @@ resource_available (GSSDPResourceBrowser *resource_browser,
         char *canonical_usn;
 
         priv = gssdp_resource_browser_get_instance_private (resource_browser);
-        usn = soup_message_headers_get_one (headers, "USN");
+        usn = message->usn;
         if (!usn)
                 return; /* No USN specified */
 
@@ -731,11 +768,11 @@ resource_available (GSSDPResourceBrowser *resource_browser,
         locations = NULL;
         destroyLocations = TRUE;
 
-        header = soup_message_headers_get_one (headers, "Location");
-        if (header)
-                locations = g_list_append (locations, g_strdup (header));
+        if (message->location)
+                locations = g_list_append (locations,
+                                           g_strdup (message->location));
 
-        header = soup_message_headers_get_one (headers, "AL");
+        header = message->al;
         if (header) {
                 /* Parse AL header. The format is:
                  * <uri1><uri2>... */
@@ -788,7 +825,7 @@ resource_available (GSSDPResourceBrowser *resource_browser,
                      it1 = it1->next, it2 = it2->next) {
                         if (strcmp ((const char *) it1->data,
                                     (const char *) it2->data) != 0) {
-                               resource_unavailable (resource_browser, headers);
+                               resource_unavailable (resource_browser, message);
                                /* Will be destroyed by resource_unavailable */
                                resource = NULL;
 
@@ -798,10 +835,8 @@ resource_available (GSSDPResourceBrowser *resource_browser,
         }
 
         if (resource) {
-                /* Remove old timeout */
-                g_source_destroy (resource->timeout_src);
-
                 was_cached = TRUE;
+                priv->resources_updated++;
         } else {
                 /* Create new Resource data structure */
                 resource = g_slice_new (Resource);
@@ -809,6 +844,7 @@ resource_available (GSSDPResourceBrowser *resource_browser,
                 resource->resource_browser = resource_browser;
                 resource->usn              = g_strdup (usn);
                 resource->locations        = locations;
+                gssdp_timer_init (&resource->expiry, resource_expire, resource);
                 destroyLocations = FALSE; /* Ownership passed to resource */
                 
                 g_hash_table_insert (priv->resources,
@@ -816,6 +852,7 @@ resource_available (GSSDPResourceBrowser *resource_browser,
                                      resource);
                 
                 was_cached = FALSE;
+                priv->resources_added++;
 
                 /* hash-table takes ownership of this */
                 canonical_usn = NULL;
@@ -825,38 +862,27 @@ resource_available (GSSDPResourceBrowser *resource_browser,
                 g_free (canonical_usn);
 
         /* Calculate new timeout */
-        header = soup_message_headers_get_one (headers, "Cache-Control");
+        diagnostics = _gssdp_client_get_diagnostics (priv->client);
+        header = message->cache_control;
         if (header) {
-                GSList *list;
-                int res;
-
-                res = 0;
-
-                for (list = soup_header_parse_list (header);
-                     list;
-                     list = list->next) {
-                        res = sscanf (list->data,
-                                      "max-age = %d",
-                                      &timeout);
-                        if (res == 1)
-                                break;
-                }
-
-                if (res != 1) {
-                        g_warning ("Invalid 'Cache-Control' header. Assuming "
-                                   "default max-age of %d.\n"
-                                   "Header was:\n%s",
-                                   SSDP_DEFAULT_MAX_AGE,
-                                   header);
+                if (message->max_age >= 0) {
+                        timeout = message->max_age;
+                } else {
+                        gssdp_diagnostic
+                                (diagnostics,
+                                 GSSDP_DIAGNOSTIC_INVALID_CACHE_CONTROL,
+                                 message->from_ip,
+                                 header,
+                                 "Invalid 'Cache-Control' header. Assuming "
+                                 "default max-age of %d.",
+                                 SSDP_DEFAULT_MAX_AGE);
 
                         timeout = SSDP_DEFAULT_MAX_AGE;
                 }
-
-                soup_header_free_list (list);
         } else {
                 const char *expires;
 
-                expires = soup_message_headers_get_one (headers, "Expires");
+                expires = _gssdp_message_get_header (message, "Expires");
                 if (expires) {
                         SoupDate *soup_exp_time;
                         time_t exp_time, cur_time;
@@ -870,36 +896,52 @@ resource_available (GSSDPResourceBrowser *resource_browser,
                         if (exp_time > cur_time)
                                 timeout = exp_time - cur_time;
                         else {
-                                g_warning ("Invalid 'Expires' header. Assuming "
-                                           "default max-age of %d.\n"
-                                           "Header was:\n%s",
-                                           SSDP_DEFAULT_MAX_AGE,
-                                           expires);
+                                gssdp_diagnostic
+                                        (diagnostics,
+                                         GSSDP_DIAGNOSTIC_INVALID_EXPIRES,
+                                         message->from_ip,
+                                         expires,
+                                         "Invalid 'Expires' header. Assuming "
+                                         "default max-age of %d.",
+                                         SSDP_DEFAULT_MAX_AGE);
 
                                 timeout = SSDP_DEFAULT_MAX_AGE;
                         }
                 } else {
-                        g_warning ("No 'Cache-Control' nor any 'Expires' "
-                                   "header was specified. Assuming default "
-                                   "max-age of %d.", SSDP_DEFAULT_MAX_AGE);
+                        gssdp_diagnostic (diagnostics,
+                                          GSSDP_DIAGNOSTIC_MISSING_EXPIRY,
+                                          message->from_ip,
+                                          NULL,
+                                          "No 'Cache-Control' nor any "
+                                          "'Expires' header was specified. "
+                                          "Assuming default max-age of %d.",
+                                          SSDP_DEFAULT_MAX_AGE);
 
                         timeout = SSDP_DEFAULT_MAX_AGE;
                 }
         }
 
-        resource->timeout_src = g_timeout_source_new_seconds (timeout);
-        g_source_set_callback (resource->timeout_src,
-                               resource_expire,
-                               resource, NULL);
-
-        g_source_attach (resource->timeout_src,
-                         g_main_context_get_thread_default ());
+        /* All resources share one expiry source, refreshing a resource only
+         * moves its timer to another slot */
+        if (priv->expiry_wheel == NULL) {
+                priv->expiry_wheel = gssdp_timer_wheel_new (EXPIRY_TICK,
+                                                            EXPIRY_SLOTS);
+                gssdp_timer_wheel_attach (priv->expiry_wheel,
+                                          g_main_context_get_thread_default ());
+        }
 
-        g_source_unref (resource->timeout_src);
+        gssdp_timer_wheel_schedule (priv->expiry_wheel,
+                                    &resource->expiry,
+                                    MIN (timeout, G_MAXUINT / 1000) * 1000);
 
         /* Only continue with signal emission if this resource was not
          * cached already */
         if (!was_cached) {
+                _gssdp_client_record_latency
+                                (priv->client,
+                                 GSSDP_LATENCY_RECEIVE_TO_AVAILABLE,
+                                 message->received);
+
                 /* Emit signal */
                 g_signal_emit (resource_browser,
                                signals[RESOURCE_AVAILABLE],
@@ -914,14 +956,14 @@ resource_available (GSSDPResourceBrowser *resource_browser,
 
 static void
 resource_unavailable (GSSDPResourceBrowser *resource_browser,
-                      SoupMessageHeaders   *headers)
+                      GSSDPMessage         *message)
 {
         GSSDPResourceBrowserPrivate *priv;
         const char *usn;
         char *canonical_usn;
 
         priv = gssdp_resource_browser_get_instance_private (resource_browser);
-        usn = soup_message_headers_get_one (headers, "USN");
+        usn = message->usn;
         if (!usn)
                 return; /* No USN specified */
 
@@ -956,9 +998,7 @@ check_target_compat (GSSDPResourceBrowser *resource_browser,
                      const char           *st)
 {
         GSSDPResourceBrowserPrivate *priv;
-        GMatchInfo *info;
-        int         version;
-        char       *tmp;
+        guint version;
 
         priv = gssdp_resource_browser_get_instance_private (resource_browser);
 
@@ -966,93 +1006,50 @@ check_target_compat (GSSDPResourceBrowser *resource_browser,
                     GSSDP_ALL_RESOURCES) == 0)
                 return TRUE;
 
-        if (!g_regex_match (priv->target_regex,
-                            st,
-                            0,
-                            &info)) {
-                g_match_info_free (info);
-
+        if (!gssdp_target_match (&priv->target_matcher, st, &version))
                 return FALSE;
-        }
-
-        /* If there was no version to match, we're done */
-        if (priv->version == 0) {
-                g_match_info_free (info);
-
-                return TRUE;
-        }
 
-        if (g_match_info_get_match_count (info) != 2) {
-                g_match_info_free (info);
-
-                return FALSE;
-        }
-
-        version = atoi ((tmp = g_match_info_fetch (info, 1)));
-        g_free (tmp);
-        g_match_info_free (info);
-
-        if (version < 0) {
-            return FALSE;
-        }
-
-        return (guint) version >= priv->version;
+        /* Newer versions of a type are backwards compatible */
+        return version >= priv->version;
 }
 
 static void
 received_discovery_response (GSSDPResourceBrowser *resource_browser,
-                             SoupMessageHeaders   *headers)
+                             GSSDPMessage         *message)
 {
-        const char *st;
-
-        st = soup_message_headers_get_one (headers, "ST");
-        if (!st)
+        if (!message->st)
                 return; /* No target specified */
 
-        if (!check_target_compat (resource_browser, st))
+        if (!check_target_compat (resource_browser, message->st))
                 return; /* Target doesn't match */
 
-        resource_available (resource_browser, headers);
+        resource_available (resource_browser, message);
 }
 
 static void
 received_announcement (GSSDPResourceBrowser *resource_browser,
-                       SoupMessageHeaders   *headers)
+                       GSSDPMessage         *message)
 {
-        const char *header;
-
-        header = soup_message_headers_get_one (headers, "NT");
-        if (!header)
+        if (!message->nt)
                 return; /* No target specified */
 
-        if (!check_target_compat (resource_browser, header))
+        if (!check_target_compat (resource_browser, message->nt))
                 return; /* Target doesn't match */
 
-        header = soup_message_headers_get_one (headers, "NTS");
-        if (!header)
-                return; /* No announcement type specified */
-
         /* Check announcement type */
-        if      (strncmp (header,
-                          SSDP_ALIVE_NTS,
-                          strlen (SSDP_ALIVE_NTS)) == 0)
-                resource_available (resource_browser, headers);
-        else if (strncmp (header,
-                          SSDP_BYEBYE_NTS,
-                          strlen (SSDP_BYEBYE_NTS)) == 0)
-                resource_unavailable (resource_browser, headers);
+        if (message->nts == _GSSDP_NTS_ALIVE)
+                resource_available (resource_browser, message);
+        else if (message->nts == _GSSDP_NTS_BYEBYE)
+                resource_unavailable (resource_browser, message);
 }
 
 /*
  * Received a message
  */
 static void
-message_received_cb (G_GNUC_UNUSED GSSDPClient *client,
-                     G_GNUC_UNUSED const char  *from_ip,
-                     G_GNUC_UNUSED gushort      from_port,
-                     _GSSDPMessageType          type,
-                     SoupMessageHeaders        *headers,
-                     gpointer                   user_data)
+message_handler (G_GNUC_UNUSED GSSDPClient *client,
+                 GSSDPMessage              *message,
+                 gpointer                   user_data)
 {
         GSSDPResourceBrowser *resource_browser;
         GSSDPResourceBrowserPrivate *priv;
@@ -1063,12 +1060,12 @@ message_received_cb (G_GNUC_UNUSED GSSDPClient *client,
         if (!priv->active)
                 return;
 
-        switch (type) {
+        switch (message->type) {
         case _GSSDP_DISCOVERY_RESPONSE:
-                received_discovery_response (resource_browser, headers);
+                received_discovery_response (resource_browser, message);
                 break;
         case _GSSDP_ANNOUNCEMENT:
-                received_announcement (resource_browser, headers);
+                received_announcement (resource_browser, message);
                 break;
         case _GSSDP_DISCOVERY_REQUEST:
                 /* Should not happend */
@@ -1084,8 +1081,18 @@ message_received_cb (G_GNUC_UNUSED GSSDPClient *client,
 static void
 resource_free (Resource *resource)
 {
+        GSSDPResourceBrowserPrivate *priv;
+
+        priv = gssdp_resource_browser_get_instance_private
+                                        (resource->resource_browser);
+
+        if (gssdp_timer_is_pending (&resource->expiry))
+                gssdp_timer_wheel_cancel (priv->expiry_wheel,
+                                          &resource->expiry);
+
+        priv->resources_removed++;
+
         g_free (resource->usn);
-        g_source_destroy (resource->timeout_src);
         g_list_free_full (resource->locations, g_free);
         g_slice_free (Resource, resource);
 }
@@ -1140,6 +1147,7 @@ send_discovery_request (GSSDPResourceBrowser *resource_browser)
                                     0,
                                     message,
                                     _GSSDP_DISCOVERY_REQUEST);
+        priv->discovery_requests++;
 
         g_free (message);
 }
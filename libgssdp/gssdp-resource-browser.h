@@ -92,6 +92,10 @@ gssdp_resource_browser_get_active (GSSDPResourceBrowser *resource_browser);
 gboolean
 gssdp_resource_browser_rescan     (GSSDPResourceBrowser *resource_browser);
 
+GVariant *
+gssdp_resource_browser_get_statistics
+                                  (GSSDPResourceBrowser *resource_browser);
+
 G_END_DECLS
 
 #endif /* GSSDP_RESOURCE_BROWSER_H */
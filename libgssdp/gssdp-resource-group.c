@@ -35,7 +35,10 @@
 #include "gssdp-resource-group.h"
 #include "gssdp-resource-browser.h"
 #include "gssdp-client-private.h"
+#include "gssdp-message.h"
+#include "gssdp-target.h"
 #include "gssdp-protocol.h"
+#include "gssdp-timer-wheel.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -45,6 +48,20 @@
 
 #define DEFAULT_MAN_HEADER "\"ssdp:discover\""
 
+/* Discovery responses are spread over [0, MX] seconds in 10 ms steps. With
+ * 512 slots a full revolution covers the common MX values of up to 5 s. */
+#define RESPONSE_TICK  10
+#define RESPONSE_SLOTS 512
+
+/* Limits protecting against search floods */
+#define DEFAULT_MAX_PENDING_RESPONSES 1024
+#define DEFAULT_MAX_MX                5
+#define DEFAULT_SEARCH_RATE           10
+#define DEFAULT_SEARCH_BURST          20
+
+/* Number of requesters tracked before the least recent ones are forgotten */
+#define SEARCH_SOURCES_MAX 4096
+
 struct _GSSDPResourceGroupPrivate {
         GSSDPClient *client;
 
@@ -54,15 +71,48 @@ struct _GSSDPResourceGroupPrivate {
 
         GList       *resources;
 
-        gulong       message_received_id;
+        /* Resources by target prefix, see gssdp_target_prefix_length() */
+        GHashTable  *target_index;
+
+        guint        message_handler_id;
 
         GSource     *timeout_src;
 
+        /* Pending discovery responses of all resources */
+        GSSDPTimerWheel *response_wheel;
+
+        /* The same, for finding repeated searches */
+        GHashTable  *pending_responses;
+
+        /* Flood protection, see gssdp_resource_group_set_search_rate() */
+        guint        max_pending_responses;
+        guint        max_mx;
+        guint        search_rate;
+        guint        search_burst;
+        GHashTable  *search_sources;
+        GQueue       search_lru;
+        guint64      dropped_searches;
+        guint64      dropped_responses;
+
+        /* See gssdp_resource_group_get_statistics() */
+        guint64      searches;
+        guint64      invalid_searches;
+        guint64      duplicate_responses;
+        guint64      responses;
+        guint64      alives;
+        guint64      byebyes;
+
         guint        last_resource_id;
         
         guint        message_delay;
-        GQueue      *message_queue;
-        GSource     *message_src;
+
+        /* Bumped when max-age changes, see ensure_messages() */
+        guint        message_serial;
+
+        /* Date header of discovery responses, rendered once per second */
+        char        *date;
+        gsize        date_length;
+        gint64       date_second;
 };
 typedef struct _GSSDPResourceGroupPrivate GSSDPResourceGroupPrivate;
 
@@ -75,13 +125,17 @@ enum {
         PROP_CLIENT,
         PROP_MAX_AGE,
         PROP_AVAILABLE,
-        PROP_MESSAGE_DELAY
+        PROP_MESSAGE_DELAY,
+        PROP_MAX_PENDING_RESPONSES,
+        PROP_MAX_MX,
+        PROP_SEARCH_RATE,
+        PROP_SEARCH_BURST
 };
 
 typedef struct {
         GSSDPResourceGroup *resource_group;
 
-        GRegex              *target_regex;
+        GSSDPTarget          target_matcher;
         char                *target;
         char                *usn;
         GList               *locations;
@@ -90,23 +144,51 @@ typedef struct {
 
         guint                id;
 
-        guint                version;
-
         gboolean             initial_byebye_sent;
+
+        /* Pre-rendered messages, see ensure_messages() */
+        guint                group_serial;
+        guint                client_serial;
+        GBytes              *alive_message;
+        GBytes              *byebye_message;
+        GBytes              *response_head;
+        GBytes              *response_middle;
+
+        /* Length of the part of usn preceding target, which is replaced
+         * by the searched target in discovery responses, or -1 */
+        gssize               usn_prefix_length;
 } Resource;
 
+/* Search token bucket of one requester */
+typedef struct {
+        char   *ip;
+        gdouble tokens;
+        gint64  last_refill;
+
+        /* In search_lru, most recent first */
+        GList   link;
+} SearchSource;
+
+/* All resources of one target type, regardless of version */
+typedef struct {
+        GList *resources;
+        guint  max_version;
+} TargetBucket;
+
 typedef struct {
         char     *dest_ip;
         gushort   dest_port;
         char     *target;
         Resource *resource;
 
-        GSource  *timeout_src;
+        /* When the request came in, see #GSSDPMessage */
+        gint64    request_time;
+
+        GSSDPTimer timer;
 } DiscoveryResponse;
 
 #define DEFAULT_MESSAGE_DELAY 120
 #define DEFAULT_ANNOUNCEMENT_SET_SIZE 3
-#define VERSION_PATTERN "[0-9]+$"
 
 /* Function prototypes */
 static void
@@ -115,11 +197,8 @@ gssdp_resource_group_set_client (GSSDPResourceGroup *resource_group,
 static gboolean
 resource_group_timeout          (gpointer            user_data);
 static void
-message_received_cb             (GSSDPClient        *client,
-                                 const char         *from_ip,
-                                 gushort             from_port,
-                                 _GSSDPMessageType   type,
-                                 SoupMessageHeaders *headers,
+message_handler                 (GSSDPClient        *client,
+                                 GSSDPMessage       *message,
                                  gpointer            user_data);
 static void
 resource_alive                  (Resource           *resource);
@@ -127,20 +206,31 @@ static void
 resource_byebye                 (Resource           *resource);
 static void
 resource_free                   (Resource           *resource);
-static gboolean
+static void
+clear_messages                  (Resource           *resource);
+static void
 discovery_response_timeout      (gpointer            user_data);
 static void
 discovery_response_free         (DiscoveryResponse  *response);
+static guint
+discovery_response_hash         (gconstpointer       data);
 static gboolean
-process_queue                   (gpointer            data);
-static char *
-get_version_for_target          (char *target);
-static GRegex *
-create_target_regex             (const char         *target,
-                                 guint              *version,
-                                 GError            **error);
+discovery_response_equal        (gconstpointer       a,
+                                 gconstpointer       b);
 static void
 send_initial_resource_byebye    (Resource          *resource);
+static void
+target_bucket_free              (TargetBucket      *bucket);
+static void
+index_resource                  (GSSDPResourceGroup *resource_group,
+                                 Resource           *resource);
+static void
+unindex_resource                (GSSDPResourceGroup *resource_group,
+                                 Resource           *resource);
+static void
+search_source_free              (SearchSource       *source);
+static void
+clear_search_sources            (GSSDPResourceGroupPrivate *priv);
 
 static void
 gssdp_resource_group_init (GSSDPResourceGroup *resource_group)
@@ -152,7 +242,25 @@ gssdp_resource_group_init (GSSDPResourceGroup *resource_group)
         priv->max_age = SSDP_DEFAULT_MAX_AGE;
         priv->message_delay = DEFAULT_MESSAGE_DELAY;
 
-        priv->message_queue = g_queue_new ();
+        priv->pending_responses = g_hash_table_new (discovery_response_hash,
+                                                    discovery_response_equal);
+
+        priv->max_pending_responses = DEFAULT_MAX_PENDING_RESPONSES;
+        priv->max_mx = DEFAULT_MAX_MX;
+        priv->search_rate = DEFAULT_SEARCH_RATE;
+        priv->search_burst = DEFAULT_SEARCH_BURST;
+        priv->search_sources = g_hash_table_new_full
+                                        (g_str_hash,
+                                         g_str_equal,
+                                         NULL,
+                                         (GDestroyNotify) search_source_free);
+        g_queue_init (&priv->search_lru);
+
+        priv->target_index = g_hash_table_new_full
+                                        (g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify) target_bucket_free);
 }
 
 static void
@@ -187,6 +295,29 @@ gssdp_resource_group_get_property (GObject    *object,
                          gssdp_resource_group_get_message_delay 
                                 (resource_group));
                 break;
+        case PROP_MAX_PENDING_RESPONSES:
+                g_value_set_uint
+                        (value,
+                         gssdp_resource_group_get_max_pending_responses
+                                (resource_group));
+                break;
+        case PROP_MAX_MX:
+                g_value_set_uint
+                        (value,
+                         gssdp_resource_group_get_max_mx (resource_group));
+                break;
+        case PROP_SEARCH_RATE:
+                g_value_set_uint
+                        (value,
+                         gssdp_resource_group_get_search_rate
+                                (resource_group));
+                break;
+        case PROP_SEARCH_BURST:
+                g_value_set_uint
+                        (value,
+                         gssdp_resource_group_get_search_burst
+                                (resource_group));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -220,6 +351,22 @@ gssdp_resource_group_set_property (GObject      *object,
                 gssdp_resource_group_set_message_delay
                         (resource_group, g_value_get_uint (value));
                 break;
+        case PROP_MAX_PENDING_RESPONSES:
+                gssdp_resource_group_set_max_pending_responses
+                        (resource_group, g_value_get_uint (value));
+                break;
+        case PROP_MAX_MX:
+                gssdp_resource_group_set_max_mx
+                        (resource_group, g_value_get_uint (value));
+                break;
+        case PROP_SEARCH_RATE:
+                gssdp_resource_group_set_search_rate
+                        (resource_group, g_value_get_uint (value));
+                break;
+        case PROP_SEARCH_BURST:
+                gssdp_resource_group_set_search_burst
+                        (resource_group, g_value_get_uint (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -238,31 +385,30 @@ gssdp_resource_group_dispose (GObject *object)
         g_list_free_full (priv->resources, (GFreeFunc) resource_free);
         priv->resources = NULL;
 
-        if (priv->message_queue) {
-                /* send messages without usual delay */
-                while (!g_queue_is_empty (priv->message_queue)) {
-                        if (priv->available)
-                                process_queue (resource_group);
-                        else
-                                g_free (g_queue_pop_head
-                                        (priv->message_queue));
-                }
-
-                g_clear_pointer (&priv->message_queue, g_queue_free);
-        }
+        /* Send the byebyes just queued, and whatever else is left, right
+         * away instead of leaving them behind in the client's queue */
+        if (priv->client != NULL)
+                _gssdp_client_flush_messages (priv->client, resource_group);
 
+        g_clear_pointer (&priv->target_index, g_hash_table_unref);
 
         /* No need to unref sources, already done on creation */
-        g_clear_pointer (&priv->message_src, g_source_destroy);
         g_clear_pointer (&priv->timeout_src, g_source_destroy);
 
+        /* Pending responses went away with their resources */
+        g_clear_pointer (&priv->response_wheel, gssdp_timer_wheel_destroy);
+        g_clear_pointer (&priv->pending_responses, g_hash_table_unref);
+        g_clear_pointer (&priv->search_sources, g_hash_table_unref);
+        g_queue_init (&priv->search_lru);
+
+        g_clear_pointer (&priv->date, g_free);
+
         if (priv->client) {
-                if (g_signal_handler_is_connected
-                        (priv->client,
-                         priv->message_received_id)) {
-                        g_signal_handler_disconnect
+                if (priv->message_handler_id != 0) {
+                        _gssdp_client_remove_handler
                                 (priv->client,
-                                 priv->message_received_id);
+                                 priv->message_handler_id);
+                        priv->message_handler_id = 0;
                 }
 
                 g_clear_object (priv->client);
@@ -340,7 +486,11 @@ gssdp_resource_group_class_init (GSSDPResourceGroupClass *klass)
          * GSSDPResourceGroup:message-delay:
          *
          * The minimum number of milliseconds between SSDP messages.
-         * The default is 120 based on DLNA specification.
+         *
+         * Deprecated: Messages of all groups on a #GSSDPClient are paced
+         * together now, see #GSSDPClient:message-rate and
+         * #GSSDPClient:message-burst. This property is only kept for
+         * compatibility and has no effect.
          **/
         g_object_class_install_property
                 (object_class,
@@ -354,6 +504,93 @@ gssdp_resource_group_class_init (GSSDPResourceGroupClass *klass)
                           G_MAXUINT,
                           DEFAULT_MESSAGE_DELAY,
                           G_PARAM_READWRITE |
+                          G_PARAM_DEPRECATED |
+                          G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK |
+                          G_PARAM_STATIC_BLURB));
+
+        /**
+         * GSSDPResourceGroup:max-pending-responses:
+         *
+         * The maximum number of discovery responses waiting to be sent, or
+         * 0 for no limit. Searches that would exceed it are only answered
+         * partially.
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_PENDING_RESPONSES,
+                 g_param_spec_uint
+                         ("max-pending-responses",
+                          "Max pending responses",
+                          "The maximum number of discovery responses "
+                          "waiting to be sent.",
+                          0,
+                          G_MAXUINT,
+                          DEFAULT_MAX_PENDING_RESPONSES,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK |
+                          G_PARAM_STATIC_BLURB));
+
+        /**
+         * GSSDPResourceGroup:max-mx:
+         *
+         * The maximum number of seconds discovery responses are delayed,
+         * whatever the MX header of the search asks for. The default is 5,
+         * as recommended by the UPnP Device Architecture 1.1.
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_MX,
+                 g_param_spec_uint
+                         ("max-mx",
+                          "Max MX",
+                          "The maximum number of seconds discovery "
+                          "responses are delayed.",
+                          1,
+                          G_MAXINT / 1000,
+                          DEFAULT_MAX_MX,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK |
+                          G_PARAM_STATIC_BLURB));
+
+        /**
+         * GSSDPResourceGroup:search-rate:
+         *
+         * The number of searches per second answered for a single host, or
+         * 0 for no limit. Searches beyond that are ignored.
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_SEARCH_RATE,
+                 g_param_spec_uint
+                         ("search-rate",
+                          "Search rate",
+                          "The number of searches per second answered for "
+                          "a single host.",
+                          0,
+                          G_MAXUINT,
+                          DEFAULT_SEARCH_RATE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK |
+                          G_PARAM_STATIC_BLURB));
+
+        /**
+         * GSSDPResourceGroup:search-burst:
+         *
+         * The number of searches answered for a single host in quick
+         * succession, see #GSSDPResourceGroup:search-rate.
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_SEARCH_BURST,
+                 g_param_spec_uint
+                         ("search-burst",
+                          "Search burst",
+                          "The number of searches answered for a single "
+                          "host in quick succession.",
+                          1,
+                          G_MAXUINT,
+                          DEFAULT_SEARCH_BURST,
+                          G_PARAM_READWRITE |
                           G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK |
                           G_PARAM_STATIC_BLURB));
 }
@@ -387,12 +624,11 @@ gssdp_resource_group_set_client (GSSDPResourceGroup *resource_group,
         priv = gssdp_resource_group_get_instance_private (resource_group);
         priv->client = g_object_ref (client);
 
-        priv->message_received_id =
-                g_signal_connect_object (priv->client,
-                                         "message-received",
-                                         G_CALLBACK (message_received_cb),
-                                         resource_group,
-                                         0);
+        if (priv->available)
+                priv->message_handler_id =
+                        _gssdp_client_add_request_handler (priv->client,
+                                                           message_handler,
+                                                           resource_group);
 
         g_object_notify (G_OBJECT (resource_group), "client");
 }
@@ -435,6 +671,7 @@ gssdp_resource_group_set_max_age (GSSDPResourceGroup *resource_group,
                 return;
 
         priv->max_age = max_age;
+        priv->message_serial++;
 
         g_object_notify (G_OBJECT (resource_group), "max-age");
 }
@@ -462,6 +699,9 @@ gssdp_resource_group_get_max_age (GSSDPResourceGroup *resource_group)
  * @message_delay: The message delay in ms.
  *
  * Sets the minimum time between each SSDP message.
+ *
+ * Deprecated: This has no effect, messages are paced by the #GSSDPClient of
+ * @resource_group. Use gssdp_client_set_message_rate() instead.
  **/
 void
 gssdp_resource_group_set_message_delay (GSSDPResourceGroup *resource_group,
@@ -476,7 +716,6 @@ gssdp_resource_group_set_message_delay (GSSDPResourceGroup *resource_group,
                 return;
 
         priv->message_delay = message_delay;
-
         g_object_notify (G_OBJECT (resource_group), "message-delay");
 }
 
@@ -485,6 +724,9 @@ gssdp_resource_group_set_message_delay (GSSDPResourceGroup *resource_group,
  * @resource_group: A #GSSDPResourceGroup
  *
  * Return value: the minimum time between each SSDP message in ms.
+ *
+ * Deprecated: The message delay has no effect, see
+ * gssdp_client_get_message_rate().
  **/
 guint
 gssdp_resource_group_get_message_delay (GSSDPResourceGroup *resource_group)
@@ -497,6 +739,288 @@ gssdp_resource_group_get_message_delay (GSSDPResourceGroup *resource_group)
         return priv->message_delay;
 }
 
+/**
+ * gssdp_resource_group_set_max_pending_responses:
+ * @resource_group: A #GSSDPResourceGroup
+ * @max_pending_responses: The maximum number of pending responses, or 0 for no limit
+ *
+ * Limits the number of discovery responses @resource_group keeps waiting
+ * to be sent, to bound the memory a flood of searches can tie up.
+ **/
+void
+gssdp_resource_group_set_max_pending_responses (GSSDPResourceGroup *resource_group,
+                                                guint               max_pending_responses)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group));
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+        if (priv->max_pending_responses == max_pending_responses)
+                return;
+
+        priv->max_pending_responses = max_pending_responses;
+
+        g_object_notify (G_OBJECT (resource_group), "max-pending-responses");
+}
+
+/**
+ * gssdp_resource_group_get_max_pending_responses:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The maximum number of pending discovery responses, or 0 if there
+ * is no limit.
+ **/
+guint
+gssdp_resource_group_get_max_pending_responses (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->max_pending_responses;
+}
+
+/**
+ * gssdp_resource_group_set_max_mx:
+ * @resource_group: A #GSSDPResourceGroup
+ * @max_mx: The maximum delay in seconds
+ *
+ * Sets the maximum number of seconds discovery responses are delayed,
+ * regardless of the MX header of the search.
+ **/
+void
+gssdp_resource_group_set_max_mx (GSSDPResourceGroup *resource_group,
+                                 guint               max_mx)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group));
+        g_return_if_fail (max_mx > 0 && max_mx <= G_MAXINT / 1000);
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+        if (priv->max_mx == max_mx)
+                return;
+
+        priv->max_mx = max_mx;
+
+        g_object_notify (G_OBJECT (resource_group), "max-mx");
+}
+
+/**
+ * gssdp_resource_group_get_max_mx:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The maximum number of seconds discovery responses are delayed.
+ **/
+guint
+gssdp_resource_group_get_max_mx (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->max_mx;
+}
+
+/**
+ * gssdp_resource_group_set_search_rate:
+ * @resource_group: A #GSSDPResourceGroup
+ * @search_rate: The number of searches per second, or 0 for no limit
+ *
+ * Sets how many searches per second @resource_group answers for any
+ * single host. Searches beyond that are dropped and counted, see
+ * gssdp_resource_group_get_dropped_searches().
+ **/
+void
+gssdp_resource_group_set_search_rate (GSSDPResourceGroup *resource_group,
+                                      guint               search_rate)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group));
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+        if (priv->search_rate == search_rate)
+                return;
+
+        priv->search_rate = search_rate;
+        clear_search_sources (priv);
+
+        g_object_notify (G_OBJECT (resource_group), "search-rate");
+}
+
+/**
+ * gssdp_resource_group_get_search_rate:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The number of searches per second answered for a single host, or
+ * 0 if there is no limit.
+ **/
+guint
+gssdp_resource_group_get_search_rate (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->search_rate;
+}
+
+/**
+ * gssdp_resource_group_set_search_burst:
+ * @resource_group: A #GSSDPResourceGroup
+ * @search_burst: The number of searches
+ *
+ * Sets how many searches @resource_group answers for any single host in
+ * quick succession, see gssdp_resource_group_set_search_rate().
+ **/
+void
+gssdp_resource_group_set_search_burst (GSSDPResourceGroup *resource_group,
+                                       guint               search_burst)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group));
+        g_return_if_fail (search_burst > 0);
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+        if (priv->search_burst == search_burst)
+                return;
+
+        priv->search_burst = search_burst;
+        clear_search_sources (priv);
+
+        g_object_notify (G_OBJECT (resource_group), "search-burst");
+}
+
+/**
+ * gssdp_resource_group_get_search_burst:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The number of searches answered for a single host in quick
+ * succession.
+ **/
+guint
+gssdp_resource_group_get_search_burst (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->search_burst;
+}
+
+/**
+ * gssdp_resource_group_get_dropped_searches:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The number of searches that were ignored because their
+ * sender exceeded the search rate.
+ **/
+guint64
+gssdp_resource_group_get_dropped_searches (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->dropped_searches;
+}
+
+/**
+ * gssdp_resource_group_get_dropped_responses:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Return value: The number of discovery responses that were not sent
+ * because too many were pending already.
+ **/
+guint64
+gssdp_resource_group_get_dropped_responses (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        return priv->dropped_responses;
+}
+
+/**
+ * gssdp_resource_group_get_statistics:
+ * @resource_group: A #GSSDPResourceGroup
+ *
+ * Get a snapshot of the counters @resource_group keeps, as a dictionary of
+ * unsigned 64 bit integers. The keys are:
+ *
+ * <itemizedlist>
+ * <listitem><para>resources: Resources in the group.</para></listitem>
+ * <listitem><para>pending-responses: Discovery responses waiting for their
+ * random delay to pass.</para></listitem>
+ * <listitem><para>searches: Discovery requests received while
+ * available.</para></listitem>
+ * <listitem><para>invalid-searches: Discovery requests ignored because of a
+ * missing or invalid header.</para></listitem>
+ * <listitem><para>dropped-searches, dropped-responses: See
+ * gssdp_resource_group_get_dropped_searches() and
+ * gssdp_resource_group_get_dropped_responses().</para></listitem>
+ * <listitem><para>duplicate-responses: Discovery responses not queued
+ * because the same response to the same host was pending
+ * already.</para></listitem>
+ * <listitem><para>responses: Discovery responses handed to the
+ * client.</para></listitem>
+ * <listitem><para>alives, byebyes: Announcements handed to the
+ * client.</para></listitem>
+ * </itemizedlist>
+ *
+ * Messages handed to the client may still wait for its rate limit, see the
+ * queued-messages key of gssdp_client_get_statistics(). More keys may be
+ * added in the future.
+ *
+ * Return value: (transfer full): A #GVariant of type a{sv}. Free with
+ * g_variant_unref().
+ **/
+GVariant *
+gssdp_resource_group_get_statistics (GSSDPResourceGroup *resource_group)
+{
+        GSSDPResourceGroupPrivate *priv;
+        GVariantBuilder builder;
+
+        g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), NULL);
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+        _gssdp_add_statistic (&builder,
+                              "resources",
+                              g_list_length (priv->resources));
+        _gssdp_add_statistic (&builder,
+                              "pending-responses",
+                              g_hash_table_size (priv->pending_responses));
+        _gssdp_add_statistic (&builder, "searches", priv->searches);
+        _gssdp_add_statistic (&builder,
+                              "invalid-searches",
+                              priv->invalid_searches);
+        _gssdp_add_statistic (&builder,
+                              "dropped-searches",
+                              priv->dropped_searches);
+        _gssdp_add_statistic (&builder,
+                              "dropped-responses",
+                              priv->dropped_responses);
+        _gssdp_add_statistic (&builder,
+                              "duplicate-responses",
+                              priv->duplicate_responses);
+        _gssdp_add_statistic (&builder, "responses", priv->responses);
+        _gssdp_add_statistic (&builder, "alives", priv->alives);
+        _gssdp_add_statistic (&builder, "byebyes", priv->byebyes);
+
+        return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 static void
 send_initial_resource_byebye (Resource *resource)
 {
@@ -544,6 +1068,19 @@ gssdp_resource_group_set_available (GSSDPResourceGroup *resource_group,
 
         priv->available = available;
 
+        /* Only listen to discovery requests while there is something to
+         * answer, which lets the client filter them out otherwise */
+        if (available && priv->client != NULL) {
+                priv->message_handler_id =
+                        _gssdp_client_add_request_handler (priv->client,
+                                                           message_handler,
+                                                           resource_group);
+        } else if (!available && priv->message_handler_id != 0) {
+                _gssdp_client_remove_handler (priv->client,
+                                              priv->message_handler_id);
+                priv->message_handler_id = 0;
+        }
+
         if (available) {
                 int timeout;
 
@@ -626,7 +1163,6 @@ gssdp_resource_group_add_resource (GSSDPResourceGroup *resource_group,
         GSSDPResourceGroupPrivate *priv;
         Resource *resource;
         GList *l;
-        GError *error;
 
         g_return_val_if_fail (GSSDP_IS_RESOURCE_GROUP (resource_group), 0);
         g_return_val_if_fail (target != NULL, 0);
@@ -642,22 +1178,10 @@ gssdp_resource_group_add_resource (GSSDPResourceGroup *resource_group,
         resource->target = g_strdup (target);
         resource->usn    = g_strdup (usn);
 
-        error = NULL;
-        resource->target_regex = create_target_regex (target,
-                                                      &resource->version,
-                                                      &error);
-        if (error) {
-                g_warning ("Error compiling regular expression for '%s': %s",
-                           target,
-                           error->message);
-
-                g_error_free (error);
-                resource_free (resource);
-
-                return 0;
-        }
+        gssdp_target_init (&resource->target_matcher, target);
 
         resource->initial_byebye_sent = FALSE;
+        resource->usn_prefix_length = -1;
 
         for (l = locations; l; l = l->next) {
                 resource->locations = g_list_append (resource->locations,
@@ -665,6 +1189,7 @@ gssdp_resource_group_add_resource (GSSDPResourceGroup *resource_group,
         }
 
         priv->resources = g_list_prepend (priv->resources, resource);
+        index_resource (resource_group, resource);
 
         resource->id = ++priv->last_resource_id;
 
@@ -732,6 +1257,7 @@ gssdp_resource_group_remove_resource (GSSDPResourceGroup *resource_group,
                 if (resource->id == resource_id) {
                         priv->resources = g_list_remove (priv->resources,
                                                          resource);
+                        unindex_resource (resource_group, resource);
 
                         resource_free (resource);
 
@@ -757,22 +1283,184 @@ resource_group_timeout (gpointer user_data)
         return TRUE;
 }
 
+/*
+ * Schedules a response to @message for @resource
+ */
+static void
+queue_discovery_response (Resource     *resource,
+                          GSSDPMessage *message,
+                          const char   *target,
+                          int           mx)
+{
+        GSSDPResourceGroupPrivate *priv;
+        guint timeout;
+        DiscoveryResponse *response;
+        DiscoveryResponse key;
+
+        priv = gssdp_resource_group_get_instance_private
+                                        (resource->resource_group);
+
+        /* Control points tend to repeat their searches, answering the first
+         * copy within its MX window is enough */
+        key.dest_ip = message->from_ip;
+        key.dest_port = message->from_port;
+        key.target = (char *) target;
+        key.resource = resource;
+        if (g_hash_table_contains (priv->pending_responses, &key)) {
+                priv->duplicate_responses++;
+
+                return;
+        }
+
+        if (priv->max_pending_responses > 0 &&
+            g_hash_table_size (priv->pending_responses) >=
+            priv->max_pending_responses) {
+                priv->dropped_responses++;
+
+                return;
+        }
+
+        /* Get a random timeout from the interval [0, mx] */
+        timeout = g_random_int_range (0, mx * 1000);
+
+        /* Prepare response */
+        response = g_slice_new (DiscoveryResponse);
+
+        response->dest_ip      = g_strdup (message->from_ip);
+        response->dest_port    = message->from_port;
+        response->resource     = resource;
+        response->target       = g_strdup (target);
+        response->request_time = message->received;
+
+        /* All pending responses share one source, due ones are sent
+         * together */
+        if (priv->response_wheel == NULL) {
+                priv->response_wheel = gssdp_timer_wheel_new (RESPONSE_TICK,
+                                                              RESPONSE_SLOTS);
+                gssdp_timer_wheel_attach (priv->response_wheel,
+                                          g_main_context_get_thread_default ());
+        }
+
+        gssdp_timer_init (&response->timer,
+                          discovery_response_timeout,
+                          response);
+        gssdp_timer_wheel_schedule (priv->response_wheel,
+                                    &response->timer,
+                                    timeout);
+
+        /* Add to resource */
+        resource->responses = g_list_prepend (resource->responses, response);
+        g_hash_table_add (priv->pending_responses, response);
+}
+
+static void
+refill_search_source (GSSDPResourceGroupPrivate *priv,
+                      SearchSource              *source,
+                      gint64                     now)
+{
+        source->tokens += (now - source->last_refill) * priv->search_rate /
+                          (gdouble) G_USEC_PER_SEC;
+        source->tokens = MIN (source->tokens, (gdouble) priv->search_burst);
+        source->last_refill = now;
+}
+
+static void
+search_source_free (SearchSource *source)
+{
+        g_free (source->ip);
+        g_slice_free (SearchSource, source);
+}
+
+static void
+clear_search_sources (GSSDPResourceGroupPrivate *priv)
+{
+        g_hash_table_remove_all (priv->search_sources);
+        g_queue_init (&priv->search_lru);
+}
+
+/* Forgets the least recent requester */
+static void
+forget_search_source (GSSDPResourceGroupPrivate *priv)
+{
+        SearchSource *source = g_queue_peek_tail (&priv->search_lru);
+
+        g_queue_unlink (&priv->search_lru, &source->link);
+        g_hash_table_remove (priv->search_sources, source->ip);
+}
+
+/*
+ * Takes one token out of the search bucket of @from_ip. Returns %FALSE if
+ * that host has been searching too much lately.
+ */
+static gboolean
+take_search_token (GSSDPResourceGroup *resource_group,
+                   const char         *from_ip)
+{
+        GSSDPResourceGroupPrivate *priv;
+        SearchSource *source;
+        gint64 now;
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        if (priv->search_rate == 0)
+                return TRUE;
+
+        now = g_get_monotonic_time ();
+
+        source = g_hash_table_lookup (priv->search_sources, from_ip);
+        if (source == NULL) {
+                SearchSource *oldest;
+
+                /* Hosts whose bucket is full again are no different from
+                 * ones never seen, and the least recent ones are the most
+                 * likely to be. Should a flood of spoofed addresses still
+                 * fill the table, forget the least recent ones anyway. */
+                while ((oldest = g_queue_peek_tail (&priv->search_lru))) {
+                        refill_search_source (priv, oldest, now);
+                        if (oldest->tokens < priv->search_burst &&
+                            priv->search_lru.length < SEARCH_SOURCES_MAX)
+                                break;
+
+                        forget_search_source (priv);
+                }
+
+                source = g_slice_new0 (SearchSource);
+                source->ip = g_strdup (from_ip);
+                source->tokens = priv->search_burst;
+                source->last_refill = now;
+                source->link.data = source;
+                g_hash_table_insert (priv->search_sources, source->ip, source);
+        } else {
+                refill_search_source (priv, source, now);
+                g_queue_unlink (&priv->search_lru, &source->link);
+        }
+
+        g_queue_push_head_link (&priv->search_lru, &source->link);
+
+        if (source->tokens < 1)
+                return FALSE;
+
+        source->tokens -= 1;
+
+        return TRUE;
+}
+
 /*
  * Received a message
  */
 static void
-message_received_cb (G_GNUC_UNUSED GSSDPClient *client,
-                     const char                *from_ip,
-                     gushort                    from_port,
-                     _GSSDPMessageType          type,
-                     SoupMessageHeaders        *headers,
-                     gpointer                   user_data)
+message_handler (GSSDPClient  *client,
+                 GSSDPMessage *message,
+                 gpointer      user_data)
 {
         GSSDPResourceGroup *resource_group;
         GSSDPResourceGroupPrivate *priv;
-        const char *target, *mx_str, *version_str, *man;
-        gboolean want_all;
-        int mx, version;
+        GSSDPDiagnostics *diagnostics;
+        TargetBucket *bucket;
+        const char *target;
+        char *prefix;
+        int mx;
+        guint version;
         GList *l;
 
         resource_group = GSSDP_RESOURCE_GROUP (user_data);
@@ -783,90 +1471,163 @@ message_received_cb (G_GNUC_UNUSED GSSDPClient *client,
                 return;
 
         /* We only handle discovery requests */
-        if (type != _GSSDP_DISCOVERY_REQUEST)
+        if (message->type != _GSSDP_DISCOVERY_REQUEST)
                 return;
 
+        priv->searches++;
+        diagnostics = _gssdp_client_get_diagnostics (client);
+
         /* Extract target */
-        target = soup_message_headers_get_one (headers, "ST");
+        target = message->st;
         if (target == NULL) {
-                g_warning ("Discovery request did not have an ST header");
+                priv->invalid_searches++;
+                gssdp_diagnostic (diagnostics,
+                                  GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                  message->from_ip,
+                                  NULL,
+                                  "Discovery request did not have an ST "
+                                  "header");
 
                 return;
         }
 
-        /* Is this the "ssdp:all" target? */
-        want_all = (strcmp (target, GSSDP_ALL_RESOURCES) == 0);
-
         /* Extract MX */
-        mx_str = soup_message_headers_get_one (headers, "MX");
-        if (mx_str == NULL || atoi (mx_str) <= 0) {
-                g_warning ("Discovery request did not have a valid MX header");
+        mx = message->mx;
+        if (mx <= 0) {
+                priv->invalid_searches++;
+                gssdp_diagnostic (diagnostics,
+                                  GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                  message->from_ip,
+                                  _gssdp_message_get_header (message, "MX"),
+                                  "Discovery request did not have a valid MX "
+                                  "header");
 
                 return;
         }
 
-        man = soup_message_headers_get_one (headers, "MAN");
-        if (man == NULL || strcmp (man, DEFAULT_MAN_HEADER) != 0) {
-                g_warning ("Discovery request did not have a valid MAN header");
+        if (message->man == NULL ||
+            strcmp (message->man, DEFAULT_MAN_HEADER) != 0) {
+                priv->invalid_searches++;
+                gssdp_diagnostic (diagnostics,
+                                  GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                  message->from_ip,
+                                  message->man,
+                                  "Discovery request did not have a valid MAN "
+                                  "header");
 
                 return;
         }
 
-        mx = atoi (mx_str);
-
-        /* Extract version */
-        version_str = get_version_for_target ((char *) target);
-        if (version_str != NULL)
-                version = atoi (version_str);
-        else
-                version = 0;
+        if (!take_search_token (resource_group, message->from_ip)) {
+                priv->dropped_searches++;
 
-        /* Find matching resource */
-        for (l = priv->resources; l != NULL; l = l->next) {
-                Resource *resource;
+                return;
+        }
 
-                resource = l->data;
+        mx = MIN ((guint) mx, priv->max_mx);
 
-                if (want_all ||
-                    (g_regex_match (resource->target_regex,
-                                    target,
-                                    0,
-                                    NULL) &&
-                     (guint) version <= resource->version)) {
-                        /* Match. */
-                        guint timeout;
-                        DiscoveryResponse *response;
-
-                        /* Get a random timeout from the interval [0, mx] */
-                        timeout = g_random_int_range (0, mx * 1000);
-
-                        /* Prepare response */
-                        response = g_slice_new (DiscoveryResponse);
-
-                        response->dest_ip   = g_strdup (from_ip);
-                        response->dest_port = from_port;
-                        response->resource  = resource;
-
-                        if (want_all)
-                                response->target = g_strdup (resource->target);
-                        else
-                                response->target = g_strdup (target);
-
-                        /* Add timeout */
-                        response->timeout_src = g_timeout_source_new (timeout);
-                        g_source_set_callback (response->timeout_src,
-                                               discovery_response_timeout,
-                                               response, NULL);
-
-                        g_source_attach (response->timeout_src,
-                                         g_main_context_get_thread_default ());
-
-                        g_source_unref (response->timeout_src);
-
-                        /* Add to resource */
-                        resource->responses =
-                                g_list_prepend (resource->responses, response);
+        /* Is this the "ssdp:all" target? */
+        if (strcmp (target, GSSDP_ALL_RESOURCES) == 0) {
+                for (l = priv->resources; l != NULL; l = l->next) {
+                        Resource *resource = l->data;
+
+                        queue_discovery_response (resource,
+                                                  message,
+                                                  resource->target,
+                                                  mx);
                 }
+
+                return;
+        }
+
+        /* Find matching resources */
+        prefix = g_strndup (target,
+                            gssdp_target_prefix_length (target, &version));
+        bucket = g_hash_table_lookup (priv->target_index, prefix);
+        g_free (prefix);
+
+        /* Older versions of a type are served by newer ones */
+        if (bucket == NULL || version > bucket->max_version)
+                return;
+
+        for (l = bucket->resources; l != NULL; l = l->next) {
+                Resource *resource = l->data;
+
+                if (gssdp_target_match (&resource->target_matcher,
+                                        target,
+                                        &version) &&
+                    version <= resource->target_matcher.version)
+                        queue_discovery_response (resource,
+                                                  message,
+                                                  target,
+                                                  mx);
+        }
+}
+
+static void
+target_bucket_free (TargetBucket *bucket)
+{
+        g_list_free (bucket->resources);
+        g_slice_free (TargetBucket, bucket);
+}
+
+/*
+ * Adds @resource to the target index of @resource_group
+ */
+static void
+index_resource (GSSDPResourceGroup *resource_group,
+                Resource           *resource)
+{
+        GSSDPResourceGroupPrivate *priv;
+        TargetBucket *bucket;
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        bucket = g_hash_table_lookup (priv->target_index,
+                                      resource->target_matcher.prefix);
+        if (bucket == NULL) {
+                bucket = g_slice_new0 (TargetBucket);
+                g_hash_table_insert (priv->target_index,
+                                     g_strdup (resource->target_matcher.prefix),
+                                     bucket);
+        }
+
+        bucket->resources = g_list_prepend (bucket->resources, resource);
+        bucket->max_version = MAX (bucket->max_version,
+                                   resource->target_matcher.version);
+}
+
+/*
+ * Removes @resource from the target index of @resource_group
+ */
+static void
+unindex_resource (GSSDPResourceGroup *resource_group,
+                  Resource           *resource)
+{
+        GSSDPResourceGroupPrivate *priv;
+        TargetBucket *bucket;
+        GList *l;
+
+        priv = gssdp_resource_group_get_instance_private (resource_group);
+
+        bucket = g_hash_table_lookup (priv->target_index,
+                                      resource->target_matcher.prefix);
+        g_return_if_fail (bucket != NULL);
+
+        bucket->resources = g_list_remove (bucket->resources, resource);
+        if (bucket->resources == NULL) {
+                g_hash_table_remove (priv->target_index,
+                                     resource->target_matcher.prefix);
+
+                return;
+        }
+
+        bucket->max_version = 0;
+        for (l = bucket->resources; l != NULL; l = l->next) {
+                Resource *other = l->data;
+
+                bucket->max_version = MAX (bucket->max_version,
+                                           other->target_matcher.version);
         }
 }
 
@@ -896,162 +1657,251 @@ construct_al (Resource *resource)
         return g_string_free (al_string, FALSE);
 }
 
-static char *
-construct_usn (const char *usn,
-               const char *response_target,
-               const char *resource_target)
+static void
+clear_messages (Resource *resource)
 {
-        const char *needle;
-        char *prefix;
-        char *st;
+        g_clear_pointer (&resource->alive_message, g_bytes_unref);
+        g_clear_pointer (&resource->byebye_message, g_bytes_unref);
+        g_clear_pointer (&resource->response_head, g_bytes_unref);
+        g_clear_pointer (&resource->response_middle, g_bytes_unref);
+}
 
-        needle = strstr (usn, resource_target);
-        if (needle == NULL)
-                return g_strdup (usn);
+static GBytes *
+bytes_new_printf (const char *format,
+                  ...) G_GNUC_PRINTF (1, 2);
 
-        prefix = g_strndup (usn, needle - usn);
-        st = g_strconcat (prefix, response_target, NULL);
+static GBytes *
+bytes_new_printf (const char *format,
+                  ...)
+{
+        va_list args;
+        char *str;
 
-        g_free (prefix);
+        va_start (args, format);
+        str = g_strdup_vprintf (format, args);
+        va_end (args);
 
-        return st;
+        return g_bytes_new_take (str, strlen (str));
 }
 
 /*
- * Send a discovery response
+ * Renders the messages of @resource unless the ones rendered earlier are
+ * still valid. Locations and targets never change during the lifetime of a
+ * resource, so only the max-age of the group and the server ID and custom
+ * headers of the client can make them stale.
  */
-static gboolean
-discovery_response_timeout (gpointer user_data)
+static void
+ensure_messages (Resource *resource)
 {
-        DiscoveryResponse *response = user_data;
-        GSSDPClient *client;
-        SoupDate *date;
-        char *al, *date_str, *message;
-        guint max_age;
-        char *usn;
-        GSSDPResourceGroup *self = response->resource->resource_group;
         GSSDPResourceGroupPrivate *priv;
+        GSSDPClient *client;
+        const char *needle;
+        guint client_serial;
+        char *al;
 
-        priv = gssdp_resource_group_get_instance_private (self);
-
-        /* Send message */
+        priv = gssdp_resource_group_get_instance_private
+                                        (resource->resource_group);
         client = priv->client;
 
-        max_age = priv->max_age;
-
-        al = construct_al (response->resource);
-        usn = construct_usn (response->resource->usn,
-                             response->target,
-                             response->resource->target);
-        date = soup_date_new_from_now (0);
-        date_str = soup_date_to_string (date, SOUP_DATE_HTTP);
-        soup_date_free (date);
-
-        message = g_strdup_printf (SSDP_DISCOVERY_RESPONSE,
-                                   (char *) response->resource->locations->data,
-                                   al ? al : "",
-                                   usn,
-                                   gssdp_client_get_server_id (client),
-                                   max_age,
-                                   response->target,
-                                   date_str);
-
-        _gssdp_client_send_message (client,
-                                    response->dest_ip,
-                                    response->dest_port,
-                                    message,
-                                    _GSSDP_DISCOVERY_RESPONSE);
-
-        g_free (message);
-        g_free (date_str);
-        g_free (al);
-        g_free (usn);
+        client_serial = _gssdp_client_get_message_serial (client);
+        if (resource->alive_message != NULL &&
+            resource->group_serial == priv->message_serial &&
+            resource->client_serial == client_serial)
+                return;
 
-        discovery_response_free (response);
+        clear_messages (resource);
+
+        al = construct_al (resource);
+
+        resource->alive_message =
+                bytes_new_printf (SSDP_ALIVE_MESSAGE,
+                                  priv->max_age,
+                                  (char *) resource->locations->data,
+                                  al ? al : "",
+                                  gssdp_client_get_server_id (client),
+                                  resource->target,
+                                  resource->usn);
+
+        resource->byebye_message =
+                bytes_new_printf (SSDP_BYEBYE_MESSAGE,
+                                  resource->target,
+                                  resource->usn);
+
+        resource->response_head =
+                bytes_new_printf (SSDP_DISCOVERY_RESPONSE_HEAD,
+                                  (char *) resource->locations->data,
+                                  al ? al : "");
+
+        resource->response_middle =
+                bytes_new_printf (SSDP_DISCOVERY_RESPONSE_MIDDLE,
+                                  gssdp_client_get_server_id (client),
+                                  priv->max_age);
+
+        needle = strstr (resource->usn, resource->target);
+        if (needle != NULL)
+                resource->usn_prefix_length = needle - resource->usn;
+        else
+                resource->usn_prefix_length = -1;
+
+        resource->group_serial = priv->message_serial;
+        resource->client_serial = client_serial;
 
-        return FALSE;
+        g_free (al);
 }
 
 /*
- * Free a DiscoveryResponse structure and its contained data
+ * Returns the current date as used in the Date header. Formatting it is only
+ * done once per second, no matter how many responses go out.
  */
-static void
-discovery_response_free (DiscoveryResponse *response)
+static const char *
+get_date (GSSDPResourceGroupPrivate *priv,
+          gsize                     *length)
 {
-        response->resource->responses =
-                g_list_remove (response->resource->responses, response);
+        gint64 now;
 
-        g_source_destroy (response->timeout_src);
+        now = g_get_real_time () / G_USEC_PER_SEC;
+        if (priv->date == NULL || priv->date_second != now) {
+                SoupDate *date;
 
-        g_free (response->dest_ip);
-        g_free (response->target);
+                g_free (priv->date);
 
-        g_slice_free (DiscoveryResponse, response);
+                date = soup_date_new_from_time_t ((time_t) now);
+                priv->date = soup_date_to_string (date, SOUP_DATE_HTTP);
+                priv->date_length = strlen (priv->date);
+                priv->date_second = now;
+                soup_date_free (date);
+        }
+
+        *length = priv->date_length;
+
+        return priv->date;
+}
+
+static void
+set_vector (GOutputVector *vector,
+            const void    *buffer,
+            gsize          size)
+{
+        vector->buffer = buffer;
+        vector->size = size;
+}
+
+static void
+set_vector_from_bytes (GOutputVector *vector,
+                       GBytes        *bytes)
+{
+        gsize size;
+
+        vector->buffer = g_bytes_get_data (bytes, &size);
+        vector->size = size;
 }
 
 /*
- * Send the next queued message, if any
+ * Send a discovery response
  */
-static gboolean
-process_queue (gpointer data)
+static void
+discovery_response_timeout (gpointer user_data)
 {
-        GSSDPResourceGroup *resource_group;
+        DiscoveryResponse *response = user_data;
+        Resource *resource = response->resource;
         GSSDPResourceGroupPrivate *priv;
-        GSSDPClient *client;
-        char *message;
+        GOutputVector vectors[9];
+        const char *date;
+        gsize date_length;
+        gsize target_length;
+        guint n = 0;
 
-        resource_group = GSSDP_RESOURCE_GROUP (data);
-        priv = gssdp_resource_group_get_instance_private (resource_group);
-
-        if (g_queue_is_empty (priv->message_queue)) {
-                /* this is the timeout after last message in queue */
-                priv->message_src = NULL;
+        priv = gssdp_resource_group_get_instance_private
+                                        (resource->resource_group);
 
-                return FALSE;
+        ensure_messages (resource);
+        date = get_date (priv, &date_length);
+        target_length = strlen (response->target);
+
+        /* The USN has the resource's target replaced with the searched one */
+        set_vector_from_bytes (&vectors[n++], resource->response_head);
+        if (resource->usn_prefix_length >= 0) {
+                set_vector (&vectors[n++],
+                            resource->usn,
+                            resource->usn_prefix_length);
+                set_vector (&vectors[n++], response->target, target_length);
+        } else {
+                set_vector (&vectors[n++],
+                            resource->usn,
+                            strlen (resource->usn));
         }
+        set_vector_from_bytes (&vectors[n++], resource->response_middle);
+        set_vector (&vectors[n++], response->target, target_length);
+        set_vector (&vectors[n++],
+                    SSDP_DISCOVERY_RESPONSE_DATE,
+                    strlen (SSDP_DISCOVERY_RESPONSE_DATE));
+        set_vector (&vectors[n++], date, date_length);
+        set_vector (&vectors[n++],
+                    SSDP_DISCOVERY_RESPONSE_TAIL,
+                    strlen (SSDP_DISCOVERY_RESPONSE_TAIL));
+
+        _gssdp_client_queue_vectors (priv->client,
+                                     GSSDP_PACER_PRIORITY_RESPONSE,
+                                     resource->resource_group,
+                                     response->dest_ip,
+                                     response->dest_port,
+                                     vectors,
+                                     n,
+                                     response->request_time);
+        priv->responses++;
 
-        client = priv->client;
-        message = g_queue_pop_head (priv->message_queue);
+        discovery_response_free (response);
+}
+
+/*
+ * Responses are the same if they go to the same requester for the same
+ * search target and resource
+ */
+static guint
+discovery_response_hash (gconstpointer data)
+{
+        const DiscoveryResponse *response = data;
 
-        _gssdp_client_send_message (client,
-                                    NULL,
-                                    0,
-                                    message,
-                                    _GSSDP_DISCOVERY_RESPONSE);
-        g_free (message);
+        return g_str_hash (response->dest_ip) ^
+               g_str_hash (response->target) ^
+               g_direct_hash (response->resource) ^
+               response->dest_port;
+}
 
-        return TRUE;
+static gboolean
+discovery_response_equal (gconstpointer a,
+                          gconstpointer b)
+{
+        const DiscoveryResponse *response_a = a;
+        const DiscoveryResponse *response_b = b;
+
+        return response_a->resource == response_b->resource &&
+               response_a->dest_port == response_b->dest_port &&
+               strcmp (response_a->dest_ip, response_b->dest_ip) == 0 &&
+               strcmp (response_a->target, response_b->target) == 0;
 }
 
 /*
- * Add a message to sending queue
- * 
- * Do not free @message.
+ * Free a DiscoveryResponse structure and its contained data
  */
 static void
-queue_message (GSSDPResourceGroup *resource_group,
-               char               *message)
+discovery_response_free (DiscoveryResponse *response)
 {
         GSSDPResourceGroupPrivate *priv;
-        priv = gssdp_resource_group_get_instance_private (resource_group);
 
-        g_queue_push_tail (priv->message_queue, message);
+        priv = gssdp_resource_group_get_instance_private
+                                        (response->resource->resource_group);
 
-        if (priv->message_src != NULL) {
-                return;
-        }
+        response->resource->responses =
+                g_list_remove (response->resource->responses, response);
+
+        gssdp_timer_wheel_cancel (priv->response_wheel, &response->timer);
+        g_hash_table_remove (priv->pending_responses, response);
 
-        /* nothing in the queue: process message immediately
-           and add a timeout for (possible) next message */
-        process_queue (resource_group);
-        priv->message_src = g_timeout_source_new (priv->message_delay);
-        g_source_set_callback (priv->message_src,
-                               process_queue,
-                               resource_group,
-                               NULL);
-        g_source_attach (priv->message_src,
-                        g_main_context_get_thread_default ());
-        g_source_unref (priv->message_src);
+        g_free (response->dest_ip);
+        g_free (response->target);
+
+        g_slice_free (DiscoveryResponse, response);
 }
 
 /*
@@ -1061,34 +1911,21 @@ static void
 resource_alive (Resource *resource)
 {
         GSSDPResourceGroupPrivate *priv;
-        GSSDPClient *client;
-        guint max_age;
-        char *al, *message;
-
-        priv = gssdp_resource_group_get_instance_private
-                                        (resource->resource_group);
 
         /* Send initial byebye if not sent already */
         send_initial_resource_byebye (resource);
 
         /* Send message */
-        client = priv->client;
-
-        max_age = priv->max_age;
-
-        al = construct_al (resource);
-
-        message = g_strdup_printf (SSDP_ALIVE_MESSAGE,
-                                   max_age,
-                                   (char *) resource->locations->data,
-                                   al ? al : "",
-                                   gssdp_client_get_server_id (client),
-                                   resource->target,
-                                   resource->usn);
-
-        queue_message (resource->resource_group, message);
+        priv = gssdp_resource_group_get_instance_private
+                                        (resource->resource_group);
 
-        g_free (al);
+        ensure_messages (resource);
+        _gssdp_client_queue_message (priv->client,
+                                     GSSDP_PACER_PRIORITY_ALIVE,
+                                     resource->resource_group,
+                                     resource->id,
+                                     resource->alive_message);
+        priv->alives++;
 }
 
 /*
@@ -1097,14 +1934,26 @@ resource_alive (Resource *resource)
 static void
 resource_byebye (Resource *resource)
 {
-        char *message;
+        GSSDPResourceGroupPrivate *priv;
 
-        /* Queue message */
-        message = g_strdup_printf (SSDP_BYEBYE_MESSAGE,
-                                   resource->target,
-                                   resource->usn);
+        priv = gssdp_resource_group_get_instance_private
+                                        (resource->resource_group);
 
-        queue_message (resource->resource_group, message);
+        /* Byebyes overtake alives in the queue, so make sure no alive from
+         * before comes after this */
+        _gssdp_client_cancel_messages (priv->client,
+                                       GSSDP_PACER_PRIORITY_ALIVE,
+                                       resource->resource_group,
+                                       resource->id);
+
+        /* Queue message */
+        ensure_messages (resource);
+        _gssdp_client_queue_message (priv->client,
+                                     GSSDP_PACER_PRIORITY_BYEBYE,
+                                     resource->resource_group,
+                                     resource->id,
+                                     resource->byebye_message);
+        priv->byebyes++;
 }
 
 /*
@@ -1125,59 +1974,13 @@ resource_free (Resource *resource)
         if (priv->available)
                 resource_byebye (resource);
 
+        clear_messages (resource);
+
         g_free (resource->usn);
         g_free (resource->target);
 
-        g_clear_pointer (&resource->target_regex, g_regex_unref);
+        gssdp_target_clear (&resource->target_matcher);
         g_list_free_full (resource->locations, g_free);
 
         g_slice_free (Resource, resource);
 }
-
-/* Gets you the pointer to the version part in the target string */
-static char *
-get_version_for_target (char *target)
-{
-        char *version;
-
-        if (strncmp (target, "urn:", 4) != 0) {
-                /* target is not a URN so no version. */
-                return NULL;
-        }
-
-        version = g_strrstr (target, ":") + 1;
-        if (version == NULL ||
-            !g_regex_match_simple (VERSION_PATTERN, version, 0, 0))
-                return NULL;
-
-        return version;
-}
-
-static GRegex *
-create_target_regex (const char *target, guint *version, GError **error)
-{
-        GRegex *regex;
-        char *pattern;
-        char *version_str;
-
-        *version = 0;
-        /* Make sure we have enough room for version pattern */
-        pattern = g_strndup (target,
-                             strlen (target) + strlen (VERSION_PATTERN));
-
-        version_str = get_version_for_target (pattern);
-        if (version_str != NULL) {
-                /* version_str is now at : + 1 in the pattern string, so this
-                 * replaces the actual version with the number matching regex
-                 */
-                *version = atoi (version_str);
-                strcpy (version_str, VERSION_PATTERN);
-        }
-
-        regex = g_regex_new (pattern, 0, 0, error);
-
-        g_free (pattern);
-
-        return regex;
-}
-
@@ -73,6 +73,43 @@ gssdp_resource_group_set_message_delay         (GSSDPResourceGroup *resource_gro
 guint
 gssdp_resource_group_get_message_delay         (GSSDPResourceGroup *resource_group);
 
+void
+gssdp_resource_group_set_max_pending_responses (GSSDPResourceGroup *resource_group,
+                                                guint               max_pending_responses);
+
+guint
+gssdp_resource_group_get_max_pending_responses (GSSDPResourceGroup *resource_group);
+
+void
+gssdp_resource_group_set_max_mx                (GSSDPResourceGroup *resource_group,
+                                                guint               max_mx);
+
+guint
+gssdp_resource_group_get_max_mx                (GSSDPResourceGroup *resource_group);
+
+void
+gssdp_resource_group_set_search_rate           (GSSDPResourceGroup *resource_group,
+                                                guint               search_rate);
+
+guint
+gssdp_resource_group_get_search_rate           (GSSDPResourceGroup *resource_group);
+
+void
+gssdp_resource_group_set_search_burst          (GSSDPResourceGroup *resource_group,
+                                                guint               search_burst);
+
+guint
+gssdp_resource_group_get_search_burst          (GSSDPResourceGroup *resource_group);
+
+guint64
+gssdp_resource_group_get_dropped_searches      (GSSDPResourceGroup *resource_group);
+
+guint64
+gssdp_resource_group_get_dropped_responses     (GSSDPResourceGroup *resource_group);
+
+GVariant *
+gssdp_resource_group_get_statistics            (GSSDPResourceGroup *resource_group);
+
 guint
 gssdp_resource_group_add_resource        (GSSDPResourceGroup *resource_group,
                                           const char         *target,
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/*
+ * Bounded single-producer, single-consumer queue of pointers that hands data
+ * from one thread to another without taking a lock.
+ *
+ * The producer only ever writes the tail and the consumer only the head, both
+ * as free running counters that are masked on access. The atomic accesses
+ * are full barriers, so an element is written before the tail moving past it
+ * is visible, and read before the head moving past it is.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-ring.h"
+
+struct _GSSDPRing {
+        gpointer *elements;
+        guint     mask;
+
+        /* Next slot to read, only written by the consumer */
+        gint      head;
+
+        /* Next slot to write, only written by the producer */
+        gint      tail;
+};
+
+/*
+ * gssdp_ring_new:
+ * @capacity: Minimum number of elements the ring can hold. It is rounded up
+ * to the next power of two.
+ *
+ * Return value: A new, empty #GSSDPRing. Free it with gssdp_ring_free().
+ */
+GSSDPRing *
+gssdp_ring_new (guint capacity)
+{
+        GSSDPRing *ring;
+        guint size = 1;
+
+        g_return_val_if_fail (capacity > 0 && capacity <= G_MAXINT / 2, NULL);
+
+        while (size < capacity)
+                size <<= 1;
+
+        ring = g_slice_new (GSSDPRing);
+        ring->elements = g_new0 (gpointer, size);
+        ring->mask = size - 1;
+        ring->head = 0;
+        ring->tail = 0;
+
+        return ring;
+}
+
+/*
+ * Frees @ring. Elements still in it are not freed, the caller has to drain
+ * it first if needed. No thread may be using @ring any more.
+ */
+void
+gssdp_ring_free (GSSDPRing *ring)
+{
+        g_free (ring->elements);
+        g_slice_free (GSSDPRing, ring);
+}
+
+guint
+gssdp_ring_get_capacity (GSSDPRing *ring)
+{
+        return ring->mask + 1;
+}
+
+/*
+ * Appends @data to @ring. Must only be called from the producer thread.
+ *
+ * Return value: %FALSE if @ring is full and @data was not added.
+ */
+gboolean
+gssdp_ring_push (GSSDPRing *ring,
+                 gpointer   data)
+{
+        guint tail = (guint) ring->tail;
+        guint head = (guint) g_atomic_int_get (&ring->head);
+
+        if (tail - head > ring->mask)
+                return FALSE;
+
+        ring->elements[tail & ring->mask] = data;
+        g_atomic_int_set (&ring->tail, (gint) (tail + 1));
+
+        return TRUE;
+}
+
+/*
+ * Removes the oldest element from @ring. Must only be called from the
+ * consumer thread.
+ *
+ * Return value: The element, or %NULL if @ring is empty.
+ */
+gpointer
+gssdp_ring_pop (GSSDPRing *ring)
+{
+        guint head = (guint) ring->head;
+        guint tail = (guint) g_atomic_int_get (&ring->tail);
+        gpointer data;
+
+        if (head == tail)
+                return NULL;
+
+        data = ring->elements[head & ring->mask];
+        g_atomic_int_set (&ring->head, (gint) (head + 1));
+
+        return data;
+}
+
+/*
+ * Can be called from either thread. The answer might be outdated by the time
+ * it is returned, but an element pushed before is always seen.
+ */
+gboolean
+gssdp_ring_is_empty (GSSDPRing *ring)
+{
+        return g_atomic_int_get (&ring->head) ==
+               g_atomic_int_get (&ring->tail);
+}
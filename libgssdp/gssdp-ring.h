@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef GSSDP_RING_H
+#define GSSDP_RING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GSSDPRing GSSDPRing;
+
+G_GNUC_INTERNAL GSSDPRing *
+gssdp_ring_new          (guint      capacity);
+
+G_GNUC_INTERNAL void
+gssdp_ring_free         (GSSDPRing *ring);
+
+G_GNUC_INTERNAL guint
+gssdp_ring_get_capacity (GSSDPRing *ring);
+
+G_GNUC_INTERNAL gboolean
+gssdp_ring_push         (GSSDPRing *ring,
+                         gpointer   data);
+
+G_GNUC_INTERNAL gpointer
+gssdp_ring_pop          (GSSDPRing *ring);
+
+G_GNUC_INTERNAL gboolean
+gssdp_ring_is_empty     (GSSDPRing *ring);
+
+G_END_DECLS
+
+#endif /* GSSDP_RING_H */
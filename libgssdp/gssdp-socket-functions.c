@@ -26,6 +26,12 @@
 #include "gssdp-error.h"
 #include "gssdp-socket-functions.h"
 #include "gssdp-pktinfo-message.h"
+#ifdef HAVE_RXQ_OVFL
+#include "gssdp-overflow-message.h"
+#endif
+#ifdef HAVE_TIMESTAMPNS
+#include "gssdp-timestamp-message.h"
+#endif
 
 #include <errno.h>
 #include <string.h>
@@ -43,6 +49,11 @@
     #include <arpa/inet.h>
 #endif
 
+#ifdef __linux__
+    #include <net/if.h>
+    #include <linux/filter.h>
+#endif
+
 static char*
 gssdp_socket_error_message (int error) {
 #ifdef G_OS_WIN32
@@ -162,3 +173,315 @@ gssdp_socket_enable_info         (GSocket *socket,
     return TRUE;
 #endif
 }
+
+/*
+ * Makes the kernel tell how many datagrams @socket dropped because its
+ * receive buffer was full, see #GSSDPOverflowMessage.
+ */
+gboolean
+gssdp_socket_enable_overflow_info (GSocket *socket,
+                                   gboolean enable,
+                                   GError **error)
+{
+#ifdef HAVE_RXQ_OVFL
+        int value = enable;
+
+        /* Register the type so g_socket_control_message_deserialize() will
+         * find it */
+        g_type_ensure (GSSDP_TYPE_OVERFLOW_MESSAGE);
+
+        return gssdp_socket_option_set (socket,
+                                        SOL_SOCKET,
+                                        SO_RXQ_OVFL,
+                                        (char *) &value,
+                                        sizeof (value),
+                                        error);
+#else
+        __GSSDP_UNUSED (socket);
+        __GSSDP_UNUSED (enable);
+        __GSSDP_UNUSED (error);
+
+        return TRUE;
+#endif
+}
+
+/*
+ * Makes the kernel attach the time of receipt to every datagram read from
+ * @socket, see #GSSDPTimestampMessage.
+ */
+gboolean
+gssdp_socket_enable_timestamps (GSocket *socket,
+                                gboolean enable,
+                                GError **error)
+{
+#ifdef HAVE_TIMESTAMPNS
+        int value = enable;
+
+        /* Register the type so g_socket_control_message_deserialize() will
+         * find it */
+        g_type_ensure (GSSDP_TYPE_TIMESTAMP_MESSAGE);
+
+        return gssdp_socket_option_set (socket,
+                                        SOL_SOCKET,
+                                        SO_TIMESTAMPNS,
+                                        (char *) &value,
+                                        sizeof (value),
+                                        error);
+#else
+        __GSSDP_UNUSED (socket);
+        __GSSDP_UNUSED (enable);
+        __GSSDP_UNUSED (error);
+
+        return TRUE;
+#endif
+}
+
+/*
+ * Sets the receive buffer of @socket to @size bytes. The system limit for
+ * unprivileged processes is bypassed with SO_RCVBUFFORCE where that is
+ * permitted.
+ */
+gboolean
+gssdp_socket_set_receive_buffer_size (GSocket *socket,
+                                      guint    size,
+                                      GError **error)
+{
+        int value = (int) MIN (size, G_MAXINT / 2);
+
+#if defined(SO_RCVBUFFORCE)
+        {
+                int actual = 0;
+                socklen_t length = sizeof (actual);
+
+                if (!gssdp_socket_option_set (socket,
+                                              SOL_SOCKET,
+                                              SO_RCVBUF,
+                                              (char *) &value,
+                                              sizeof (value),
+                                              error))
+                        return FALSE;
+
+                /* Linux silently caps the size at net.core.rmem_max and
+                 * reports twice the usable size */
+                if (getsockopt (g_socket_get_fd (socket),
+                                SOL_SOCKET,
+                                SO_RCVBUF,
+                                &actual,
+                                &length) == 0 &&
+                    actual / 2 >= value)
+                        return TRUE;
+
+                /* Needs CAP_NET_ADMIN; a smaller buffer is better than
+                 * failing, so don't complain */
+                if (setsockopt (g_socket_get_fd (socket),
+                                SOL_SOCKET,
+                                SO_RCVBUFFORCE,
+                                &value,
+                                sizeof (value)) == -1)
+                        g_debug ("Receive buffer is limited to %d bytes",
+                                 actual / 2);
+
+                return TRUE;
+        }
+#else
+        return gssdp_socket_option_set (socket,
+                                        SOL_SOCKET,
+                                        SO_RCVBUF,
+                                        (char *) &value,
+                                        sizeof (value),
+                                        error);
+#endif
+}
+
+/*
+ * gssdp_socket_restrict_multicast:
+ * @socket: A #GSocket that joined a multicast group
+ * @error: Location for a #GError
+ *
+ * Makes the kernel only deliver multicast datagrams to @socket that belong to
+ * a group joined on @socket itself, for the interface it was joined on,
+ * instead of those for every group joined on the same port by anyone in the
+ * system. Datagrams for other addresses on that interface still arrive.
+ *
+ * Return value: %TRUE on success. This is only supported on Linux.
+ */
+gboolean
+gssdp_socket_restrict_multicast (GSocket *socket,
+                                 GError **error)
+{
+#if defined(__linux__) && defined(IP_MULTICAST_ALL)
+        int all = 0;
+
+        /* Memberships are per interface, and this does not need any
+         * privileges */
+        return gssdp_socket_option_set (socket,
+                                        IPPROTO_IP,
+                                        IP_MULTICAST_ALL,
+                                        &all,
+                                        sizeof (all),
+                                        error);
+#else
+        __GSSDP_UNUSED (socket);
+
+        g_set_error_literal (error,
+                             GSSDP_ERROR,
+                             GSSDP_ERROR_FAILED,
+                             "Restricting multicast is not supported");
+
+        return FALSE;
+#endif
+}
+
+/*
+ * gssdp_socket_bind_to_device:
+ * @socket: A #GSocket
+ * @device_name: The network interface to restrict @socket to
+ * @error: Location for a #GError
+ *
+ * Binds @socket to @device_name, so it only sees traffic received on that
+ * interface, whichever of its addresses it was for.
+ *
+ * Return value: %TRUE on success. This is only supported on Linux, and needs
+ * CAP_NET_RAW before Linux 5.7.
+ */
+gboolean
+gssdp_socket_bind_to_device (GSocket    *socket,
+                             const char *device_name,
+                             GError    **error)
+{
+#if defined(__linux__) && defined(SO_BINDTODEVICE)
+        char name[IFNAMSIZ];
+
+        if (device_name == NULL || strlen (device_name) >= IFNAMSIZ) {
+                g_set_error (error,
+                             GSSDP_ERROR,
+                             GSSDP_ERROR_FAILED,
+                             "Invalid device name: %s",
+                             device_name ? device_name : "(null)");
+
+                return FALSE;
+        }
+
+        memset (name, 0, sizeof (name));
+        strcpy (name, device_name);
+
+        return gssdp_socket_option_set (socket,
+                                        SOL_SOCKET,
+                                        SO_BINDTODEVICE,
+                                        name,
+                                        sizeof (name),
+                                        error);
+#else
+        __GSSDP_UNUSED (socket);
+        __GSSDP_UNUSED (device_name);
+
+        g_set_error_literal (error,
+                             GSSDP_ERROR,
+                             GSSDP_ERROR_FAILED,
+                             "Binding to a device is not supported");
+
+        return FALSE;
+#endif
+}
+
+#ifdef __linux__
+/* Start of the UDP payload as seen by a socket filter */
+#define FILTER_PAYLOAD_OFFSET 8
+
+#define FILTER_HTTP        0x48545450 /* "HTTP", case-sensitive */
+#define FILTER_LOWERCASE   0x20202020
+#define FILTER_NOTIFY      0x6e6f7469 /* "noti" */
+#define FILTER_SEARCH      0x6d2d7365 /* "m-se" */
+#endif
+
+/*
+ * gssdp_socket_set_filter:
+ * @socket: A #GSocket
+ * @enable: Whether to filter at all
+ * @accept: The kind of messages that should still reach @socket
+ * @error: Location for a #GError
+ *
+ * Attaches a kernel socket filter to @socket that drops every datagram which
+ * does not start like an SSDP message before it is copied to user space.
+ * Discovery requests are only passed on with %GSSDP_SOCKET_ACCEPT_REQUESTS,
+ * announcements and discovery responses only with
+ * %GSSDP_SOCKET_ACCEPT_TARGETS. A previously attached filter is replaced, or
+ * removed if @enable is %FALSE.
+ *
+ * This is a no-op on anything but Linux.
+ */
+gboolean
+gssdp_socket_set_filter (GSocket          *socket,
+                         gboolean          enable,
+                         GSSDPSocketAccept accept,
+                         GError          **error)
+{
+#ifdef __linux__
+        guint32 targets, requests;
+        int dummy = 0;
+
+        if (!enable) {
+                char *message;
+
+                /* Detaching fails with ENOENT if there is no filter, which is
+                 * just fine */
+                if (setsockopt (g_socket_get_fd (socket),
+                                SOL_SOCKET,
+                                SO_DETACH_FILTER,
+                                &dummy,
+                                sizeof (dummy)) != -1 || errno == ENOENT)
+                        return TRUE;
+
+                message = gssdp_socket_error_message (gssdp_socket_errno ());
+                g_set_error_literal (error,
+                                     GSSDP_ERROR,
+                                     GSSDP_ERROR_FAILED,
+                                     message);
+                g_free (message);
+
+                return FALSE;
+        }
+
+        targets = (accept & GSSDP_SOCKET_ACCEPT_TARGETS) ? 0xffffffff : 0;
+        requests = (accept & GSSDP_SOCKET_ACCEPT_REQUESTS) ? 0xffffffff : 0;
+
+        {
+                /* Looks at the first four bytes of the payload only. Finer
+                 * grained matching, e.g. on the NT header, would need to
+                 * search the datagram which classic BPF cannot do. */
+                struct sock_filter code[] = {
+                        BPF_STMT (BPF_LD | BPF_W | BPF_ABS,
+                                  FILTER_PAYLOAD_OFFSET),
+                        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K,
+                                  FILTER_HTTP, 3, 0),
+                        BPF_STMT (BPF_ALU | BPF_OR | BPF_K,
+                                  FILTER_LOWERCASE),
+                        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K,
+                                  FILTER_NOTIFY, 1, 0),
+                        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K,
+                                  FILTER_SEARCH, 1, 2),
+                        BPF_STMT (BPF_RET | BPF_K, targets),
+                        BPF_STMT (BPF_RET | BPF_K, requests),
+                        BPF_STMT (BPF_RET | BPF_K, 0),
+                };
+                struct sock_fprog program = {
+                        G_N_ELEMENTS (code),
+                        code
+                };
+
+                return gssdp_socket_option_set (socket,
+                                                SOL_SOCKET,
+                                                SO_ATTACH_FILTER,
+                                                &program,
+                                                sizeof (program),
+                                                error);
+        }
+#else
+        __GSSDP_UNUSED (socket);
+        __GSSDP_UNUSED (enable);
+        __GSSDP_UNUSED (accept);
+        __GSSDP_UNUSED (error);
+
+        return TRUE;
+#endif
+}
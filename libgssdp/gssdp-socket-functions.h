@@ -38,4 +38,39 @@ gssdp_socket_enable_info         (GSocket *socket,
                                   gboolean enable,
                                   GError **error);
 
+G_GNUC_INTERNAL gboolean
+gssdp_socket_enable_overflow_info (GSocket *socket,
+                                   gboolean enable,
+                                   GError **error);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_enable_timestamps   (GSocket *socket,
+                                  gboolean enable,
+                                  GError **error);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_set_receive_buffer_size (GSocket *socket,
+                                      guint    size,
+                                      GError **error);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_restrict_multicast  (GSocket    *socket,
+                                  GError    **error);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_bind_to_device      (GSocket    *socket,
+                                  const char *device_name,
+                                  GError    **error);
+
+typedef enum {
+        GSSDP_SOCKET_ACCEPT_REQUESTS = 1 << 0,
+        GSSDP_SOCKET_ACCEPT_TARGETS  = 1 << 1
+} GSSDPSocketAccept;
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_set_filter          (GSocket          *socket,
+                                  gboolean          enable,
+                                  GSSDPSocketAccept accept,
+                                  GError          **error);
+
 #endif
@@ -52,6 +52,16 @@ struct _GSSDPSocketSourcePrivate {
         char                 *device_name;
         guint                 ttl;
         guint                 port;
+
+        /* Whether the kernel only hands us traffic of our own interface */
+        gboolean              bound_to_device;
+
+        /* Datagrams the kernel dropped on a full receive buffer, as last
+         * reported by SO_RXQ_OVFL, see gssdp_socket_source_update_drops() */
+        gint                  drops;
+        guint32               drops_offset;
+        gint                  filtered;
+        gint                  drops_rebase;
 };
 typedef struct _GSSDPSocketSourcePrivate GSSDPSocketSourcePrivate;
 
@@ -238,6 +248,27 @@ gssdp_socket_source_do_init (GInitable                   *initable,
                 goto error;
         }
 
+        /* Only a diagnostic, so not being able to have it is fine */
+        if (!gssdp_socket_enable_timestamps (priv->socket,
+                                             TRUE,
+                                             &inner_error)) {
+                g_debug ("Failed to enable timestamps: %s",
+                         inner_error->message);
+                g_clear_error (&inner_error);
+        }
+
+#ifdef HAVE_RXQ_OVFL
+        /* Same here. The control message only comes along with datagrams
+         * once something was dropped. */
+        if (!gssdp_socket_enable_overflow_info (priv->socket,
+                                                TRUE,
+                                                &inner_error)) {
+                g_debug ("Failed to enable overflow info: %s",
+                         inner_error->message);
+                g_clear_error (&inner_error);
+        }
+#endif
+
         /* TTL */
         if (!priv->ttl)
                 /* UDA/1.0 says 4, UDA/1.1 says 2 */
@@ -327,6 +358,26 @@ gssdp_socket_source_do_init (GInitable                   *initable,
 
                         goto error;
                 }
+
+                /* Other interfaces' traffic is of no use to us, so don't
+                 * have it queued on this socket in the first place */
+                if (!gssdp_socket_restrict_multicast (priv->socket,
+                                                      &inner_error)) {
+                        g_debug ("Could not restrict multicast: %s",
+                                 inner_error->message);
+                        g_clear_error (&inner_error);
+                }
+
+                if (gssdp_socket_bind_to_device (priv->socket,
+                                                 priv->device_name,
+                                                 &inner_error)) {
+                        priv->bound_to_device = TRUE;
+                } else {
+                        g_debug ("Could not bind socket to %s: %s",
+                                 priv->device_name,
+                                 inner_error->message);
+                        g_clear_error (&inner_error);
+                }
         }
 
         priv->source = g_socket_create_source (priv->socket,
@@ -386,6 +437,108 @@ gssdp_socket_source_attach (GSSDPSocketSource *self)
                          g_main_context_get_thread_default ());
 }
 
+gboolean
+gssdp_socket_source_set_receive_buffer_size (GSSDPSocketSource *self,
+                                             guint              size,
+                                             GError           **error)
+{
+        GSSDPSocketSourcePrivate *priv;
+        g_return_val_if_fail (self != NULL, FALSE);
+        g_return_val_if_fail (GSSDP_IS_SOCKET_SOURCE (self), FALSE);
+        priv = gssdp_socket_source_get_instance_private (self);
+
+        return gssdp_socket_set_receive_buffer_size (priv->socket,
+                                                     size,
+                                                     error);
+}
+
+/*
+ * Records the drop counter the kernel reported along with a datagram. Only
+ * called from the thread reading the socket, which can be a different one
+ * than that of gssdp_socket_source_get_drops().
+ *
+ * The kernel counts datagrams rejected by the socket filter as dropped too.
+ * Those are no overflows, so the counter is ignored while a filter is
+ * attached, and afterwards only its growth from then on is added.
+ */
+void
+gssdp_socket_source_update_drops (GSSDPSocketSource *self,
+                                  guint32            drops)
+{
+        GSSDPSocketSourcePrivate *priv;
+        g_return_if_fail (self != NULL);
+        g_return_if_fail (GSSDP_IS_SOCKET_SOURCE (self));
+        priv = gssdp_socket_source_get_instance_private (self);
+
+        if (g_atomic_int_get (&priv->filtered))
+                return;
+
+        if (g_atomic_int_compare_and_exchange (&priv->drops_rebase,
+                                               TRUE,
+                                               FALSE))
+                priv->drops_offset = drops -
+                                     (guint32) g_atomic_int_get (&priv->drops);
+
+        g_atomic_int_set (&priv->drops, (gint) (drops - priv->drops_offset));
+}
+
+/*
+ * Returns the number of datagrams the kernel dropped for @self because its
+ * receive buffer was full, as far as it told us yet.
+ */
+guint32
+gssdp_socket_source_get_drops (GSSDPSocketSource *self)
+{
+        GSSDPSocketSourcePrivate *priv;
+        g_return_val_if_fail (self != NULL, 0);
+        g_return_val_if_fail (GSSDP_IS_SOCKET_SOURCE (self), 0);
+        priv = gssdp_socket_source_get_instance_private (self);
+
+        return (guint32) g_atomic_int_get (&priv->drops);
+}
+
+/*
+ * Returns %TRUE if the kernel only passes datagrams received on the network
+ * interface of @self on to it. They can still be for any address of that
+ * interface.
+ */
+gboolean
+gssdp_socket_source_is_bound_to_device (GSSDPSocketSource *self)
+{
+        GSSDPSocketSourcePrivate *priv;
+        g_return_val_if_fail (self != NULL, FALSE);
+        g_return_val_if_fail (GSSDP_IS_SOCKET_SOURCE (self), FALSE);
+        priv = gssdp_socket_source_get_instance_private (self);
+
+        return priv->bound_to_device;
+}
+
+/*
+ * Lets only datagrams of the kinds in @accept through to @self, see
+ * gssdp_socket_set_filter().
+ */
+gboolean
+gssdp_socket_source_set_filter (GSSDPSocketSource *self,
+                                gboolean           enable,
+                                GSSDPSocketAccept  accept,
+                                GError           **error)
+{
+        GSSDPSocketSourcePrivate *priv;
+        g_return_val_if_fail (self != NULL, FALSE);
+        g_return_val_if_fail (GSSDP_IS_SOCKET_SOURCE (self), FALSE);
+        priv = gssdp_socket_source_get_instance_private (self);
+
+        if (!gssdp_socket_set_filter (priv->socket, enable, accept, error))
+                return FALSE;
+
+        /* See gssdp_socket_source_update_drops() */
+        if (enable)
+                g_atomic_int_set (&priv->drops_rebase, TRUE);
+        g_atomic_int_set (&priv->filtered, enable);
+
+        return TRUE;
+}
+
 static void
 gssdp_socket_source_dispose (GObject *object)
 {
@@ -28,6 +28,8 @@
 
 #include <gio/gio.h>
 
+#include "gssdp-socket-functions.h"
+
 G_BEGIN_DECLS
 
 #define GSSDP_TYPE_SOCKET_SOURCE (gssdp_socket_source_get_type ())
@@ -62,6 +64,28 @@ gssdp_socket_source_set_callback (GSSDPSocketSource   *socket_source,
 G_GNUC_INTERNAL void
 gssdp_socket_source_attach       (GSSDPSocketSource   *socket_source);
 
+G_GNUC_INTERNAL gboolean
+gssdp_socket_source_set_receive_buffer_size
+                                 (GSSDPSocketSource   *socket_source,
+                                  guint                size,
+                                  GError             **error);
+
+G_GNUC_INTERNAL void
+gssdp_socket_source_update_drops (GSSDPSocketSource   *socket_source,
+                                  guint32              drops);
+
+G_GNUC_INTERNAL guint32
+gssdp_socket_source_get_drops    (GSSDPSocketSource   *socket_source);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_source_is_bound_to_device (GSSDPSocketSource *socket_source);
+
+G_GNUC_INTERNAL gboolean
+gssdp_socket_source_set_filter   (GSSDPSocketSource   *socket_source,
+                                  gboolean             enable,
+                                  GSSDPSocketAccept    accept,
+                                  GError             **error);
+
 G_END_DECLS
 
 #endif /* GSSDP_SOCKET_SOURCE_H */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-target.h"
+
+#include <string.h>
+
+/*
+ * Parses the decimal number making up all of @str. Returns %FALSE if @str is
+ * empty or contains anything but digits.
+ */
+static gboolean
+parse_version (const char *str, guint *version)
+{
+        guint64 value = 0;
+
+        if (*str == '\0')
+                return FALSE;
+
+        for (; *str != '\0'; str++) {
+                if (!g_ascii_isdigit (*str))
+                        return FALSE;
+
+                value = value * 10 + (*str - '0');
+                if (value > G_MAXUINT)
+                        value = G_MAXUINT;
+        }
+
+        *version = (guint) value;
+
+        return TRUE;
+}
+
+/*
+ * gssdp_target_prefix_length:
+ * @str: A target string
+ * @version: (out) (allow-none): Location for the version of @str
+ *
+ * Everything after the last colon of a target is taken as version if it is a
+ * number, unless that colon is the one of a plain "uuid:" target.
+ *
+ * Return value: The length of the part of @str before its version, including
+ * the colon, or the length of @str if it does not have a version.
+ */
+gsize
+gssdp_target_prefix_length (const char *str,
+                            guint      *version)
+{
+        const char *colon;
+        guint value;
+
+        colon = strrchr (str, ':');
+        if (colon != NULL &&
+            !(g_str_has_prefix (str, "uuid:") &&
+              colon == str + strlen ("uuid")) &&
+            parse_version (colon + 1, &value)) {
+                if (version != NULL)
+                        *version = value;
+
+                return colon + 1 - str;
+        }
+
+        if (version != NULL)
+                *version = 0;
+
+        return strlen (str);
+}
+
+/*
+ * gssdp_target_init:
+ * @target: The #GSSDPTarget to initialize
+ * @str: The target string
+ *
+ * Splits @str into its prefix and version, see gssdp_target_prefix_length().
+ */
+void
+gssdp_target_init (GSSDPTarget *target,
+                   const char  *str)
+{
+        target->prefix_len = gssdp_target_prefix_length (str,
+                                                         &target->version);
+        target->has_version = str[target->prefix_len] != '\0';
+        target->prefix = g_strndup (str, target->prefix_len);
+}
+
+void
+gssdp_target_clear (GSSDPTarget *target)
+{
+        g_clear_pointer (&target->prefix, g_free);
+}
+
+/*
+ * gssdp_target_match:
+ * @target: A #GSSDPTarget
+ * @str: An ST or NT header value
+ * @version: (out): Location for the version of @str
+ *
+ * Checks whether @str names the same target type as @target. If @target has a
+ * version, @str needs to have one as well but it may differ; it is stored in
+ * @version so the caller can apply its compatibility rules. Otherwise @str has
+ * to be equal to @target and @version is set to 0.
+ *
+ * Return value: %TRUE if @str matches @target
+ */
+gboolean
+gssdp_target_match (const GSSDPTarget *target,
+                    const char        *str,
+                    guint             *version)
+{
+        *version = 0;
+
+        if (strncmp (str, target->prefix, target->prefix_len) != 0)
+                return FALSE;
+
+        if (!target->has_version)
+                return str[target->prefix_len] == '\0';
+
+        return parse_version (str + target->prefix_len, version);
+}
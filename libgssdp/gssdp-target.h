@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_TARGET_H
+#define GSSDP_TARGET_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A search or notification target such as
+ * urn:schemas-upnp-org:device:MediaServer:2, split into the fixed part and
+ * the trailing version.
+ */
+typedef struct {
+        /* The target up to and including the colon before the version, or
+         * the whole target if it has no version */
+        char     *prefix;
+        gsize     prefix_len;
+
+        gboolean  has_version;
+        guint     version;
+} GSSDPTarget;
+
+G_GNUC_INTERNAL gsize
+gssdp_target_prefix_length (const char        *str,
+                            guint             *version);
+
+G_GNUC_INTERNAL void
+gssdp_target_init          (GSSDPTarget       *target,
+                            const char        *str);
+
+G_GNUC_INTERNAL void
+gssdp_target_clear         (GSSDPTarget       *target);
+
+G_GNUC_INTERNAL gboolean
+gssdp_target_match         (const GSSDPTarget *target,
+                            const char        *str,
+                            guint             *version);
+
+G_END_DECLS
+
+#endif /* GSSDP_TARGET_H */
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Hashed timer wheel driving any number of timers from a single GSource.
+ *
+ * Time is split into ticks, and a timer expiring at tick t lives in slot
+ * t % n_slots. Timers further away than one revolution simply stay in their
+ * slot until their tick has come. (Re)scheduling or cancelling a timer is a
+ * constant time list operation; the source only wakes up for ticks that have
+ * timers in their slot.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-timer-wheel.h"
+
+struct _GSSDPTimerWheel {
+        GSource source;
+
+        /* Length of a tick in microseconds */
+        gint64  tick;
+
+        GQueue *slots;
+        guint   n_slots;
+
+        /* Last tick that was processed */
+        gint64  current;
+
+        /* Earliest tick that might have an expired timer */
+        gint64  next;
+
+        guint   n_timers;
+};
+
+static gint64
+get_current_tick (GSSDPTimerWheel *wheel)
+{
+        return g_get_monotonic_time () / wheel->tick;
+}
+
+static void
+set_next_tick (GSSDPTimerWheel *wheel,
+               gint64           next)
+{
+        wheel->next = next;
+
+        if (next == G_MAXINT64)
+                g_source_set_ready_time ((GSource *) wheel, -1);
+        else
+                g_source_set_ready_time ((GSource *) wheel,
+                                         next * wheel->tick);
+}
+
+/* Finds the first slot after the current tick that holds a timer. The timers
+ * in it might be due in a later revolution, that just causes an early
+ * wake-up. */
+static void
+update_next_tick (GSSDPTimerWheel *wheel)
+{
+        guint i;
+
+        if (wheel->n_timers == 0) {
+                set_next_tick (wheel, G_MAXINT64);
+
+                return;
+        }
+
+        for (i = 1; i <= wheel->n_slots; i++) {
+                gint64 tick = wheel->current + i;
+
+                if (!g_queue_is_empty (&wheel->slots[tick % wheel->n_slots])) {
+                        set_next_tick (wheel, tick);
+
+                        return;
+                }
+        }
+
+        set_next_tick (wheel, G_MAXINT64);
+}
+
+static gboolean
+gssdp_timer_wheel_dispatch (GSource                  *source,
+                            G_GNUC_UNUSED GSourceFunc callback,
+                            G_GNUC_UNUSED gpointer    user_data)
+{
+        GSSDPTimerWheel *wheel = (GSSDPTimerWheel *) source;
+        GQueue expired = G_QUEUE_INIT;
+        gint64 now, tick, last;
+        GList *link;
+
+        now = get_current_tick (wheel);
+
+        /* After a long sleep looking at every slot once is enough */
+        last = MIN (now, wheel->current + wheel->n_slots);
+
+        for (tick = wheel->current + 1; tick <= last; tick++) {
+                GQueue *slot = &wheel->slots[tick % wheel->n_slots];
+
+                link = slot->head;
+                while (link != NULL) {
+                        GSSDPTimer *timer = link->data;
+                        GList *next = link->next;
+
+                        if (timer->expires <= now) {
+                                g_queue_unlink (slot, link);
+                                g_queue_push_tail_link (&expired, link);
+                                timer->queue = &expired;
+                        }
+
+                        link = next;
+                }
+        }
+
+        wheel->current = now;
+
+        /* Callbacks may cancel or reschedule any timer, including the ones
+         * that are about to be run */
+        while ((link = g_queue_pop_head_link (&expired)) != NULL) {
+                GSSDPTimer *timer = link->data;
+
+                timer->queue = NULL;
+                wheel->n_timers--;
+
+                timer->func (timer->user_data);
+
+                if (g_source_is_destroyed (source))
+                        break;
+        }
+
+        while ((link = g_queue_pop_head_link (&expired)) != NULL)
+                ((GSSDPTimer *) link->data)->queue = NULL;
+
+        if (!g_source_is_destroyed (source))
+                update_next_tick (wheel);
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+gssdp_timer_wheel_finalize (GSource *source)
+{
+        GSSDPTimerWheel *wheel = (GSSDPTimerWheel *) source;
+
+        g_free (wheel->slots);
+}
+
+static GSourceFuncs gssdp_timer_wheel_funcs = {
+        NULL,
+        NULL,
+        gssdp_timer_wheel_dispatch,
+        gssdp_timer_wheel_finalize,
+        NULL,
+        NULL
+};
+
+/*
+ * gssdp_timer_wheel_new:
+ * @tick: Resolution of the wheel in milliseconds
+ * @n_slots: Number of slots. Timers up to @tick * @n_slots in the future are
+ * spread over distinct slots.
+ *
+ * Return value: A new #GSSDPTimerWheel. Free it with
+ * gssdp_timer_wheel_destroy().
+ */
+GSSDPTimerWheel *
+gssdp_timer_wheel_new (guint tick,
+                       guint n_slots)
+{
+        GSSDPTimerWheel *wheel;
+        guint i;
+
+        g_return_val_if_fail (tick > 0, NULL);
+        g_return_val_if_fail (n_slots > 0, NULL);
+
+        wheel = (GSSDPTimerWheel *) g_source_new (&gssdp_timer_wheel_funcs,
+                                                  sizeof (GSSDPTimerWheel));
+        g_source_set_name ((GSource *) wheel, "GSSDPTimerWheel");
+
+        wheel->tick = (gint64) tick * 1000;
+        wheel->n_slots = n_slots;
+        wheel->slots = g_new (GQueue, n_slots);
+        for (i = 0; i < n_slots; i++)
+                g_queue_init (&wheel->slots[i]);
+
+        wheel->current = get_current_tick (wheel);
+        wheel->next = G_MAXINT64;
+        wheel->n_timers = 0;
+
+        return wheel;
+}
+
+void
+gssdp_timer_wheel_attach (GSSDPTimerWheel *wheel,
+                          GMainContext    *context)
+{
+        g_source_attach ((GSource *) wheel, context);
+}
+
+/*
+ * Stops @wheel and frees it. Timers still scheduled on it are not run; their
+ * owners must not cancel them afterwards.
+ */
+void
+gssdp_timer_wheel_destroy (GSSDPTimerWheel *wheel)
+{
+        g_source_destroy ((GSource *) wheel);
+        g_source_unref ((GSource *) wheel);
+}
+
+void
+gssdp_timer_init (GSSDPTimer     *timer,
+                  GSSDPTimerFunc  func,
+                  gpointer        user_data)
+{
+        timer->link.data = timer;
+        timer->link.prev = NULL;
+        timer->link.next = NULL;
+        timer->queue = NULL;
+        timer->expires = 0;
+        timer->func = func;
+        timer->user_data = user_data;
+}
+
+/*
+ * Schedules @timer to run @timeout milliseconds from now, replacing its
+ * previous deadline if it was already pending. The timer may run up to one
+ * tick late.
+ */
+void
+gssdp_timer_wheel_schedule (GSSDPTimerWheel *wheel,
+                            GSSDPTimer      *timer,
+                            guint            timeout)
+{
+        gint64 expires;
+
+        gssdp_timer_wheel_cancel (wheel, timer);
+
+        expires = (g_get_monotonic_time () + (gint64) timeout * 1000 +
+                   wheel->tick - 1) / wheel->tick;
+        if (expires <= wheel->current)
+                expires = wheel->current + 1;
+
+        timer->expires = expires;
+        timer->queue = &wheel->slots[expires % wheel->n_slots];
+        g_queue_push_tail_link (timer->queue, &timer->link);
+        wheel->n_timers++;
+
+        if (expires < wheel->next)
+                set_next_tick (wheel, expires);
+}
+
+void
+gssdp_timer_wheel_cancel (GSSDPTimerWheel *wheel,
+                          GSSDPTimer      *timer)
+{
+        if (timer->queue == NULL)
+                return;
+
+        g_queue_unlink (timer->queue, &timer->link);
+        timer->queue = NULL;
+        wheel->n_timers--;
+}
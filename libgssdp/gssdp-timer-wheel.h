@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_TIMER_WHEEL_H
+#define GSSDP_TIMER_WHEEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GSSDPTimerWheel GSSDPTimerWheel;
+
+typedef void (* GSSDPTimerFunc) (gpointer user_data);
+
+/*
+ * A timer that can be scheduled on a #GSSDPTimerWheel. It is meant to be
+ * embedded into the structure it belongs to, so scheduling it does not
+ * allocate anything.
+ */
+typedef struct {
+        GList          link;
+        GQueue        *queue;
+        gint64         expires;
+        GSSDPTimerFunc func;
+        gpointer       user_data;
+} GSSDPTimer;
+
+G_GNUC_INTERNAL GSSDPTimerWheel *
+gssdp_timer_wheel_new      (guint            tick,
+                            guint            n_slots);
+
+G_GNUC_INTERNAL void
+gssdp_timer_wheel_attach   (GSSDPTimerWheel *wheel,
+                            GMainContext    *context);
+
+G_GNUC_INTERNAL void
+gssdp_timer_wheel_destroy  (GSSDPTimerWheel *wheel);
+
+G_GNUC_INTERNAL void
+gssdp_timer_init           (GSSDPTimer      *timer,
+                            GSSDPTimerFunc   func,
+                            gpointer         user_data);
+
+G_GNUC_INTERNAL void
+gssdp_timer_wheel_schedule (GSSDPTimerWheel *wheel,
+                            GSSDPTimer      *timer,
+                            guint            timeout);
+
+G_GNUC_INTERNAL void
+gssdp_timer_wheel_cancel   (GSSDPTimerWheel *wheel,
+                            GSSDPTimer      *timer);
+
+static inline gboolean
+gssdp_timer_is_pending     (GSSDPTimer      *timer)
+{
+        return timer->queue != NULL;
+}
+
+G_END_DECLS
+
+#endif /* GSSDP_TIMER_WHEEL_H */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * SO_TIMESTAMPNS control message, carrying the wall clock time at which the
+ * kernel received a datagram. The nanoseconds are cut down to microseconds,
+ * like everything else in GLib.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-timestamp-message.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+struct _GSSDPTimestampMessage {
+        GSocketControlMessage parent;
+
+        gint64                time;
+};
+
+struct _GSSDPTimestampMessageClass {
+        GSocketControlMessageClass parent_class;
+};
+
+G_DEFINE_TYPE (GSSDPTimestampMessage,
+               gssdp_timestamp_message,
+               G_TYPE_SOCKET_CONTROL_MESSAGE)
+
+enum {
+        PROP_0,
+        PROP_TIME
+};
+
+static gsize
+gssdp_timestamp_message_get_size (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return sizeof (struct timespec);
+}
+
+static int
+gssdp_timestamp_message_get_level (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return SOL_SOCKET;
+}
+
+static int
+gssdp_timestamp_message_get_msg_type (G_GNUC_UNUSED GSocketControlMessage *msg)
+{
+        return SCM_TIMESTAMPNS;
+}
+
+static void
+gssdp_timestamp_message_serialize (GSocketControlMessage *msg,
+                                   gpointer               data)
+{
+        GSSDPTimestampMessage *self = GSSDP_TIMESTAMP_MESSAGE (msg);
+        struct timespec ts;
+
+        ts.tv_sec = self->time / G_USEC_PER_SEC;
+        ts.tv_nsec = (self->time % G_USEC_PER_SEC) * 1000;
+
+        memcpy (data, &ts, sizeof (struct timespec));
+}
+
+static GSocketControlMessage *
+gssdp_timestamp_message_deserialize (int      level,
+                                     int      type,
+                                     gsize    size,
+                                     gpointer data)
+{
+        struct timespec ts;
+
+        if (level != SOL_SOCKET ||
+            type != SCM_TIMESTAMPNS ||
+            size < sizeof (struct timespec))
+                return NULL;
+
+        memcpy (&ts, data, sizeof (struct timespec));
+
+        return gssdp_timestamp_message_new ((gint64) ts.tv_sec *
+                                            G_USEC_PER_SEC +
+                                            ts.tv_nsec / 1000);
+}
+
+static void
+gssdp_timestamp_message_get_property (GObject    *object,
+                                      guint       property_id,
+                                      GValue     *value,
+                                      GParamSpec *pspec)
+{
+        GSSDPTimestampMessage *self = GSSDP_TIMESTAMP_MESSAGE (object);
+
+        switch (property_id)
+        {
+        case PROP_TIME:
+                g_value_set_int64 (value, self->time);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+                break;
+        }
+}
+
+static void
+gssdp_timestamp_message_set_property (GObject      *object,
+                                      guint         property_id,
+                                      const GValue *value,
+                                      GParamSpec   *pspec)
+{
+        GSSDPTimestampMessage *self = GSSDP_TIMESTAMP_MESSAGE (object);
+
+        switch (property_id)
+        {
+        case PROP_TIME:
+                self->time = g_value_get_int64 (value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+                break;
+        }
+}
+
+static void
+gssdp_timestamp_message_init (G_GNUC_UNUSED GSSDPTimestampMessage *self)
+{
+}
+
+static void
+gssdp_timestamp_message_class_init (GSSDPTimestampMessageClass *klass)
+{
+        GSocketControlMessageClass *scm_class =
+                G_SOCKET_CONTROL_MESSAGE_CLASS (klass);
+
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        scm_class->get_size = gssdp_timestamp_message_get_size;
+        scm_class->get_level = gssdp_timestamp_message_get_level;
+        scm_class->get_type = gssdp_timestamp_message_get_msg_type;
+        scm_class->serialize = gssdp_timestamp_message_serialize;
+        scm_class->deserialize = gssdp_timestamp_message_deserialize;
+
+        object_class->get_property = gssdp_timestamp_message_get_property;
+        object_class->set_property = gssdp_timestamp_message_set_property;
+
+        g_object_class_install_property
+                (object_class,
+                 PROP_TIME,
+                 g_param_spec_int64 ("time",
+                                     "time",
+                                     "Wall clock time of receipt in "
+                                     "microseconds",
+                                     0,
+                                     G_MAXINT64,
+                                     0,
+                                     G_PARAM_READWRITE |
+                                     G_PARAM_CONSTRUCT |
+                                     G_PARAM_STATIC_STRINGS));
+}
+
+GSocketControlMessage *
+gssdp_timestamp_message_new (gint64 time)
+{
+        return G_SOCKET_CONTROL_MESSAGE (
+                g_object_new (GSSDP_TYPE_TIMESTAMP_MESSAGE,
+                              "time", time,
+                              NULL));
+}
+
+gint64
+gssdp_timestamp_message_get_time (GSSDPTimestampMessage *message)
+{
+        g_return_val_if_fail (GSSDP_IS_TIMESTAMP_MESSAGE (message), 0);
+
+        return message->time;
+}
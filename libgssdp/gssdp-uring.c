@@ -0,0 +1,681 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * io_uring based replacement for the poll sources of GSSDPSocketSource.
+ *
+ * Every socket gets one multishot recvmsg that keeps picking buffers from a
+ * ring shared by all sockets, so a datagram costs neither a poll wake-up nor
+ * a recvmsg call of its own. Sends are queued up while the main context
+ * dispatches and handed to the kernel together right before it goes back to
+ * sleep. Completions are signalled on an eventfd, which is the only thing the
+ * main context polls.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-uring.h"
+#include "gssdp-error.h"
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Submission queue entries; sends beyond that are submitted early */
+#define QUEUE_DEPTH 256
+
+/* Receive buffers shared by all sockets. Each one holds the headers the
+ * kernel writes in front of a datagram, so the largest datagram that can be
+ * received is somewhat smaller than BUFFER_SIZE. */
+#define BUFFER_GROUP 0
+#define N_BUFFERS 128
+#define BUFFER_SIZE 8192
+
+/* Room for IP_PKTINFO, SO_RXQ_OVFL and SO_TIMESTAMPNS */
+#define CONTROL_SIZE 256
+
+/* Control messages passed on per datagram */
+#define MAX_CONTROL_MESSAGES 8
+
+typedef enum {
+        OP_RECEIVE,
+        OP_SEND
+} OpKind;
+
+typedef struct {
+        OpKind              kind;
+        GSSDPSocketSource  *socket_source;
+        int                 fd;
+        struct msghdr       msg;
+        GSSDPUringRecvFunc  func;
+        gpointer            user_data;
+} ReceiveOp;
+
+typedef struct {
+        OpKind                  kind;
+        gsize                  *sent_count;
+        gsize                  *error_count;
+        struct msghdr           msg;
+        struct iovec            iov;
+        struct sockaddr_storage address;
+        char                    data[];
+} SendOp;
+
+struct _GSSDPUring {
+        GSource                  source;
+
+        struct io_uring          ring;
+        gboolean                 have_ring;
+        struct io_uring_buf_ring *buf_ring;
+        char                    *buffers;
+        int                      event_fd;
+
+        GPtrArray               *receivers;
+        guint                    pending_sends;
+        gboolean                 closing;
+
+        guint64                  wakeups;
+        guint64                  datagrams;
+
+        GSSDPDiagnostics        *diagnostics;
+};
+
+static void
+receive_op_free (ReceiveOp *op)
+{
+        g_object_unref (op->socket_source);
+        g_free (op);
+}
+
+static struct io_uring_sqe *
+get_sqe (GSSDPUring *uring)
+{
+        struct io_uring_sqe *sqe;
+
+        sqe = io_uring_get_sqe (&uring->ring);
+        if (sqe == NULL) {
+                /* Queue is full, hand what is in it to the kernel */
+                io_uring_submit (&uring->ring);
+                sqe = io_uring_get_sqe (&uring->ring);
+        }
+
+        return sqe;
+}
+
+static gboolean
+arm_receive (GSSDPUring *uring,
+             ReceiveOp  *op)
+{
+        struct io_uring_sqe *sqe;
+
+        sqe = get_sqe (uring);
+        if (sqe == NULL)
+                return FALSE;
+
+        io_uring_prep_recvmsg_multishot (sqe, op->fd, &op->msg, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        io_uring_sqe_set_data (sqe, op);
+
+        return TRUE;
+}
+
+static void
+recycle_buffer (GSSDPUring *uring,
+                guint16     bid)
+{
+        /* One byte less than there is, so the receiver can terminate the
+         * payload in place */
+        io_uring_buf_ring_add (uring->buf_ring,
+                               uring->buffers + (gsize) bid * BUFFER_SIZE,
+                               BUFFER_SIZE - 1,
+                               bid,
+                               io_uring_buf_ring_mask (N_BUFFERS),
+                               0);
+        io_uring_buf_ring_advance (uring->buf_ring, 1);
+}
+
+static void
+deliver_datagram (GSSDPUring *uring,
+                  ReceiveOp  *op,
+                  char       *buf,
+                  gsize       length)
+{
+        struct io_uring_recvmsg_out *out;
+        struct cmsghdr *cmsg;
+        GSocketControlMessage *messages[MAX_CONTROL_MESSAGES];
+        GSocketAddress *address;
+        guint n_messages = 0, i;
+        char *payload;
+
+        out = io_uring_recvmsg_validate (buf, length, &op->msg);
+        if (out == NULL)
+                return;
+
+        if (out->flags & MSG_TRUNC) {
+                g_debug ("Dropping datagram larger than %d bytes",
+                         BUFFER_SIZE);
+
+                return;
+        }
+
+        address = g_socket_address_new_from_native
+                                (io_uring_recvmsg_name (out),
+                                 MIN (out->namelen, op->msg.msg_namelen));
+        if (address == NULL)
+                return;
+
+        for (cmsg = io_uring_recvmsg_cmsg_firsthdr (out, &op->msg);
+             cmsg != NULL;
+             cmsg = io_uring_recvmsg_cmsg_nexthdr (out, &op->msg, cmsg)) {
+                GSocketControlMessage *message;
+
+                message = g_socket_control_message_deserialize
+                                        (cmsg->cmsg_level,
+                                         cmsg->cmsg_type,
+                                         cmsg->cmsg_len - CMSG_LEN (0),
+                                         CMSG_DATA (cmsg));
+                if (message == NULL)
+                        continue;
+
+                if (n_messages < MAX_CONTROL_MESSAGES)
+                        messages[n_messages++] = message;
+                else
+                        g_object_unref (message);
+        }
+
+        payload = io_uring_recvmsg_payload (out, &op->msg);
+        uring->datagrams++;
+
+        op->func (op->socket_source,
+                  payload,
+                  io_uring_recvmsg_payload_length (out, length, &op->msg),
+                  address,
+                  messages,
+                  n_messages,
+                  op->user_data);
+
+        for (i = 0; i < n_messages; i++)
+                g_object_unref (messages[i]);
+        g_object_unref (address);
+}
+
+static void
+complete_receive (GSSDPUring *uring,
+                  ReceiveOp  *op,
+                  gint        res,
+                  guint       flags)
+{
+        if (flags & IORING_CQE_F_BUFFER) {
+                guint16 bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+                if (res >= 0 && !uring->closing)
+                        deliver_datagram (uring,
+                                          op,
+                                          uring->buffers +
+                                          (gsize) bid * BUFFER_SIZE,
+                                          res);
+
+                recycle_buffer (uring, bid);
+        }
+
+        if (flags & IORING_CQE_F_MORE || uring->closing)
+                return;
+
+        /* Running out of buffers ends the multishot receive, but they have
+         * been given back by now. Like the poll based receive, carry on
+         * after other errors too, unless the request itself is broken and
+         * would only fail again right away. */
+        if (res < 0 && res != -ENOBUFS) {
+                gssdp_diagnostic (uring->diagnostics,
+                                  GSSDP_DIAGNOSTIC_RECEIVE_ERROR,
+                                  NULL,
+                                  NULL,
+                                  "Failed to receive from socket: %s",
+                                  g_strerror (-res));
+
+                if (res == -EINVAL || res == -EBADF || res == -ENOTSOCK)
+                        return;
+        }
+
+        arm_receive (uring, op);
+}
+
+static void
+complete_send (GSSDPUring *uring,
+               SendOp     *op,
+               gint        res)
+{
+        if (res < 0) {
+                g_atomic_pointer_add (op->error_count, 1);
+                gssdp_diagnostic (uring->diagnostics,
+                                  GSSDP_DIAGNOSTIC_SEND_ERROR,
+                                  NULL,
+                                  NULL,
+                                  "Error sending SSDP packet: %s",
+                                  g_strerror (-res));
+        } else {
+                g_atomic_pointer_add (op->sent_count, 1);
+        }
+
+        uring->pending_sends--;
+        g_free (op);
+}
+
+static void
+process_completions (GSSDPUring *uring)
+{
+        struct io_uring_cqe *cqe;
+
+        while (io_uring_peek_cqe (&uring->ring, &cqe) == 0) {
+                gpointer data = io_uring_cqe_get_data (cqe);
+                gint res = cqe->res;
+                guint flags = cqe->flags;
+
+                /* Callbacks may queue sends, which might need the room */
+                io_uring_cqe_seen (&uring->ring, cqe);
+
+                if (*(OpKind *) data == OP_RECEIVE)
+                        complete_receive (uring, data, res, flags);
+                else
+                        complete_send (uring, data, res);
+        }
+}
+
+/*
+ * Multishot recvmsg only came with Linux 6.0, while provided buffer rings are
+ * in 5.19 already. Older kernels reject the request as soon as it is
+ * submitted, so try one on a socket nothing is ever sent to and cancel it
+ * again.
+ *
+ * Returns: 0 if multishot receives work, a negative errno otherwise
+ */
+static int
+probe_multishot_receive (GSSDPUring *uring)
+{
+        struct io_uring_sqe *sqe;
+        struct io_uring_cqe *cqe;
+        struct msghdr msg;
+        int fd, ret, i;
+
+        fd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        memset (&msg, 0, sizeof (msg));
+
+        /* The ring is still empty, so there is room for both */
+        sqe = io_uring_get_sqe (&uring->ring);
+        io_uring_prep_recvmsg_multishot (sqe, fd, &msg, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        io_uring_sqe_set_data64 (sqe, 1);
+
+        sqe = io_uring_get_sqe (&uring->ring);
+        io_uring_prep_cancel64 (sqe, 1, 0);
+        io_uring_sqe_set_data64 (sqe, 2);
+
+        ret = io_uring_submit (&uring->ring);
+        if (ret < 0) {
+                close (fd);
+
+                return ret;
+        }
+
+        /* Either way, the receive and the cancel complete once each */
+        ret = 0;
+        for (i = 0; i < 2; i++) {
+                int res = io_uring_wait_cqe (&uring->ring, &cqe);
+
+                if (res < 0) {
+                        ret = res;
+
+                        break;
+                }
+
+                if (io_uring_cqe_get_data64 (cqe) == 1 &&
+                    cqe->res < 0 &&
+                    cqe->res != -ECANCELED)
+                        ret = cqe->res;
+
+                io_uring_cqe_seen (&uring->ring, cqe);
+        }
+
+        close (fd);
+
+        return ret;
+}
+
+static gboolean
+gssdp_uring_prepare (GSource *source,
+                     gint    *timeout)
+{
+        GSSDPUring *uring = (GSSDPUring *) source;
+
+        *timeout = -1;
+
+        /* Everything queued during this iteration goes out in one go */
+        if (io_uring_sq_ready (&uring->ring) > 0)
+                io_uring_submit (&uring->ring);
+
+        return io_uring_cq_ready (&uring->ring) > 0;
+}
+
+static gboolean
+gssdp_uring_dispatch (GSource                  *source,
+                      G_GNUC_UNUSED GSourceFunc callback,
+                      G_GNUC_UNUSED gpointer    user_data)
+{
+        GSSDPUring *uring = (GSSDPUring *) source;
+        guint64 datagrams = uring->datagrams;
+        guint64 value;
+
+        /* Completions arriving after this signal the eventfd again */
+        if (read (uring->event_fd, &value, sizeof (value)) < 0 &&
+            errno != EAGAIN)
+                g_warning ("Failed to read eventfd: %s", g_strerror (errno));
+
+        process_completions (uring);
+
+        if (uring->datagrams != datagrams)
+                uring->wakeups++;
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+gssdp_uring_finalize (GSource *source)
+{
+        GSSDPUring *uring = (GSSDPUring *) source;
+
+        if (uring->buf_ring != NULL)
+                io_uring_free_buf_ring (&uring->ring,
+                                        uring->buf_ring,
+                                        N_BUFFERS,
+                                        BUFFER_GROUP);
+
+        /* Cancels the receives, which keep pointing into uring->receivers
+         * until then */
+        if (uring->have_ring)
+                io_uring_queue_exit (&uring->ring);
+
+        if (uring->event_fd >= 0)
+                close (uring->event_fd);
+
+        g_ptr_array_unref (uring->receivers);
+        g_free (uring->buffers);
+}
+
+static GSourceFuncs gssdp_uring_funcs = {
+        gssdp_uring_prepare,
+        NULL,
+        gssdp_uring_dispatch,
+        gssdp_uring_finalize,
+        NULL,
+        NULL
+};
+
+/*
+ * gssdp_uring_new:
+ * @diagnostics: Where to report send and receive errors. Has to outlive the
+ * ring.
+ * @error: Location to store error, or %NULL
+ *
+ * Sets up an io_uring along with its receive buffers. This fails on kernels
+ * that are too old for provided buffer rings or multishot receives.
+ *
+ * Return value: A new #GSSDPUring, or %NULL. Free it with gssdp_uring_free().
+ */
+GSSDPUring *
+gssdp_uring_new (GSSDPDiagnostics  *diagnostics,
+                 GError           **error)
+{
+        GSSDPUring *uring;
+        const char *what;
+        guint16 i;
+        int ret;
+
+        uring = (GSSDPUring *) g_source_new (&gssdp_uring_funcs,
+                                             sizeof (GSSDPUring));
+        g_source_set_name ((GSource *) uring, "GSSDPUring");
+
+        uring->have_ring = FALSE;
+        uring->buf_ring = NULL;
+        uring->buffers = NULL;
+        uring->event_fd = -1;
+        uring->receivers = g_ptr_array_new_with_free_func
+                                        ((GDestroyNotify) receive_op_free);
+        uring->pending_sends = 0;
+        uring->closing = FALSE;
+        uring->wakeups = 0;
+        uring->datagrams = 0;
+        uring->diagnostics = diagnostics;
+
+        what = "set up io_uring";
+        ret = io_uring_queue_init (QUEUE_DEPTH, &uring->ring, 0);
+        if (ret < 0)
+                goto fail;
+        uring->have_ring = TRUE;
+
+        what = "set up receive buffers";
+        uring->buf_ring = io_uring_setup_buf_ring (&uring->ring,
+                                                   N_BUFFERS,
+                                                   BUFFER_GROUP,
+                                                   0,
+                                                   &ret);
+        if (uring->buf_ring == NULL)
+                goto fail;
+
+        uring->buffers = g_malloc ((gsize) N_BUFFERS * BUFFER_SIZE);
+        for (i = 0; i < N_BUFFERS; i++)
+                recycle_buffer (uring, i);
+
+        what = "receive with multishot requests";
+        ret = probe_multishot_receive (uring);
+        if (ret < 0)
+                goto fail;
+
+        what = "create eventfd";
+        uring->event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (uring->event_fd < 0) {
+                ret = -errno;
+
+                goto fail;
+        }
+
+        what = "register eventfd";
+        ret = io_uring_register_eventfd (&uring->ring, uring->event_fd);
+        if (ret < 0)
+                goto fail;
+
+        g_source_add_unix_fd ((GSource *) uring, uring->event_fd, G_IO_IN);
+
+        return uring;
+
+fail:
+        g_set_error (error,
+                     GSSDP_ERROR,
+                     GSSDP_ERROR_FAILED,
+                     "Failed to %s: %s",
+                     what,
+                     g_strerror (-ret));
+        g_source_unref ((GSource *) uring);
+
+        return NULL;
+}
+
+void
+gssdp_uring_attach (GSSDPUring   *uring,
+                    GMainContext *context)
+{
+        g_source_attach ((GSource *) uring, context);
+}
+
+/*
+ * Starts receiving on @socket_source. @func is called on the context @uring
+ * is attached to for every datagram, instead of the callback set on
+ * @socket_source, which must not be attached itself.
+ */
+gboolean
+gssdp_uring_add_socket (GSSDPUring         *uring,
+                        GSSDPSocketSource  *socket_source,
+                        GSSDPUringRecvFunc  func,
+                        gpointer            user_data,
+                        GError            **error)
+{
+        ReceiveOp *op;
+
+        op = g_new0 (ReceiveOp, 1);
+        op->kind = OP_RECEIVE;
+        op->socket_source = g_object_ref (socket_source);
+        op->fd = g_socket_get_fd
+                        (gssdp_socket_source_get_socket (socket_source));
+        op->func = func;
+        op->user_data = user_data;
+
+        /* For multishot receives only the lengths matter; the kernel puts
+         * address and control messages into the buffer */
+        op->msg.msg_namelen = sizeof (struct sockaddr_storage);
+        op->msg.msg_controllen = CONTROL_SIZE;
+
+        if (!arm_receive (uring, op)) {
+                g_set_error_literal (error,
+                                     GSSDP_ERROR,
+                                     GSSDP_ERROR_FAILED,
+                                     "io_uring submission queue is full");
+                receive_op_free (op);
+
+                return FALSE;
+        }
+
+        g_ptr_array_add (uring->receivers, op);
+
+        return TRUE;
+}
+
+/*
+ * Queues the concatenation of @vectors to be sent to @address on @socket.
+ * The data is copied, and goes out with everything else queued before the
+ * main context polls the next time. Errors are only reported on completion,
+ * as warnings. Only then @sent_count or @error_count is incremented, which
+ * have to stay around until @uring is freed.
+ */
+gboolean
+gssdp_uring_send (GSSDPUring          *uring,
+                  GSocket             *socket,
+                  GSocketAddress      *address,
+                  const GOutputVector *vectors,
+                  guint                n_vectors,
+                  gsize               *sent_count,
+                  gsize               *error_count,
+                  GError             **error)
+{
+        struct io_uring_sqe *sqe;
+        SendOp *op;
+        gsize size = 0;
+        guint i;
+
+        for (i = 0; i < n_vectors; i++)
+                size += vectors[i].size;
+
+        op = g_malloc0 (sizeof (SendOp) + size);
+        op->kind = OP_SEND;
+        op->sent_count = sent_count;
+        op->error_count = error_count;
+
+        if (!g_socket_address_to_native (address,
+                                         &op->address,
+                                         sizeof (op->address),
+                                         error)) {
+                g_free (op);
+
+                return FALSE;
+        }
+
+        size = 0;
+        for (i = 0; i < n_vectors; i++) {
+                memcpy (op->data + size, vectors[i].buffer, vectors[i].size);
+                size += vectors[i].size;
+        }
+
+        op->iov.iov_base = op->data;
+        op->iov.iov_len = size;
+        op->msg.msg_name = &op->address;
+        op->msg.msg_namelen = g_socket_address_get_native_size (address);
+        op->msg.msg_iov = &op->iov;
+        op->msg.msg_iovlen = 1;
+
+        sqe = get_sqe (uring);
+        if (sqe == NULL) {
+                g_set_error_literal (error,
+                                     GSSDP_ERROR,
+                                     GSSDP_ERROR_FAILED,
+                                     "io_uring submission queue is full");
+                g_free (op);
+
+                return FALSE;
+        }
+
+        io_uring_prep_sendmsg (sqe, g_socket_get_fd (socket), &op->msg, 0);
+        io_uring_sqe_set_data (sqe, op);
+        uring->pending_sends++;
+
+        return TRUE;
+}
+
+/*
+ * Returns the number of dispatches that received anything and the number of
+ * datagrams received in total.
+ */
+void
+gssdp_uring_get_stats (GSSDPUring *uring,
+                       guint64    *wakeups,
+                       guint64    *datagrams)
+{
+        *wakeups = uring->wakeups;
+        *datagrams = uring->datagrams;
+}
+
+/*
+ * Sends whatever is still queued, waiting for it, and frees @uring. The
+ * sockets are not read any more from then on.
+ */
+void
+gssdp_uring_free (GSSDPUring *uring)
+{
+        uring->closing = TRUE;
+        g_source_destroy ((GSource *) uring);
+
+        while (uring->pending_sends > 0) {
+                struct io_uring_cqe *cqe;
+
+                io_uring_submit (&uring->ring);
+                if (io_uring_wait_cqe (&uring->ring, &cqe) < 0)
+                        break;
+
+                process_completions (uring);
+        }
+
+        g_source_unref ((GSource *) uring);
+}
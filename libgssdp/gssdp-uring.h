@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_URING_H
+#define GSSDP_URING_H
+
+#include <gio/gio.h>
+
+#include "gssdp-socket-source.h"
+#include "gssdp-diagnostics.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GSSDPUring GSSDPUring;
+
+/*
+ * Called for every datagram received on a socket added with
+ * gssdp_uring_add_socket(). @buf is only valid during the call, but has room
+ * for one more byte after @length so it can be terminated in place.
+ * @address and @messages are owned by the caller.
+ */
+typedef void (* GSSDPUringRecvFunc) (GSSDPSocketSource      *socket_source,
+                                     char                   *buf,
+                                     gsize                   length,
+                                     GSocketAddress         *address,
+                                     GSocketControlMessage **messages,
+                                     guint                   num_messages,
+                                     gpointer                user_data);
+
+G_GNUC_INTERNAL GSSDPUring *
+gssdp_uring_new        (GSSDPDiagnostics       *diagnostics,
+                        GError                **error);
+
+G_GNUC_INTERNAL void
+gssdp_uring_attach     (GSSDPUring             *uring,
+                        GMainContext           *context);
+
+G_GNUC_INTERNAL gboolean
+gssdp_uring_add_socket (GSSDPUring             *uring,
+                        GSSDPSocketSource      *socket_source,
+                        GSSDPUringRecvFunc      func,
+                        gpointer                user_data,
+                        GError                **error);
+
+G_GNUC_INTERNAL gboolean
+gssdp_uring_send       (GSSDPUring             *uring,
+                        GSocket                *socket,
+                        GSocketAddress         *address,
+                        const GOutputVector    *vectors,
+                        guint                   n_vectors,
+                        gsize                  *sent_count,
+                        gsize                  *error_count,
+                        GError                **error);
+
+G_GNUC_INTERNAL void
+gssdp_uring_get_stats  (GSSDPUring             *uring,
+                        guint64                *wakeups,
+                        guint64                *datagrams);
+
+G_GNUC_INTERNAL void
+gssdp_uring_free       (GSSDPUring             *uring);
+
+G_END_DECLS
+
+#endif /* GSSDP_URING_H */
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Maps the hardware addresses of peers to the user agent they announced.
+ *
+ * The cache holds at most a fixed number of peers, evicting the one heard
+ * from least recently, and forgets peers that have been silent for longer
+ * than the time to live. Agent strings are shared between all peers using
+ * them, since most networks only have a handful of different ones.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gssdp-user-agent-cache.h"
+
+#include <string.h>
+
+typedef struct {
+        char  *str;
+        guint  count;
+} UserAgent;
+
+typedef struct {
+        /* Position in the LRU list, most recently used first */
+        GList       link;
+
+        char       *hwaddr;
+        UserAgent  *user_agent;
+        gint64      expires;
+} Entry;
+
+struct _GSSDPUserAgentCache {
+        guint       capacity;
+
+        /* Seconds, or 0 for entries that never expire */
+        guint       ttl;
+
+        GHashTable *entries;
+        GQueue      lru;
+
+        /* Agent string -> UserAgent shared by the entries using it */
+        GHashTable *user_agents;
+};
+
+static void
+user_agent_free (UserAgent *user_agent)
+{
+        g_free (user_agent->str);
+        g_slice_free (UserAgent, user_agent);
+}
+
+static UserAgent *
+user_agent_ref (GSSDPUserAgentCache *cache,
+                const char          *str)
+{
+        UserAgent *user_agent;
+
+        user_agent = g_hash_table_lookup (cache->user_agents, str);
+        if (user_agent == NULL) {
+                user_agent = g_slice_new (UserAgent);
+                user_agent->str = g_strdup (str);
+                user_agent->count = 0;
+                g_hash_table_insert (cache->user_agents,
+                                     user_agent->str,
+                                     user_agent);
+        }
+
+        user_agent->count++;
+
+        return user_agent;
+}
+
+static void
+user_agent_unref (GSSDPUserAgentCache *cache,
+                  UserAgent           *user_agent)
+{
+        if (--user_agent->count == 0)
+                g_hash_table_remove (cache->user_agents, user_agent->str);
+}
+
+static void
+entry_remove (GSSDPUserAgentCache *cache,
+              Entry               *entry)
+{
+        g_queue_unlink (&cache->lru, &entry->link);
+        g_hash_table_remove (cache->entries, entry->hwaddr);
+        user_agent_unref (cache, entry->user_agent);
+        g_free (entry->hwaddr);
+        g_slice_free (Entry, entry);
+}
+
+static gboolean
+entry_is_expired (Entry  *entry,
+                  gint64  now)
+{
+        return entry->expires != 0 && entry->expires <= now;
+}
+
+/* Drops expired entries and makes room for @room new ones */
+static void
+trim (GSSDPUserAgentCache *cache,
+      guint                room)
+{
+        gint64 now = g_get_monotonic_time ();
+
+        while (cache->lru.tail != NULL) {
+                Entry *entry = cache->lru.tail->data;
+
+                /* Entries are refreshed when moved to the head, so the tail
+                 * always expires first */
+                if (cache->lru.length + room <= cache->capacity &&
+                    !entry_is_expired (entry, now))
+                        break;
+
+                entry_remove (cache, entry);
+        }
+}
+
+/*
+ * gssdp_user_agent_cache_new:
+ * @capacity: Maximum number of peers
+ * @ttl: Seconds after which silent peers are forgotten, or 0 for never
+ */
+GSSDPUserAgentCache *
+gssdp_user_agent_cache_new (guint capacity,
+                            guint ttl)
+{
+        GSSDPUserAgentCache *cache;
+
+        cache = g_slice_new (GSSDPUserAgentCache);
+        cache->capacity = capacity;
+        cache->ttl = ttl;
+        cache->entries = g_hash_table_new (g_str_hash, g_str_equal);
+        g_queue_init (&cache->lru);
+        cache->user_agents = g_hash_table_new_full (g_str_hash,
+                                                    g_str_equal,
+                                                    NULL,
+                                                    (GDestroyNotify)
+                                                    user_agent_free);
+
+        return cache;
+}
+
+void
+gssdp_user_agent_cache_free (GSSDPUserAgentCache *cache)
+{
+        while (cache->lru.head != NULL)
+                entry_remove (cache, cache->lru.head->data);
+
+        g_hash_table_unref (cache->entries);
+        g_hash_table_unref (cache->user_agents);
+        g_slice_free (GSSDPUserAgentCache, cache);
+}
+
+void
+gssdp_user_agent_cache_set_capacity (GSSDPUserAgentCache *cache,
+                                     guint                capacity)
+{
+        cache->capacity = capacity;
+        trim (cache, 0);
+}
+
+/*
+ * Changing the time to live only affects entries updated afterwards
+ */
+void
+gssdp_user_agent_cache_set_ttl (GSSDPUserAgentCache *cache,
+                                guint                ttl)
+{
+        cache->ttl = ttl;
+}
+
+guint
+gssdp_user_agent_cache_get_size (GSSDPUserAgentCache *cache)
+{
+        return cache->lru.length;
+}
+
+/*
+ * Records that @hwaddr uses @user_agent. Updating a peer whose agent did not
+ * change does not allocate anything.
+ */
+void
+gssdp_user_agent_cache_update (GSSDPUserAgentCache *cache,
+                               const char          *hwaddr,
+                               const char          *user_agent)
+{
+        Entry *entry;
+
+        if (cache->capacity == 0)
+                return;
+
+        entry = g_hash_table_lookup (cache->entries, hwaddr);
+        if (entry != NULL) {
+                if (strcmp (entry->user_agent->str, user_agent) != 0) {
+                        UserAgent *old = entry->user_agent;
+
+                        entry->user_agent = user_agent_ref (cache,
+                                                            user_agent);
+                        user_agent_unref (cache, old);
+                }
+
+                g_queue_unlink (&cache->lru, &entry->link);
+        } else {
+                trim (cache, 1);
+
+                entry = g_slice_new (Entry);
+                entry->link.data = entry;
+                entry->link.prev = NULL;
+                entry->link.next = NULL;
+                entry->hwaddr = g_strdup (hwaddr);
+                entry->user_agent = user_agent_ref (cache, user_agent);
+                g_hash_table_insert (cache->entries, entry->hwaddr, entry);
+        }
+
+        if (cache->ttl > 0)
+                entry->expires = g_get_monotonic_time () +
+                                 (gint64) cache->ttl * G_USEC_PER_SEC;
+        else
+                entry->expires = 0;
+
+        g_queue_push_head_link (&cache->lru, &entry->link);
+}
+
+/*
+ * Return value: The user agent last seen for @hwaddr, or %NULL. It stays
+ * valid until the cache is next modified.
+ */
+const char *
+gssdp_user_agent_cache_lookup (GSSDPUserAgentCache *cache,
+                               const char          *hwaddr)
+{
+        Entry *entry;
+
+        entry = g_hash_table_lookup (cache->entries, hwaddr);
+        if (entry == NULL)
+                return NULL;
+
+        if (entry_is_expired (entry, g_get_monotonic_time ())) {
+                entry_remove (cache, entry);
+
+                return NULL;
+        }
+
+        return entry->user_agent->str;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GSSDP_USER_AGENT_CACHE_H
+#define GSSDP_USER_AGENT_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GSSDPUserAgentCache GSSDPUserAgentCache;
+
+G_GNUC_INTERNAL GSSDPUserAgentCache *
+gssdp_user_agent_cache_new          (guint                capacity,
+                                     guint                ttl);
+
+G_GNUC_INTERNAL void
+gssdp_user_agent_cache_free         (GSSDPUserAgentCache *cache);
+
+G_GNUC_INTERNAL void
+gssdp_user_agent_cache_set_capacity (GSSDPUserAgentCache *cache,
+                                     guint                capacity);
+
+G_GNUC_INTERNAL void
+gssdp_user_agent_cache_set_ttl      (GSSDPUserAgentCache *cache,
+                                     guint                ttl);
+
+G_GNUC_INTERNAL guint
+gssdp_user_agent_cache_get_size     (GSSDPUserAgentCache *cache);
+
+G_GNUC_INTERNAL void
+gssdp_user_agent_cache_update       (GSSDPUserAgentCache *cache,
+                                     const char          *hwaddr,
+                                     const char          *user_agent);
+
+G_GNUC_INTERNAL const char *
+gssdp_user_agent_cache_lookup       (GSSDPUserAgentCache *cache,
+                                     const char          *hwaddr);
+
+G_END_DECLS
+
+#endif /* GSSDP_USER_AGENT_CACHE_H */
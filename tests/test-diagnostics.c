@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <libgssdp/gssdp-diagnostics.h>
+
+/* Long enough to not run out while the test takes its first turns */
+#define INTERVAL 200
+
+static guint64
+lookup (GVariant   *statistics,
+        const char *key)
+{
+        guint64 value = G_MAXUINT64;
+
+        g_assert_true (g_variant_lookup (statistics, key, "t", &value));
+
+        return value;
+}
+
+static void
+test_diagnostics_rate_limit (void)
+{
+        GSSDPDiagnostics diagnostics;
+        guint n_suppressed, i;
+
+        gssdp_diagnostics_init (&diagnostics, 2, INTERVAL);
+
+        for (i = 0; i < 2; i++) {
+                g_assert_true (gssdp_diagnostics_take
+                                        (&diagnostics,
+                                         GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                         &n_suppressed));
+                g_assert_cmpuint (n_suppressed, ==, 0);
+        }
+
+        for (i = 0; i < 3; i++)
+                g_assert_false (gssdp_diagnostics_take
+                                        (&diagnostics,
+                                         GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                         &n_suppressed));
+
+        /* Every kind has a budget of its own */
+        g_assert_true (gssdp_diagnostics_take (&diagnostics,
+                                               GSSDP_DIAGNOSTIC_SEND_ERROR,
+                                               &n_suppressed));
+        g_assert_cmpuint (n_suppressed, ==, 0);
+
+        /* The next interval reports what was swallowed */
+        g_usleep ((INTERVAL + 50) * 1000);
+
+        g_assert_true (gssdp_diagnostics_take (&diagnostics,
+                                               GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                               &n_suppressed));
+        g_assert_cmpuint (n_suppressed, ==, 3);
+
+        g_assert_true (gssdp_diagnostics_take (&diagnostics,
+                                               GSSDP_DIAGNOSTIC_INVALID_SEARCH,
+                                               &n_suppressed));
+        g_assert_cmpuint (n_suppressed, ==, 0);
+
+        gssdp_diagnostics_clear (&diagnostics);
+}
+
+static void
+test_diagnostics_statistics (void)
+{
+        GSSDPDiagnostics diagnostics;
+        GVariantBuilder builder;
+        GVariant *statistics;
+        guint n_suppressed, i;
+
+        gssdp_diagnostics_init (&diagnostics, 1, INTERVAL);
+
+        for (i = 0; i < 4; i++)
+                gssdp_diagnostics_take (&diagnostics,
+                                        GSSDP_DIAGNOSTIC_MISSING_EXPIRY,
+                                        &n_suppressed);
+
+        /* Counting alone does not touch the rate limit */
+        gssdp_diagnostics_count (&diagnostics,
+                                 GSSDP_DIAGNOSTIC_RECEIVE_ERROR);
+        g_assert_true (gssdp_diagnostics_take
+                                (&diagnostics,
+                                 GSSDP_DIAGNOSTIC_RECEIVE_ERROR,
+                                 &n_suppressed));
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+        gssdp_diagnostics_add_statistics (&diagnostics, &builder);
+        statistics = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+        g_assert_cmpuint (lookup (statistics, "diagnostics-missing-expiry"),
+                          ==,
+                          4);
+        g_assert_cmpuint (lookup (statistics, "diagnostics-receive-error"),
+                          ==,
+                          2);
+        g_assert_cmpuint (lookup (statistics, "diagnostics-send-error"),
+                          ==,
+                          0);
+        g_assert_cmpuint (lookup (statistics, "suppressed-diagnostics"),
+                          ==,
+                          3);
+
+        g_variant_unref (statistics);
+        gssdp_diagnostics_clear (&diagnostics);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/diagnostics/rate-limit",
+                         test_diagnostics_rate_limit);
+        g_test_add_func ("/diagnostics/statistics",
+                         test_diagnostics_statistics);
+
+        g_test_run ();
+
+        return 0;
+}
@@ -24,6 +24,7 @@
 #include <gio/gio.h>
 
 #include <libgssdp/gssdp-resource-browser.h>
+#include <libgssdp/gssdp-resource-group.h>
 #include <libgssdp/gssdp-protocol.h>
 
 #include "test-util.h"
@@ -34,6 +35,9 @@
 #define VERSIONED_USN_1 UUID_1"::"VERSIONED_NT_1
 #define VERSIONED_USN_2 UUID_1"::"VERSIONED_NT_2
 
+/* Slack for the 10 ms response timer and the client's rate limit */
+#define RESPONSE_SLACK 250
+
 /* Helper functions */
 
 static GSocket *
@@ -99,6 +103,132 @@ create_byebye_message (const char *nt)
         return msg;
 }
 
+static void
+send_search (GSocket    *socket,
+             const char *target,
+             int         mx)
+{
+        GError *error = NULL;
+        GSocketAddress *sock_addr;
+        GInetAddress *address;
+        char *msg;
+
+        msg = g_strdup_printf ("M-SEARCH * HTTP/1.1\r\n"
+                               "Host: " SSDP_ADDR ":" SSDP_PORT_STR "\r\n"
+                               "Man: \"ssdp:discover\"\r\n"
+                               "ST: %s\r\n"
+                               "MX: %d\r\n"
+                               "\r\n",
+                               target,
+                               mx);
+
+        address = g_inet_address_new_from_string (SSDP_ADDR);
+        sock_addr = g_inet_socket_address_new (address, SSDP_PORT);
+        g_object_unref (address);
+
+        g_socket_send_to (socket, sock_addr, msg, strlen (msg), NULL, &error);
+        g_assert (error == NULL);
+
+        g_object_unref (sock_addr);
+        g_free (msg);
+}
+
+typedef struct {
+        GMainLoop *loop;
+        guint      received;
+        gint64     first;
+} TestSearchData;
+
+static gboolean
+on_search_response (GSocket      *socket,
+                    GIOCondition  condition,
+                    gpointer      user_data)
+{
+        TestSearchData *data = (TestSearchData *) user_data;
+        char buf[2048];
+        gssize bytes;
+
+        bytes = g_socket_receive (socket, buf, sizeof (buf) - 1, NULL, NULL);
+        if (bytes <= 0)
+                return TRUE;
+
+        buf[bytes] = '\0';
+        if (!g_str_has_prefix (buf, "HTTP/1.1 200 OK"))
+                return TRUE;
+
+        if (data->received++ == 0)
+                data->first = g_get_monotonic_time ();
+
+        if (data->loop != NULL)
+                g_main_loop_quit (data->loop);
+
+        return TRUE;
+}
+
+static GSource *
+watch_search_responses (GSocket        *socket,
+                        TestSearchData *data)
+{
+        GSource *source;
+
+        source = g_socket_create_source (socket, G_IO_IN, NULL);
+        g_source_set_callback (source,
+                               (GSourceFunc) on_search_response,
+                               data,
+                               NULL);
+        g_source_attach (source, NULL);
+
+        return source;
+}
+
+static guint64
+get_statistic (GSSDPResourceGroup *group,
+               const char         *key)
+{
+        GVariant *statistics;
+        guint64 value = 0;
+
+        statistics = gssdp_resource_group_get_statistics (group);
+        g_assert (g_variant_lookup (statistics, key, "t", &value));
+        g_variant_unref (statistics);
+
+        return value;
+}
+
+/* Iterates the main context until @group saw @searches discovery requests */
+static void
+wait_for_searches (GSSDPResourceGroup *group,
+                   guint64             searches)
+{
+        gint64 deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+
+        while (get_statistic (group, "searches") < searches) {
+                g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+                g_main_context_iteration (NULL, FALSE);
+                g_usleep (1000);
+        }
+}
+
+static GSSDPResourceGroup *
+create_resource_group (GSSDPClient *client,
+                       const char  *nt)
+{
+        GSSDPResourceGroup *group;
+        char *usn;
+
+        usn = g_strconcat (UUID_1, "::", nt, NULL);
+
+        group = gssdp_resource_group_new (client);
+        gssdp_resource_group_add_resource_simple (group,
+                                                  nt,
+                                                  usn,
+                                                  "http://127.0.0.1:1234");
+        gssdp_resource_group_set_available (group, TRUE);
+        g_free (usn);
+
+        return group;
+}
+
 typedef struct {
         const char *usn;
         GMainLoop  *loop;
@@ -486,6 +616,178 @@ test_discovery_versioned_ignore_older (void)
 }
 
 
+/*
+ * A search is answered within its MX window
+ */
+static void
+test_discovery_mx (void)
+{
+        GSSDPClient *client;
+        GSSDPResourceGroup *group;
+        GError *error = NULL;
+        GSocket *socket;
+        GSource *source;
+        TestSearchData data = { NULL, 0, 0 };
+        gint64 start;
+        guint timeout_id;
+
+        data.loop = g_main_loop_new (NULL, FALSE);
+
+        client = get_client (&error);
+        g_assert (client != NULL);
+        g_assert (error == NULL);
+
+        group = create_resource_group (client, VERSIONED_NT_1);
+
+        socket = create_socket ();
+        source = watch_search_responses (socket, &data);
+
+        timeout_id = g_timeout_add (1000 + RESPONSE_SLACK,
+                                    quit_loop,
+                                    data.loop);
+
+        start = g_get_monotonic_time ();
+        send_search (socket, VERSIONED_NT_1, 1);
+        g_main_loop_run (data.loop);
+
+        g_assert_cmpuint (data.received, ==, 1);
+        g_assert_cmpint (data.first - start,
+                         <,
+                         (1000 + RESPONSE_SLACK) * 1000);
+
+        g_source_remove (timeout_id);
+        g_source_destroy (source);
+        g_source_unref (source);
+        g_object_unref (socket);
+        g_object_unref (group);
+        g_object_unref (client);
+        g_main_loop_unref (data.loop);
+}
+
+/*
+ * Responses still waiting for their delay are not sent once the group is gone
+ */
+static void
+test_discovery_dispose (void)
+{
+        GSSDPClient *client;
+        GSSDPResourceGroup *group;
+        GError *error = NULL;
+        GSocket *socket;
+        GSource *source;
+        TestSearchData data = { NULL, 0, 0 };
+        GMainLoop *loop;
+        guint64 sent;
+
+        loop = g_main_loop_new (NULL, FALSE);
+
+        client = get_client (&error);
+        g_assert (client != NULL);
+        g_assert (error == NULL);
+
+        group = create_resource_group (client, VERSIONED_NT_1);
+
+        socket = create_socket ();
+        source = watch_search_responses (socket, &data);
+
+        send_search (socket, VERSIONED_NT_1, 3);
+        wait_for_searches (group, 1);
+
+        /* The response may have been due right away */
+        sent = get_statistic (group, "responses");
+        g_assert_cmpuint (sent + get_statistic (group, "pending-responses"),
+                          ==,
+                          1);
+        g_object_unref (group);
+
+        g_timeout_add (3000 + RESPONSE_SLACK, quit_loop, loop);
+        g_main_loop_run (loop);
+
+        g_assert_cmpuint (data.received, ==, sent);
+
+        g_source_destroy (source);
+        g_source_unref (source);
+        g_object_unref (socket);
+        g_object_unref (client);
+        g_main_loop_unref (loop);
+}
+
+
+/*
+ * A single host flooding a group with searches only gets a bounded number
+ * of responses, all within the clamped MX window
+ */
+static void
+test_discovery_flood (void)
+{
+        GSSDPClient *client;
+        GSSDPResourceGroup *group;
+        GError *error = NULL;
+        GSocket *socket;
+        GSource *source;
+        TestSearchData data = { NULL, 0, 0 };
+        GMainLoop *loop;
+        guint64 duplicates, dropped;
+        int i;
+
+        loop = g_main_loop_new (NULL, FALSE);
+
+        client = get_client (&error);
+        g_assert (client != NULL);
+        g_assert (error == NULL);
+
+        group = create_resource_group (client, VERSIONED_NT_1);
+        gssdp_resource_group_add_resource_simple
+                                (group,
+                                 "urn:org-gupnp:service:FunctionalTest:1",
+                                 UUID_1"::urn:org-gupnp:service:FunctionalTest:1",
+                                 "http://127.0.0.1:1234");
+        gssdp_resource_group_add_resource_simple (group,
+                                                  UUID_1,
+                                                  UUID_1,
+                                                  "http://127.0.0.1:1234");
+        gssdp_resource_group_set_search_rate (group, 1);
+        gssdp_resource_group_set_search_burst (group, 5);
+        gssdp_resource_group_set_max_pending_responses (group, 2);
+        gssdp_resource_group_set_max_mx (group, 1);
+
+        socket = create_socket ();
+        source = watch_search_responses (socket, &data);
+
+        for (i = 0; i < 30; i++)
+                send_search (socket, "ssdp:all", 5);
+        wait_for_searches (group, 30);
+
+        /* Only the burst is answered */
+        g_assert_cmpuint (get_statistic (group, "dropped-searches"), ==, 25);
+
+        /* All responses are due within the clamped MX */
+        g_timeout_add (1000 + RESPONSE_SLACK, quit_loop, loop);
+        g_main_loop_run (loop);
+
+        g_assert_cmpuint (get_statistic (group, "pending-responses"), ==, 0);
+        g_assert_cmpuint (get_statistic (group, "responses"),
+                          ==,
+                          data.received);
+
+        /* Repeated searches share the pending responses, the rest does not
+         * fit into the two pending slots */
+        duplicates = get_statistic (group, "duplicate-responses");
+        dropped = get_statistic (group, "dropped-responses");
+        g_assert_cmpuint (duplicates, >, 0);
+        g_assert_cmpuint (dropped, >, 0);
+        g_assert_cmpuint (data.received, >=, 2);
+        g_assert_cmpuint (data.received + duplicates + dropped, ==, 5 * 3);
+
+        g_source_destroy (source);
+        g_source_unref (source);
+        g_object_unref (socket);
+        g_object_unref (group);
+        g_object_unref (client);
+        g_main_loop_unref (loop);
+}
+
+
 int main(int argc, char *argv[])
 {
 #if !GLIB_CHECK_VERSION (2, 35, 0)
@@ -511,6 +813,15 @@ int main(int argc, char *argv[])
         g_test_add_func ("/functional/resource-group/discovery/versioned/ignore-older",
                          test_discovery_versioned_ignore_older);
 
+        g_test_add_func ("/functional/resource-group/discovery/mx",
+                         test_discovery_mx);
+
+        g_test_add_func ("/functional/resource-group/discovery/dispose",
+                         test_discovery_dispose);
+
+        g_test_add_func ("/functional/resource-group/discovery/flood",
+                         test_discovery_flood);
+
         g_test_run ();
 
         return 0;
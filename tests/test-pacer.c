@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <libgssdp/gssdp-pacer.h>
+
+static void
+record_messages (GSSDPPacerItem *items,
+                 guint           n_items,
+                 gpointer        user_data)
+{
+        GString *sent = user_data;
+        guint i;
+
+        for (i = 0; i < n_items; i++) {
+                gsize size;
+                const char *data;
+
+                data = g_bytes_get_data (items[i].message, &size);
+                g_string_append_len (sent, data, size);
+                if (items[i].dest_ip != NULL)
+                        g_string_append_printf (sent,
+                                                "@%s:%u",
+                                                items[i].dest_ip,
+                                                items[i].dest_port);
+                g_string_append_c (sent, ' ');
+        }
+}
+
+static void
+push (GSSDPPacer         *pacer,
+      GSSDPPacerPriority  priority,
+      gpointer            owner,
+      guint               id,
+      const char         *dest_ip,
+      const char         *message)
+{
+        GBytes *bytes;
+
+        bytes = g_bytes_new_static (message, strlen (message));
+        gssdp_pacer_push (pacer,
+                          priority,
+                          owner,
+                          id,
+                          dest_ip,
+                          1900,
+                          0,
+                          bytes);
+        g_bytes_unref (bytes);
+}
+
+static void
+test_pacer_priority (void)
+{
+        GString *sent = g_string_new (NULL);
+        GSSDPPacer *pacer;
+
+        pacer = gssdp_pacer_new (record_messages, sent);
+
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "alive1");
+        push (pacer, GSSDP_PACER_PRIORITY_BYEBYE, NULL, 0, NULL, "byebye1");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "alive2");
+        push (pacer, GSSDP_PACER_PRIORITY_RESPONSE, NULL, 0, "10.0.0.1",
+              "response");
+        push (pacer, GSSDP_PACER_PRIORITY_BYEBYE, NULL, 0, NULL, "byebye2");
+
+        /* Something is queued ahead, so this has to wait its turn */
+        g_assert (!gssdp_pacer_try_take (pacer,
+                                         GSSDP_PACER_PRIORITY_RESPONSE));
+
+        gssdp_pacer_flush (pacer);
+        g_assert_cmpstr (sent->str,
+                         ==,
+                         "response@10.0.0.1:1900 byebye1 byebye2 "
+                         "alive1 alive2 ");
+
+        /* Nothing queued and no limit */
+        g_assert (gssdp_pacer_try_take (pacer, GSSDP_PACER_PRIORITY_ALIVE));
+
+        gssdp_pacer_destroy (pacer);
+        g_string_free (sent, TRUE);
+}
+
+static void
+test_pacer_cancel (void)
+{
+        GString *sent = g_string_new (NULL);
+        GSSDPPacer *pacer;
+        int owner, other;
+
+        pacer = gssdp_pacer_new (record_messages, sent);
+
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &owner, 1, NULL, "a1");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &owner, 2, NULL, "b1");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &owner, 1, NULL, "a2");
+        push (pacer, GSSDP_PACER_PRIORITY_BYEBYE, &owner, 1, NULL, "a3");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &other, 1, NULL, "c1");
+
+        gssdp_pacer_cancel (pacer, GSSDP_PACER_PRIORITY_ALIVE, &owner, 1);
+
+        gssdp_pacer_flush (pacer);
+        g_assert_cmpstr (sent->str, ==, "a3 b1 c1 ");
+
+        gssdp_pacer_destroy (pacer);
+        g_string_free (sent, TRUE);
+}
+
+static void
+test_pacer_flush_owner (void)
+{
+        GString *sent = g_string_new (NULL);
+        GSSDPPacer *pacer;
+        int owner, other;
+
+        pacer = gssdp_pacer_new (record_messages, sent);
+
+        /* Nothing would go out without flushing */
+        gssdp_pacer_set_rate (pacer, 1, 1);
+        g_assert (gssdp_pacer_try_take (pacer, GSSDP_PACER_PRIORITY_ALIVE));
+
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &other, 1, NULL, "c1");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, &owner, 1, NULL, "a1");
+        push (pacer, GSSDP_PACER_PRIORITY_BYEBYE, &owner, 2, NULL, "b1");
+        push (pacer, GSSDP_PACER_PRIORITY_BYEBYE, &other, 1, NULL, "c2");
+
+        gssdp_pacer_flush_owner (pacer, &owner);
+        g_assert_cmpstr (sent->str, ==, "b1 a1 ");
+        g_assert_cmpuint (gssdp_pacer_get_n_queued (pacer), ==, 2);
+
+        gssdp_pacer_destroy (pacer);
+        g_string_free (sent, TRUE);
+}
+
+static void
+test_pacer_rate (void)
+{
+        GString *sent = g_string_new (NULL);
+        GSSDPPacer *pacer;
+        gint64 start;
+
+        pacer = gssdp_pacer_new (record_messages, sent);
+        gssdp_pacer_attach (pacer, NULL);
+
+        /* One token to begin with, then one every 20 ms */
+        gssdp_pacer_set_rate (pacer, 50, 1);
+        g_assert (gssdp_pacer_try_take (pacer,
+                                        GSSDP_PACER_PRIORITY_RESPONSE));
+        g_assert (!gssdp_pacer_try_take (pacer,
+                                         GSSDP_PACER_PRIORITY_RESPONSE));
+
+        start = g_get_monotonic_time ();
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "1");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "2");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "3");
+        push (pacer, GSSDP_PACER_PRIORITY_ALIVE, NULL, 0, NULL, "4");
+
+        while (sent->len < strlen ("1 2 3 4 "))
+                g_main_context_iteration (NULL, TRUE);
+
+        g_assert_cmpstr (sent->str, ==, "1 2 3 4 ");
+        g_assert_cmpint (g_get_monotonic_time () - start, >=, 60000);
+
+        gssdp_pacer_destroy (pacer);
+        g_string_free (sent, TRUE);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/pacer/priority", test_pacer_priority);
+        g_test_add_func ("/pacer/cancel", test_pacer_cancel);
+        g_test_add_func ("/pacer/flush-owner", test_pacer_flush_owner);
+        g_test_add_func ("/pacer/rate", test_pacer_rate);
+
+        g_test_run ();
+
+        return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <libsoup/soup.h>
+
+#include <libgssdp/gssdp-parser.h>
+#include <libgssdp/gssdp-message.h>
+#include <libgssdp/gssdp-client-private.h>
+
+#define NOTIFY_PACKET                                               \
+        "NOTIFY * HTTP/1.1\r\n"                                     \
+        "Host: 239.255.255.250:1900\r\n"                            \
+        "Cache-Control: max-age=1800\r\n"                           \
+        "Location: http://192.168.1.10:49152/description.xml\r\n"   \
+        "Server: Linux/4.9 UPnP/1.0 GSSDP/1.1.0\r\n"                \
+        "NTS: ssdp:alive\r\n"                                       \
+        "NT: urn:schemas-upnp-org:device:MediaServer:1\r\n"         \
+        "USN: uuid:81909e94-ebf4-469e-ac68-81f2f189de1b::"          \
+        "urn:schemas-upnp-org:device:MediaServer:1\r\n"             \
+        "\r\n"
+
+#define MSEARCH_PACKET                                              \
+        "M-SEARCH * HTTP/1.1\r\n"                                   \
+        "Host: 239.255.255.250:1900\r\n"                            \
+        "Man: \"ssdp:discover\"\r\n"                                \
+        "ST: ssdp:all\r\n"                                          \
+        "MX: 3\r\n"                                                 \
+        "\r\n"
+
+#define RESPONSE_PACKET                                             \
+        "HTTP/1.1 200 OK\r\n"                                       \
+        "Location: http://192.168.1.10:49152/description.xml\r\n"   \
+        "Ext:\r\n"                                                  \
+        "USN: uuid:81909e94-ebf4-469e-ac68-81f2f189de1b\r\n"        \
+        "Server: Linux/4.9 UPnP/1.0 GSSDP/1.1.0\r\n"                \
+        "Cache-Control: max-age=1800\r\n"                           \
+        "ST: upnp:rootdevice\r\n"                                   \
+        "Content-Length: 0\r\n"                                     \
+        "\r\n"
+
+static gboolean
+parse_string (GSSDPParser *parser, const char *packet, char **buf)
+{
+        gsize len = strlen (packet);
+
+        *buf = g_malloc (len + 1);
+        memcpy (*buf, packet, len + 1);
+
+        return gssdp_parser_parse (parser, *buf, len);
+}
+
+static void
+test_parser_notify (void)
+{
+        GSSDPParser parser;
+        char *buf;
+
+        g_assert (parse_string (&parser, NOTIFY_PACKET, &buf));
+        g_assert_cmpint (parser.type, ==, _GSSDP_ANNOUNCEMENT);
+        g_assert_cmpuint (parser.n_headers, ==, 7);
+        g_assert_cmpuint (parser.length, ==, strlen (NOTIFY_PACKET));
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "NT"),
+                         ==,
+                         "urn:schemas-upnp-org:device:MediaServer:1");
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "nts"),
+                         ==,
+                         "ssdp:alive");
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "Cache-Control"),
+                         ==,
+                         "max-age=1800");
+        g_assert (gssdp_parser_get_header (&parser, "ST") == NULL);
+
+        g_free (buf);
+}
+
+static void
+test_parser_msearch (void)
+{
+        GSSDPParser parser;
+        char *buf;
+
+        g_assert (parse_string (&parser, MSEARCH_PACKET, &buf));
+        g_assert_cmpint (parser.type, ==, _GSSDP_DISCOVERY_REQUEST);
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "MAN"),
+                         ==,
+                         "\"ssdp:discover\"");
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "MX"), ==, "3");
+
+        g_free (buf);
+}
+
+static void
+test_parser_response (void)
+{
+        GSSDPParser parser;
+        char *buf;
+
+        g_assert (parse_string (&parser, RESPONSE_PACKET, &buf));
+        g_assert_cmpint (parser.type, ==, _GSSDP_DISCOVERY_RESPONSE);
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "Ext"), ==, "");
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "ST"),
+                         ==,
+                         "upnp:rootdevice");
+
+        g_free (buf);
+}
+
+static void
+test_parser_whitespace (void)
+{
+        GSSDPParser parser;
+        char *buf;
+
+        /* Bare LF line endings, padding and a folded header */
+        g_assert (parse_string (&parser,
+                                "NOTIFY * HTTP/1.1\n"
+                                "NT :   upnp:rootdevice  \n"
+                                "USN: uuid:foo\r\n"
+                                "\t::upnp:rootdevice\r\n"
+                                "garbage line\r\n"
+                                "\n",
+                                &buf));
+        g_assert_cmpint (parser.type, ==, _GSSDP_ANNOUNCEMENT);
+        g_assert_cmpuint (parser.n_headers, ==, 2);
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "NT"),
+                         ==,
+                         "upnp:rootdevice");
+        g_assert_cmpstr (gssdp_parser_get_header (&parser, "USN"),
+                         ==,
+                         "uuid:foo  \t::upnp:rootdevice");
+
+        g_free (buf);
+}
+
+static void
+test_parser_invalid (void)
+{
+        GSSDPParser parser;
+        char *buf;
+
+        /* Missing empty line */
+        g_assert (!parse_string (&parser,
+                                 "NOTIFY * HTTP/1.1\r\nNT: foo\r\n",
+                                 &buf));
+        g_free (buf);
+
+        /* Unknown method */
+        g_assert (!parse_string (&parser,
+                                 "SUBSCRIBE * HTTP/1.1\r\n\r\n",
+                                 &buf));
+        g_free (buf);
+
+        /* Not HTTP/1.1 */
+        g_assert (!parse_string (&parser,
+                                 "NOTIFY * HTTP/1.0\r\n\r\n",
+                                 &buf));
+        g_free (buf);
+
+        /* Not targeted at * */
+        g_assert (!parse_string (&parser,
+                                 "NOTIFY /foo HTTP/1.1\r\n\r\n",
+                                 &buf));
+        g_free (buf);
+
+        /* Not a 200 response */
+        g_assert (!parse_string (&parser,
+                                 "HTTP/1.1 404 Not Found\r\n\r\n",
+                                 &buf));
+        g_free (buf);
+
+        g_assert (!parse_string (&parser, "", &buf));
+        g_free (buf);
+}
+
+static void
+test_message_decode (void)
+{
+        GSSDPParser parser;
+        GSSDPMessage *message;
+        char *buf;
+
+        g_assert (parse_string (&parser, NOTIFY_PACKET, &buf));
+        message = _gssdp_message_new (&parser,
+                                      buf,
+                                      g_strdup ("192.168.1.10"),
+                                      1900);
+
+        /* The message has its own copy of the headers */
+        memset (buf, 0, parser.length);
+        g_free (buf);
+
+        g_assert_cmpint (message->type, ==, _GSSDP_ANNOUNCEMENT);
+        g_assert_cmpint (message->nts, ==, _GSSDP_NTS_ALIVE);
+        g_assert_cmpint (message->max_age, ==, 1800);
+        g_assert_cmpint (message->mx, ==, -1);
+        g_assert_cmpuint (message->version, ==, 1);
+        g_assert_cmpstr (message->nt,
+                         ==,
+                         "urn:schemas-upnp-org:device:MediaServer:1");
+        g_assert_cmpstr (message->location,
+                         ==,
+                         "http://192.168.1.10:49152/description.xml");
+        g_assert_cmpstr (message->agent,
+                         ==,
+                         "Linux/4.9 UPnP/1.0 GSSDP/1.1.0");
+        g_assert (message->st == NULL);
+        g_assert_cmpstr (_gssdp_message_get_header (message, "host"),
+                         ==,
+                         "239.255.255.250:1900");
+        g_assert_cmpstr (soup_message_headers_get_one
+                                (_gssdp_message_get_soup_headers (message),
+                                 "USN"),
+                         ==,
+                         message->usn);
+
+        _gssdp_message_unref (message);
+
+        g_assert (parse_string (&parser, MSEARCH_PACKET, &buf));
+        message = _gssdp_message_new (&parser, buf, g_strdup ("::1"), 1900);
+        g_free (buf);
+
+        g_assert_cmpint (message->type, ==, _GSSDP_DISCOVERY_REQUEST);
+        g_assert_cmpint (message->nts, ==, _GSSDP_NTS_NONE);
+        g_assert_cmpint (message->mx, ==, 3);
+        g_assert_cmpint (message->max_age, ==, -1);
+        g_assert_cmpuint (message->version, ==, 0);
+        g_assert_cmpstr (message->st, ==, "ssdp:all");
+
+        _gssdp_message_unref (message);
+}
+
+static void
+test_message_max_age (void)
+{
+        g_assert_cmpint (_gssdp_message_parse_max_age ("max-age=1800"),
+                         ==,
+                         1800);
+        g_assert_cmpint (_gssdp_message_parse_max_age ("max-age = 60"),
+                         ==,
+                         60);
+        g_assert_cmpint (_gssdp_message_parse_max_age
+                                ("no-cache, MAX-AGE=10 ,private"),
+                         ==,
+                         10);
+        g_assert_cmpint (_gssdp_message_parse_max_age ("max-age"), ==, -1);
+        g_assert_cmpint (_gssdp_message_parse_max_age ("max-age=-1"), ==, -1);
+        g_assert_cmpint (_gssdp_message_parse_max_age ("max-age=1x"), ==, -1);
+        g_assert_cmpint (_gssdp_message_parse_max_age ("no-cache"), ==, -1);
+        g_assert_cmpint (_gssdp_message_parse_max_age (NULL), ==, -1);
+}
+
+/* The code path the client used before the in-place parser */
+static gboolean
+parse_with_soup (const char *buf, gsize len)
+{
+        SoupMessageHeaders *headers;
+        char *method = NULL, *path = NULL;
+        SoupHTTPVersion version;
+        guint status;
+        gboolean ret;
+
+        headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_REQUEST);
+        ret = soup_headers_parse_request (buf,
+                                          len,
+                                          headers,
+                                          &method,
+                                          &path,
+                                          &version) == SOUP_STATUS_OK;
+        g_free (method);
+        g_free (path);
+        soup_message_headers_free (headers);
+
+        if (ret)
+                return TRUE;
+
+        headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+        ret = soup_headers_parse_response (buf,
+                                           len,
+                                           headers,
+                                           NULL,
+                                           &status,
+                                           NULL);
+        soup_message_headers_free (headers);
+
+        return ret;
+}
+
+#define BENCHMARK_ITERATIONS 200000
+
+static void
+test_parser_benchmark (void)
+{
+        const char *packets[] = { NOTIFY_PACKET,
+                                  MSEARCH_PACKET,
+                                  RESPONSE_PACKET };
+        char buf[1024];
+        gdouble elapsed;
+        guint i;
+
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                const char *packet = packets[i % G_N_ELEMENTS (packets)];
+                gsize len = strlen (packet);
+                GSSDPParser parser;
+
+                /* The parser works in place, so copy it like recv() would */
+                memcpy (buf, packet, len + 1);
+                g_assert (gssdp_parser_parse (&parser, buf, len));
+        }
+        elapsed = g_test_timer_elapsed ();
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "In-place parser: %.0f packets/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                const char *packet = packets[i % G_N_ELEMENTS (packets)];
+                gsize len = strlen (packet);
+
+                memcpy (buf, packet, len + 1);
+                g_assert (parse_with_soup (buf, len));
+        }
+        elapsed = g_test_timer_elapsed ();
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "libsoup parser: %.0f packets/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/parser/notify", test_parser_notify);
+        g_test_add_func ("/parser/m-search", test_parser_msearch);
+        g_test_add_func ("/parser/response", test_parser_response);
+        g_test_add_func ("/parser/whitespace", test_parser_whitespace);
+        g_test_add_func ("/parser/invalid", test_parser_invalid);
+        g_test_add_func ("/message/decode", test_message_decode);
+        g_test_add_func ("/message/max-age", test_message_max_age);
+
+        if (g_test_perf ())
+                g_test_add_func ("/parser/benchmark", test_parser_benchmark);
+
+        g_test_run ();
+
+        return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <libgssdp/gssdp-ring.h>
+
+#define N_ELEMENTS 100000
+
+static void
+test_ring_order (void)
+{
+        GSSDPRing *ring;
+        guint i;
+
+        /* Rounded up to a power of two */
+        ring = gssdp_ring_new (3);
+        g_assert_cmpuint (gssdp_ring_get_capacity (ring), ==, 4);
+
+        g_assert_true (gssdp_ring_is_empty (ring));
+        g_assert_null (gssdp_ring_pop (ring));
+
+        for (i = 1; i <= 4; i++)
+                g_assert_true (gssdp_ring_push (ring, GUINT_TO_POINTER (i)));
+        g_assert_false (gssdp_ring_push (ring, GUINT_TO_POINTER (5)));
+
+        g_assert_cmpuint (GPOINTER_TO_UINT (gssdp_ring_pop (ring)), ==, 1);
+        g_assert_true (gssdp_ring_push (ring, GUINT_TO_POINTER (5)));
+
+        for (i = 2; i <= 5; i++)
+                g_assert_cmpuint (GPOINTER_TO_UINT (gssdp_ring_pop (ring)),
+                                  ==,
+                                  i);
+
+        g_assert_true (gssdp_ring_is_empty (ring));
+
+        gssdp_ring_free (ring);
+}
+
+static gpointer
+produce (gpointer user_data)
+{
+        GSSDPRing *ring = user_data;
+        guint i;
+
+        for (i = 1; i <= N_ELEMENTS; i++)
+                while (!gssdp_ring_push (ring, GUINT_TO_POINTER (i)))
+                        g_thread_yield ();
+
+        return NULL;
+}
+
+static void
+test_ring_threads (void)
+{
+        GSSDPRing *ring;
+        GThread *producer;
+        guint expected = 1;
+
+        ring = gssdp_ring_new (16);
+        producer = g_thread_new ("producer", produce, ring);
+
+        while (expected <= N_ELEMENTS) {
+                gpointer data = gssdp_ring_pop (ring);
+
+                if (data == NULL) {
+                        g_thread_yield ();
+
+                        continue;
+                }
+
+                g_assert_cmpuint (GPOINTER_TO_UINT (data), ==, expected);
+                expected++;
+        }
+
+        g_thread_join (producer);
+        g_assert_true (gssdp_ring_is_empty (ring));
+
+        gssdp_ring_free (ring);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/ring/order", test_ring_order);
+        g_test_add_func ("/ring/threads", test_ring_threads);
+
+        g_test_run ();
+
+        return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libgssdp/gssdp-target.h>
+
+#define MEDIA_SERVER "urn:schemas-upnp-org:device:MediaServer"
+
+static void
+test_target_split (void)
+{
+        GSSDPTarget target;
+
+        gssdp_target_init (&target, MEDIA_SERVER ":2");
+        g_assert (target.has_version);
+        g_assert_cmpuint (target.version, ==, 2);
+        g_assert_cmpstr (target.prefix, ==, MEDIA_SERVER ":");
+        g_assert_cmpuint (target.prefix_len, ==, strlen (MEDIA_SERVER ":"));
+        gssdp_target_clear (&target);
+
+        gssdp_target_init (&target, "upnp:rootdevice");
+        g_assert (!target.has_version);
+        g_assert_cmpstr (target.prefix, ==, "upnp:rootdevice");
+        gssdp_target_clear (&target);
+
+        /* The colon of a plain uuid is no version separator */
+        gssdp_target_init (&target, "uuid:1234");
+        g_assert (!target.has_version);
+        g_assert_cmpstr (target.prefix, ==, "uuid:1234");
+        gssdp_target_clear (&target);
+
+        gssdp_target_init (&target, "uuid:1234::" MEDIA_SERVER ":1");
+        g_assert (target.has_version);
+        g_assert_cmpuint (target.version, ==, 1);
+        gssdp_target_clear (&target);
+
+        gssdp_target_init (&target, MEDIA_SERVER ":1a");
+        g_assert (!target.has_version);
+        gssdp_target_clear (&target);
+}
+
+static void
+test_target_version (void)
+{
+        static const struct {
+                const char *target;
+                gsize       prefix_len;
+                guint       version;
+        } cases[] = {
+                { MEDIA_SERVER ":1", sizeof (MEDIA_SERVER), 1 },
+                { MEDIA_SERVER, sizeof (MEDIA_SERVER) - 1, 0 },
+                { "urn:schemas-upnp-org:service:ContentDirectory:4", 46, 4 },
+                { "urn:schemas-microsoft-com:service:"
+                  "X_MS_MediaReceiverRegistrar:1", 62, 1 },
+                { "urn:dial-multiscreen-org:service:dial:1", 38, 1 },
+                { "urn:schemas-sony-com:service:ScalarWebAPI:1", 42, 1 },
+                { "urn:example.com:device:Thing:12", 29, 12 },
+                { "urn:example.com:device:Thing:v2", 31, 0 },
+                { "urn:example.com:device:Thing:2.0", 32, 0 },
+                { "urn:example.com:device:Thing:", 29, 0 },
+                { "urn:example.com:device:Thing:99999999999", 29, G_MAXUINT },
+                { "uuid:81909e94-ebf4-469e-ac68-81f2f189de1b", 41, 0 },
+                { "uuid:1234", 9, 0 },
+                { "upnp:rootdevice", 15, 0 },
+                { "ssdp:all", 8, 0 },
+                { "", 0, 0 },
+        };
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+                guint version = G_MAXUINT - 1;
+                gsize len;
+
+                len = gssdp_target_prefix_length (cases[i].target, &version);
+                g_assert_cmpuint (len, ==, cases[i].prefix_len);
+                g_assert_cmpuint (version, ==, cases[i].version);
+        }
+}
+
+static void
+test_target_match (void)
+{
+        GSSDPTarget target;
+        guint version;
+
+        gssdp_target_init (&target, MEDIA_SERVER ":2");
+
+        g_assert (gssdp_target_match (&target, MEDIA_SERVER ":2", &version));
+        g_assert_cmpuint (version, ==, 2);
+        g_assert (gssdp_target_match (&target, MEDIA_SERVER ":1", &version));
+        g_assert_cmpuint (version, ==, 1);
+        g_assert (gssdp_target_match (&target, MEDIA_SERVER ":10", &version));
+        g_assert_cmpuint (version, ==, 10);
+
+        g_assert (!gssdp_target_match (&target, MEDIA_SERVER, &version));
+        g_assert (!gssdp_target_match (&target, MEDIA_SERVER ":", &version));
+        g_assert (!gssdp_target_match (&target, MEDIA_SERVER ":x", &version));
+        g_assert (!gssdp_target_match (&target,
+                                       "urn:schemas-upnp-org:device:"
+                                       "MediaRenderer:1",
+                                       &version));
+
+        gssdp_target_clear (&target);
+
+        gssdp_target_init (&target, "upnp:rootdevice");
+
+        g_assert (gssdp_target_match (&target, "upnp:rootdevice", &version));
+        g_assert_cmpuint (version, ==, 0);
+        g_assert (!gssdp_target_match (&target, "upnp:rootdevice2", &version));
+        g_assert (!gssdp_target_match (&target, "upnp:root", &version));
+
+        gssdp_target_clear (&target);
+}
+
+/* What GSSDPResourceBrowser used to do for every NT and ST */
+static gboolean
+regex_match (GRegex *regex, const char *str, guint *version)
+{
+        GMatchInfo *info;
+        char *tmp;
+
+        if (!g_regex_match (regex, str, 0, &info)) {
+                g_match_info_free (info);
+
+                return FALSE;
+        }
+
+        *version = atoi ((tmp = g_match_info_fetch (info, 1)));
+        g_free (tmp);
+        g_match_info_free (info);
+
+        return TRUE;
+}
+
+/* What GSSDPResourceGroup used to do for every M-SEARCH */
+static guint
+regex_version (const char *target)
+{
+        const char *version;
+
+        if (strncmp (target, "urn:", 4) != 0)
+                return 0;
+
+        version = g_strrstr (target, ":") + 1;
+        if (!g_regex_match_simple ("[0-9]+$", version, 0, 0))
+                return 0;
+
+        return atoi (version);
+}
+
+#define BENCHMARK_ITERATIONS 1000000
+
+static void
+test_target_benchmark (void)
+{
+        const char *targets[] = {
+                MEDIA_SERVER ":1",
+                MEDIA_SERVER ":4",
+                "urn:schemas-upnp-org:device:MediaRenderer:1",
+                "upnp:rootdevice",
+        };
+        GSSDPTarget target;
+        GRegex *regex;
+        gdouble elapsed;
+        guint i, version, matches;
+
+        gssdp_target_init (&target, MEDIA_SERVER ":2");
+
+        matches = 0;
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                if (gssdp_target_match (&target,
+                                        targets[i % G_N_ELEMENTS (targets)],
+                                        &version) &&
+                    version >= target.version)
+                        matches++;
+        }
+        elapsed = g_test_timer_elapsed ();
+        g_assert_cmpuint (matches, ==, BENCHMARK_ITERATIONS / 4);
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "GSSDPTarget: %.0f matches/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+
+        gssdp_target_clear (&target);
+
+        regex = g_regex_new (MEDIA_SERVER ":([0-9]+)", 0, 0, NULL);
+
+        matches = 0;
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                if (regex_match (regex,
+                                 targets[i % G_N_ELEMENTS (targets)],
+                                 &version) &&
+                    version >= 2)
+                        matches++;
+        }
+        elapsed = g_test_timer_elapsed ();
+        g_assert_cmpuint (matches, ==, BENCHMARK_ITERATIONS / 4);
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "GRegex: %.0f matches/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+
+        g_regex_unref (regex);
+
+        /* Version extraction alone */
+        matches = 0;
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                gssdp_target_prefix_length
+                                (targets[i % G_N_ELEMENTS (targets)],
+                                 &version);
+                matches += version;
+        }
+        elapsed = g_test_timer_elapsed ();
+        g_assert_cmpuint (matches, ==, BENCHMARK_ITERATIONS / 4 * 6);
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "gssdp_target_prefix_length: "
+                                 "%.0f versions/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+
+        matches = 0;
+        g_test_timer_start ();
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+                matches += regex_version (targets[i % G_N_ELEMENTS (targets)]);
+        elapsed = g_test_timer_elapsed ();
+        g_assert_cmpuint (matches, ==, BENCHMARK_ITERATIONS / 4 * 6);
+        g_test_maximized_result (BENCHMARK_ITERATIONS / elapsed,
+                                 "g_regex_match_simple: %.0f versions/s",
+                                 BENCHMARK_ITERATIONS / elapsed);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/target/split", test_target_split);
+        g_test_add_func ("/target/version", test_target_version);
+        g_test_add_func ("/target/match", test_target_match);
+
+        if (g_test_perf ())
+                g_test_add_func ("/target/benchmark", test_target_benchmark);
+
+        g_test_run ();
+
+        return 0;
+}
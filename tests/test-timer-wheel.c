@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <libgssdp/gssdp-timer-wheel.h>
+
+typedef struct {
+        GSSDPTimer  timer;
+        const char *name;
+        GString    *log;
+        gint64      fired;
+} TestTimer;
+
+static void
+on_timer (gpointer user_data)
+{
+        TestTimer *timer = user_data;
+
+        timer->fired = g_get_monotonic_time ();
+        g_string_append_printf (timer->log, "%s ", timer->name);
+}
+
+static void
+test_timer_init (TestTimer  *timer,
+                 const char *name,
+                 GString    *log)
+{
+        gssdp_timer_init (&timer->timer, on_timer, timer);
+        timer->name = name;
+        timer->log = log;
+        timer->fired = 0;
+}
+
+static gboolean
+on_deadline (gpointer user_data)
+{
+        *(gboolean *) user_data = TRUE;
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Runs the default main context for @timeout milliseconds */
+static void
+run_for (guint timeout)
+{
+        gboolean done = FALSE;
+
+        g_timeout_add (timeout, on_deadline, &done);
+        while (!done)
+                g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_timer_wheel_schedule (void)
+{
+        GString *log = g_string_new (NULL);
+        GSSDPTimerWheel *wheel;
+        TestTimer a, b, c;
+        gint64 start;
+
+        wheel = gssdp_timer_wheel_new (10, 16);
+        gssdp_timer_wheel_attach (wheel, NULL);
+
+        test_timer_init (&a, "a", log);
+        test_timer_init (&b, "b", log);
+        test_timer_init (&c, "c", log);
+
+        start = g_get_monotonic_time ();
+        gssdp_timer_wheel_schedule (wheel, &a.timer, 20);
+        gssdp_timer_wheel_schedule (wheel, &b.timer, 30);
+        gssdp_timer_wheel_schedule (wheel, &c.timer, 40);
+        g_assert (gssdp_timer_is_pending (&b.timer));
+
+        gssdp_timer_wheel_cancel (wheel, &b.timer);
+        g_assert (!gssdp_timer_is_pending (&b.timer));
+
+        /* Replaces the earlier deadline */
+        gssdp_timer_wheel_schedule (wheel, &a.timer, 60);
+
+        run_for (150);
+
+        g_assert_cmpstr (log->str, ==, "c a ");
+        g_assert_cmpint (a.fired - start, >=, 60000);
+        g_assert_cmpint (c.fired - start, >=, 40000);
+        g_assert (!gssdp_timer_is_pending (&a.timer));
+        g_assert (!gssdp_timer_is_pending (&c.timer));
+
+        gssdp_timer_wheel_destroy (wheel);
+        g_string_free (log, TRUE);
+}
+
+static void
+test_timer_wheel_revolution (void)
+{
+        GString *log = g_string_new (NULL);
+        GSSDPTimerWheel *wheel;
+        TestTimer near, far;
+        gint64 start;
+
+        /* One revolution is 40 ms, so both timers share a slot */
+        wheel = gssdp_timer_wheel_new (10, 4);
+        gssdp_timer_wheel_attach (wheel, NULL);
+
+        test_timer_init (&near, "near", log);
+        test_timer_init (&far, "far", log);
+
+        start = g_get_monotonic_time ();
+        gssdp_timer_wheel_schedule (wheel, &far.timer, 100);
+        gssdp_timer_wheel_schedule (wheel, &near.timer, 20);
+
+        while (near.fired == 0)
+                g_main_context_iteration (NULL, TRUE);
+
+        /* Visiting the slot early must not run the later timer */
+        g_assert_cmpstr (log->str, ==, "near ");
+        g_assert (gssdp_timer_is_pending (&far.timer));
+
+        while (far.fired == 0)
+                g_main_context_iteration (NULL, TRUE);
+
+        g_assert_cmpstr (log->str, ==, "near far ");
+        g_assert_cmpint (far.fired - start, >=, 100000);
+
+        gssdp_timer_wheel_destroy (wheel);
+        g_string_free (log, TRUE);
+}
+
+static void
+test_timer_wheel_catch_up (void)
+{
+        GString *log = g_string_new (NULL);
+        GSSDPTimerWheel *wheel;
+        TestTimer t1, t2, t3, later;
+
+        /* One revolution is 80 ms */
+        wheel = gssdp_timer_wheel_new (10, 8);
+        gssdp_timer_wheel_attach (wheel, NULL);
+
+        test_timer_init (&t1, "1", log);
+        test_timer_init (&t2, "2", log);
+        test_timer_init (&t3, "3", log);
+        test_timer_init (&later, "later", log);
+
+        gssdp_timer_wheel_schedule (wheel, &t3.timer, 30);
+        gssdp_timer_wheel_schedule (wheel, &t1.timer, 10);
+        gssdp_timer_wheel_schedule (wheel, &t2.timer, 20);
+        gssdp_timer_wheel_schedule (wheel, &later.timer, 1000);
+
+        /* The main loop stalls for several revolutions */
+        g_usleep (200000);
+
+        while (t3.fired == 0)
+                g_main_context_iteration (NULL, TRUE);
+
+        /* All of them at once, still in order */
+        g_assert_cmpstr (log->str, ==, "1 2 3 ");
+        g_assert (gssdp_timer_is_pending (&later.timer));
+
+        gssdp_timer_wheel_cancel (wheel, &later.timer);
+        run_for (50);
+        g_assert_cmpstr (log->str, ==, "1 2 3 ");
+
+        gssdp_timer_wheel_destroy (wheel);
+        g_string_free (log, TRUE);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/timer-wheel/schedule", test_timer_wheel_schedule);
+        g_test_add_func ("/timer-wheel/revolution",
+                         test_timer_wheel_revolution);
+        g_test_add_func ("/timer-wheel/catch-up", test_timer_wheel_catch_up);
+
+        g_test_run ();
+
+        return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The GSSDP authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <libgssdp/gssdp-user-agent-cache.h>
+
+#define AGENT_A "Linux/4.9 UPnP/1.0 GSSDP/1.2"
+#define AGENT_B "Windows/10 UPnP/1.0 Foo/1.0"
+
+static void
+test_user_agent_cache_lru (void)
+{
+        GSSDPUserAgentCache *cache;
+
+        cache = gssdp_user_agent_cache_new (2, 0);
+
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_A);
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:02", AGENT_B);
+
+        /* Refreshing the first peer makes the second one the oldest */
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_A);
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:03", AGENT_A);
+
+        g_assert_cmpuint (gssdp_user_agent_cache_get_size (cache), ==, 2);
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:01"), ==, AGENT_A);
+        g_assert_null (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:02"));
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:03"), ==, AGENT_A);
+
+        gssdp_user_agent_cache_set_capacity (cache, 1);
+        g_assert_cmpuint (gssdp_user_agent_cache_get_size (cache), ==, 1);
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:03"), ==, AGENT_A);
+
+        gssdp_user_agent_cache_free (cache);
+}
+
+static void
+test_user_agent_cache_update (void)
+{
+        GSSDPUserAgentCache *cache;
+        const char *agent;
+
+        cache = gssdp_user_agent_cache_new (8, 0);
+
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_A);
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:02", AGENT_A);
+
+        /* Peers with the same agent share the string */
+        agent = gssdp_user_agent_cache_lookup (cache, "00:00:00:00:00:01");
+        g_assert (agent == gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:02"));
+
+        /* An unchanged agent keeps its string */
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_A);
+        g_assert (agent == gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:01"));
+
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_B);
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:01"), ==, AGENT_B);
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:02"), ==, AGENT_A);
+
+        gssdp_user_agent_cache_free (cache);
+}
+
+static void
+test_user_agent_cache_ttl (void)
+{
+        GSSDPUserAgentCache *cache;
+
+        cache = gssdp_user_agent_cache_new (8, 1);
+
+        gssdp_user_agent_cache_update (cache, "00:00:00:00:00:01", AGENT_A);
+        g_assert_cmpstr (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:01"), ==, AGENT_A);
+
+        g_usleep (G_USEC_PER_SEC + G_USEC_PER_SEC / 10);
+
+        g_assert_null (gssdp_user_agent_cache_lookup
+                                (cache, "00:00:00:00:00:01"));
+        g_assert_cmpuint (gssdp_user_agent_cache_get_size (cache), ==, 0);
+
+        gssdp_user_agent_cache_free (cache);
+}
+
+int main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add_func ("/user-agent-cache/lru", test_user_agent_cache_lru);
+        g_test_add_func ("/user-agent-cache/update",
+                         test_user_agent_cache_update);
+        g_test_add_func ("/user-agent-cache/ttl", test_user_agent_cache_ttl);
+
+        g_test_run ();
+
+        return 0;
+}